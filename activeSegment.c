@@ -2,14 +2,49 @@
 #include <stdlib.h>
 #include <string.h>
 #include "activeSegment.h"
+#include "perfStats.h"
+
+// Freed segments are kept on a free list until trimActiveSegmentPool(). An
+// empty list is refilled with as many segments as are already out, so once
+// the pool has covered the largest replicate no more are allocated
+static ActiveSegment *activeFreeList = NULL;
+static long activeSegmentsAllocated = 0;
+
+void trimActiveSegmentPool(void) {
+    ActiveSegment *seg;
+
+    while (activeFreeList) {
+        seg = activeFreeList;
+        activeFreeList = seg->next;
+        free(seg);
+        activeSegmentsAllocated--;
+    }
+}
+
+static void refillActiveSegmentPool(void) {
+    long n = activeSegmentsAllocated > 64 ? activeSegmentsAllocated : 64;
+    ActiveSegment *seg;
+
+    while (n-- > 0) {
+        seg = (ActiveSegment*)malloc(sizeof(ActiveSegment));
+        if (!seg) {
+            fprintf(stderr, "Memory allocation failed for ActiveSegment\n");
+            exit(1);
+        }
+        seg->next = activeFreeList;
+        activeFreeList = seg;
+        activeSegmentsAllocated++;
+    }
+}
 
 // Create a new active segment
 ActiveSegment* newActiveSegment(int start, int end) {
-    ActiveSegment *seg = (ActiveSegment*)malloc(sizeof(ActiveSegment));
-    if (!seg) {
-        fprintf(stderr, "Memory allocation failed for ActiveSegment\n");
-        exit(1);
-    }
+    ActiveSegment *seg;
+
+    if (!activeFreeList) refillActiveSegmentPool();
+    seg = activeFreeList;
+    activeFreeList = seg->next;
+    PERF_SEGMENT_ALLOC(Active);
     seg->start = start;
     seg->end = end;
     seg->next = NULL;
@@ -18,7 +53,11 @@ ActiveSegment* newActiveSegment(int start, int end) {
 
 // Free a single segment
 void freeActiveSegment(ActiveSegment *seg) {
-    if (seg) free(seg);
+    if (seg) {
+        seg->next = activeFreeList;
+        activeFreeList = seg;
+        PERF_SEGMENT_FREE(Active);
+    }
 }
 
 // Free entire segment list
@@ -35,6 +35,7 @@ int verifyActiveMaterial(ActiveMaterial *am, int nSites);
 // Internal helpers (exposed for testing)
 ActiveSegment* newActiveSegment(int start, int end);
 void freeActiveSegment(ActiveSegment *seg);
+void trimActiveSegmentPool(void);
 ActiveSegment* coalesceActiveSegments(ActiveSegment *head);
 void removeFixedRegion(ActiveMaterial *am, int start, int end);
 
@@ -1,4 +1,5 @@
 #include <math.h>
+#include "rngStream.h"
 
 double detSweepFreq(double t, double s);
 double neutralStochastic(double dt, double currentFreq);
@@ -10,8 +11,9 @@ double variablePopnSizeTraj(double dt, double currentFreq, double alpha, double
 /* Forward declaration for ranf() */
 double ranf(void);
 
-/* Optimized inline version of neutralStochastic */
-static inline double neutralStochasticOptimized(double dt, double currentFreq) {
+/* Optimized inline version of neutralStochastic; draws from rs, or from */
+/* ranf() when rs is NULL */
+static inline double neutralStochasticStream(double dt, double currentFreq, RngStream *rs) {
     // Precompute common expressions
     double drift_term = -currentFreq * dt;
     double variance = currentFreq * (1.0 - currentFreq) * dt;
@@ -22,13 +24,17 @@ static inline double neutralStochasticOptimized(double dt, double currentFreq) {
     double diffusion_term = sqrt(variance);
     
     // Keep original branching structure but optimize the calculation
-    if (ranf() < 0.5) {
+    if (rngUniform(rs) < 0.5) {
         return currentFreq + drift_term + diffusion_term;
     } else {
         return currentFreq + drift_term - diffusion_term;
     }
 }
 
+static inline double neutralStochasticOptimized(double dt, double currentFreq) {
+    return neutralStochasticStream(dt, currentFreq, NULL);
+}
+
 /* Optimized inline version of genicSelectionStochastic (backwards in time) */
 static inline double genicSelectionStochasticOptimized(double dt, double currentFreq, double alpha) {
     // Precompute common expressions
@@ -49,8 +55,9 @@ static inline double genicSelectionStochasticOptimized(double dt, double current
     }
 }
 
-/* Optimized inline version of genicSelectionStochasticForwards */
-static inline double genicSelectionStochasticForwardsOptimized(double dt, double currentFreq, double alpha) {
+/* Optimized inline version of genicSelectionStochasticForwards; draws from rs, */
+/* or from ranf() when rs is NULL */
+static inline double genicSelectionStochasticForwardsStream(double dt, double currentFreq, double alpha, RngStream *rs) {
     // Precompute common expressions
     double p_q = currentFreq * (1.0 - currentFreq);
     
@@ -61,9 +68,13 @@ static inline double genicSelectionStochasticForwardsOptimized(double dt, double
     double drift_term = (alpha * p_q / tanh(alpha_p)) * dt;
     double diffusion_term = sqrt(p_q * dt);
     
-    if (ranf() < 0.5) {
+    if (rngUniform(rs) < 0.5) {
         return currentFreq + drift_term + diffusion_term;
     } else {
         return currentFreq + drift_term - diffusion_term;
     }
+}
+
+static inline double genicSelectionStochasticForwardsOptimized(double dt, double currentFreq, double alpha) {
+    return genicSelectionStochasticForwardsStream(dt, currentFreq, alpha, NULL);
 }
\ No newline at end of file
@@ -4,13 +4,61 @@
 #include <limits.h>
 #include "ancestrySegment.h"
 #include "ancestrySegmentAVL.h"
+#include "perfStats.h"
 
-AncestrySegment* newSegment(int start, int end, AncestrySegment *left, AncestrySegment *right) {
-    AncestrySegment *seg = (AncestrySegment*)calloc(1, sizeof(AncestrySegment));
-    if (!seg) {
-        fprintf(stderr, "Memory allocation failed for AncestrySegment\n");
-        exit(1);
+// Released segments wait on a free list, linked through next, and are handed
+// out again before asking the allocator; trimAncestrySegmentPool() returns
+// them to the system. An empty list is refilled with as many segments as are
+// already out, so once the pool has covered the largest replicate no more are
+// allocated
+static AncestrySegment *segmentFreeList = NULL;
+static long segmentsAllocated = 0;
+
+static void refillSegmentPool(void) {
+    long n = segmentsAllocated > 256 ? segmentsAllocated : 256;
+    AncestrySegment *seg;
+
+    while (n-- > 0) {
+        seg = (AncestrySegment*)malloc(sizeof(AncestrySegment));
+        if (!seg) {
+            fprintf(stderr, "Memory allocation failed for AncestrySegment\n");
+            exit(1);
+        }
+        seg->next = segmentFreeList;
+        segmentFreeList = seg;
+        segmentsAllocated++;
     }
+}
+
+static AncestrySegment* allocSegment(void) {
+    AncestrySegment *seg;
+
+    if (!segmentFreeList) refillSegmentPool();
+    seg = segmentFreeList;
+    segmentFreeList = seg->next;
+    memset(seg, 0, sizeof(AncestrySegment));
+    return seg;
+}
+
+static void recycleSegment(AncestrySegment *seg) {
+    seg->next = segmentFreeList;
+    segmentFreeList = seg;
+}
+
+void trimAncestrySegmentPool(void) {
+    AncestrySegment *seg;
+
+    while (segmentFreeList) {
+        seg = segmentFreeList;
+        segmentFreeList = seg->next;
+        free(seg);
+        segmentsAllocated--;
+    }
+}
+
+AncestrySegment* newSegment(int start, int end, AncestrySegment *left, AncestrySegment *right) {
+    AncestrySegment *seg = allocSegment();
+    PERF_SEGMENT_ALLOC(Ancestry);
     seg->start = start;
     seg->end = end;
     seg->left = left;
@@ -68,7 +116,7 @@ AncestrySegment* copySegmentTree(AncestrySegment *root) {
     return newRoot;
 }
 
-uint16_t getAncestryCount(AncestrySegment *root, int site) {
+AncestryCount getAncestryCount(AncestrySegment *root, int site) {
     // Use AVL tree for O(log n) lookup if available
     if (root && root->avlTree) {
         AncestrySegment *found = findSegmentContaining((AVLTree*)root->avlTree, site);
@@ -120,7 +168,8 @@ void releaseSegment(AncestrySegment *seg) {
             freeAVLTree((AVLTree*)seg->avlTree);
             seg->avlTree = NULL;
         }
-        free(seg);
+        recycleSegment(seg);
+        PERF_SEGMENT_FREE(Ancestry);
     }
 }
 
@@ -133,7 +182,7 @@ AncestrySegment* shallowCopySegment(AncestrySegment *seg) {
 }
 
 // Helper function to create a segment list covering an interval
-static AncestrySegment* createSegmentList(int start, int end, uint16_t count) {
+static AncestrySegment* createSegmentList(int start, int end, AncestryCount count) {
     if (start >= end) return NULL;
     return newSegment(start, end, NULL, NULL);
 }
@@ -150,7 +199,8 @@ static AncestrySegment* coalesceSegments(AncestrySegment *head) {
             AncestrySegment *toRemove = current->next;
             current->end = toRemove->end;
             current->next = toRemove->next;
-            free(toRemove);
+            recycleSegment(toRemove);
+            PERF_SEGMENT_FREE(Ancestry);
             // Don't advance current, check if we can merge with the new next
         } else {
             current = current->next;
@@ -162,7 +212,7 @@ static AncestrySegment* coalesceSegments(AncestrySegment *head) {
 
 // Helper function to add a segment to the result list
 static void addSegmentToResult(AncestrySegment **result, AncestrySegment **tail, 
-                               int start, int end, uint16_t count) {
+                               int start, int end, AncestryCount count) {
     if (start >= end || count == 0) return;  // Skip empty or zero-count segments
     
     // Check if we can merge with the previous segment
@@ -228,7 +278,7 @@ AncestrySegment* mergeAncestryTrees(AncestrySegment *leftTree, AncestrySegment *
         if (nextPos == INT_MAX) break;  // No more events
         
         // Calculate total count for interval [pos, nextPos)
-        uint16_t count = 0;
+        AncestryCount count = 0;
         if (l && pos >= l->start && pos < l->end) count += l->count;
         if (r && pos >= r->start && pos < r->end) count += r->count;
         
@@ -3,11 +3,27 @@
 
 #include <stdint.h>
 
+// Lineage counts are 16 bits, enough for 65535 samples, unless the build sets
+// ANCESTRY_COUNT_BITS to 32 (make WIDE_COUNTS=1) for larger samples.
+#ifndef ANCESTRY_COUNT_BITS
+#define ANCESTRY_COUNT_BITS 16
+#endif
+
+#if ANCESTRY_COUNT_BITS == 16
+typedef uint16_t AncestryCount;
+#define ANCESTRY_COUNT_MAX 65535L
+#elif ANCESTRY_COUNT_BITS == 32
+typedef uint32_t AncestryCount;
+#define ANCESTRY_COUNT_MAX 4294967295L
+#else
+#error "ANCESTRY_COUNT_BITS must be 16 or 32"
+#endif
+
 typedef struct AncestrySegment {
     int start, end;  // genomic interval [start, end)
     struct AncestrySegment *left, *right;  // child segments (for tree structure)
     struct AncestrySegment *next;  // linked list for segments at same level
-    uint16_t count;  // number of lineages
+    AncestryCount count;  // number of lineages
     int isLeaf;  // 1 if this is a leaf segment, 0 otherwise
     int refCount;  // Reference count for sharing
     void *avlTree;  // Optional AVL tree for fast lookups (only on root)
@@ -16,6 +32,7 @@ typedef struct AncestrySegment {
 // Basic operations
 AncestrySegment* newSegment(int start, int end, AncestrySegment *left, AncestrySegment *right);
 void freeSegmentTree(AncestrySegment *root);
+void trimAncestrySegmentPool(void);
 AncestrySegment* copySegmentTree(AncestrySegment *root);
 
 // Reference counting operations
@@ -24,7 +41,7 @@ void releaseSegment(AncestrySegment *seg);
 AncestrySegment* shallowCopySegment(AncestrySegment *seg);
 
 // Query operations
-uint16_t getAncestryCount(AncestrySegment *root, int site);
+AncestryCount getAncestryCount(AncestrySegment *root, int site);
 int hasAncestry(AncestrySegment *root, int site);
 
 // Tree operations for coalescence and recombination
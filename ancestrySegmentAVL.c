@@ -15,9 +15,34 @@ static int getBalance(AVLNode *node) {
     return node ? height(node->left) - height(node->right) : 0;
 }
 
+// Freed nodes and trees are kept on free lists (nodes linked through left)
+// until trimAVLPool(). An empty node list is refilled with as many nodes as
+// are already out, so once the pool has covered the largest replicate no
+// more are allocated
+static AVLNode *nodeFreeList = NULL;
+static AVLTree *treeFreeList = NULL;
+static long avlNodesAllocated = 0;
+
+static void refillAVLNodePool(void) {
+    long n = avlNodesAllocated > 64 ? avlNodesAllocated : 64;
+    AVLNode *node;
+
+    while (n-- > 0) {
+        node = (AVLNode*)malloc(sizeof(AVLNode));
+        if (!node) return;
+        node->left = nodeFreeList;
+        nodeFreeList = node;
+        avlNodesAllocated++;
+    }
+}
+
 static AVLNode* createAVLNode(AncestrySegment *segment) {
-    AVLNode *node = (AVLNode*)malloc(sizeof(AVLNode));
+    AVLNode *node;
+
+    if (!nodeFreeList) refillAVLNodePool();
+    node = nodeFreeList;
     if (!node) return NULL;
+    nodeFreeList = node->left;
     
     node->segment = segment;
     node->left = NULL;
@@ -123,12 +148,32 @@ static void freeAVLNodes(AVLNode *node) {
     if (!node) return;
     freeAVLNodes(node->left);
     freeAVLNodes(node->right);
-    free(node);
+    node->left = nodeFreeList;
+    nodeFreeList = node;
+}
+
+void trimAVLPool(void) {
+    void *next;
+
+    while (nodeFreeList) {
+        next = nodeFreeList->left;
+        free(nodeFreeList);
+        nodeFreeList = next;
+        avlNodesAllocated--;
+    }
+    while (treeFreeList) {
+        next = treeFreeList->nextFree;
+        free(treeFreeList);
+        treeFreeList = next;
+    }
 }
 
 // Public functions
 AVLTree* createAVLTree(void) {
-    AVLTree *tree = (AVLTree*)malloc(sizeof(AVLTree));
+    AVLTree *tree = treeFreeList;
+
+    if (tree) treeFreeList = tree->nextFree;
+    else tree = (AVLTree*)malloc(sizeof(AVLTree));
     if (!tree) return NULL;
     
     tree->root = NULL;
@@ -139,7 +184,8 @@ AVLTree* createAVLTree(void) {
 void freeAVLTree(AVLTree *tree) {
     if (!tree) return;
     freeAVLNodes(tree->root);
-    free(tree);
+    tree->nextFree = treeFreeList;
+    treeFreeList = tree;
 }
 
 void insertSegment(AVLTree *tree, AncestrySegment *segment) {
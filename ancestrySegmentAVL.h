@@ -12,14 +12,16 @@ typedef struct AVLNode {
 } AVLNode;
 
 // AVL tree structure
-typedef struct {
+typedef struct AVLTree {
     AVLNode *root;
     int size;
+    struct AVLTree *nextFree;  // link while on the free list
 } AVLTree;
 
 // AVL tree operations
 AVLTree* createAVLTree(void);
 void freeAVLTree(AVLTree *tree);
+void trimAVLPool(void);
 void insertSegment(AVLTree *tree, AncestrySegment *segment);
 AncestrySegment* findSegmentContaining(AVLTree *tree, int site);
 AVLTree* buildAVLFromList(AncestrySegment *listHead);
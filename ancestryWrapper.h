@@ -6,7 +6,7 @@
 // Wrapper functions for ancestry tree operations
 
 // Get ancestry count at a site
-static inline uint16_t getAncestryAt(rootedNode *node, int site) {
+static inline AncestryCount getAncestryAt(rootedNode *node, int site) {
     return node->ancestryRoot ? getAncestryCount(node->ancestryRoot, site) : 0;
 }
 
@@ -20,7 +20,7 @@ static inline int hasAncestryAt(rootedNode *node, int site) {
 
 // Check if site is polymorphic (has ancestry but not fixed)
 static inline int isPolymorphicAt(rootedNode *node, int site, int sampleSize) {
-    uint16_t count = getAncestryAt(node, site);
+    AncestryCount count = getAncestryAt(node, site);
     return count > 0 && count < sampleSize;
 }
 
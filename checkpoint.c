@@ -0,0 +1,122 @@
+// checkpoint.c
+// saving and restoring the state needed to resume a multi-replicate run
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "ranlib.h"
+
+#define CHECKPOINT_MAGIC "discoal-checkpoint 1"
+
+// the key identifies the run so a checkpoint is never resumed with other
+// parameters; the checkpoint options themselves may change between attempts
+char *checkpointArgsKey(int argc, const char **argv) {
+	size_t len = 1;
+	int i;
+	char *key;
+
+	for (i = 1; i < argc; i++) len += strlen(argv[i]) + 1;
+	key = malloc(len);
+	if (key == NULL) {
+		fprintf(stderr, "Error: Failed to allocate checkpoint key\n");
+		exit(1);
+	}
+	key[0] = '\0';
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--checkpoint") == 0 || strcmp(argv[i], "--checkpoint-every") == 0) {
+			i++;
+			continue;
+		}
+		if (strcmp(argv[i], "--resume") == 0) continue;
+		if (key[0] != '\0') strcat(key, " ");
+		strcat(key, argv[i]);
+	}
+	return key;
+}
+
+void checkpointCaptureRng(Checkpoint *ck) {
+	getsd(&ck->rngState1, &ck->rngState2);
+	ck->hasXoshiroState = rngBackend == RNG_XOSHIRO;
+	if (ck->hasXoshiroState) getxs(ck->xoshiroState);
+}
+
+void checkpointRestoreRng(const Checkpoint *ck) {
+	setsd(ck->rngState1, ck->rngState2);
+	if (ck->hasXoshiroState) setxs(ck->xoshiroState);
+}
+
+// written to a temporary file and renamed so a crash mid-write leaves the
+// previous checkpoint intact
+int writeCheckpoint(const char *fileName, const Checkpoint *ck) {
+	char tmpName[4096];
+	FILE *f;
+
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+	f = fopen(tmpName, "w");
+	if (f == NULL) {
+		perror("Failed to write checkpoint");
+		return 0;
+	}
+	fprintf(f, "%s\n", CHECKPOINT_MAGIC);
+	fprintf(f, "args %s\n", ck->argsKey);
+	fprintf(f, "seeds %ld %ld\n", ck->seed1, ck->seed2);
+	fprintf(f, "rng %ld %ld\n", ck->rngState1, ck->rngState2);
+	if (ck->hasXoshiroState)
+		fprintf(f, "xoshiro %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", ck->xoshiroState[0],
+		        ck->xoshiroState[1], ck->xoshiroState[2], ck->xoshiroState[3]);
+	fprintf(f, "completed %ld\n", ck->completed);
+	fprintf(f, "simulated %ld\n", ck->simulated);
+	fprintf(f, "offset %ld\n", ck->outputOffset);
+	if (fflush(f) != 0 || fsync(fileno(f)) != 0) {
+		perror("Failed to write checkpoint");
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	if (rename(tmpName, fileName) != 0) {
+		perror("Failed to write checkpoint");
+		return 0;
+	}
+	return 1;
+}
+
+// returns 1 on success, 0 if the file does not exist and -1 if it is malformed
+int readCheckpoint(const char *fileName, Checkpoint *ck) {
+	FILE *f;
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	int fields = 0;
+
+	memset(ck, 0, sizeof(*ck));
+	f = fopen(fileName, "r");
+	if (f == NULL) return 0;
+
+	while ((len = getline(&line, &cap, f)) > 0) {
+		if (line[len - 1] == '\n') line[--len] = '\0';
+		if (strcmp(line, CHECKPOINT_MAGIC) == 0) fields |= 1;
+		else if (strncmp(line, "args ", 5) == 0) {
+			ck->argsKey = strdup(line + 5);
+			fields |= 2;
+		}
+		else if (sscanf(line, "seeds %ld %ld", &ck->seed1, &ck->seed2) == 2) fields |= 4;
+		else if (sscanf(line, "rng %ld %ld", &ck->rngState1, &ck->rngState2) == 2) fields |= 8;
+		else if (sscanf(line, "xoshiro %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64, &ck->xoshiroState[0],
+		                &ck->xoshiroState[1], &ck->xoshiroState[2], &ck->xoshiroState[3]) == 4)
+			ck->hasXoshiroState = 1;
+		else if (sscanf(line, "completed %ld", &ck->completed) == 1) fields |= 16;
+		else if (sscanf(line, "simulated %ld", &ck->simulated) == 1) fields |= 32;
+		else if (sscanf(line, "offset %ld", &ck->outputOffset) == 1) fields |= 64;
+	}
+	free(line);
+	fclose(f);
+	return fields == 127 ? 1 : -1;
+}
+
+void freeCheckpoint(Checkpoint *ck) {
+	free(ck->argsKey);
+	ck->argsKey = NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+// Checkpoint/resume for long multi-replicate runs. Between replicates the
+// only state main() carries forward is the RNG state and the replicate
+// counters, so that is all a checkpoint holds, together with the number of
+// stdout bytes the completed replicates occupy.
+
+#include <stdint.h>
+
+typedef struct {
+	char *argsKey;          // command line without argv[0] and checkpoint flags
+	long seed1, seed2;      // seeds printed in the header
+	long rngState1, rngState2;  // getsd() of the current generator
+	int hasXoshiroState;    // set under --rng xoshiro
+	uint64_t xoshiroState[4];   // getxs()
+	long completed;         // replicates written to stdout
+	long simulated;         // replicates simulated (differs from completed under -C)
+	long outputOffset;      // stdout bytes covering the completed replicates
+} Checkpoint;
+
+char *checkpointArgsKey(int argc, const char **argv);
+void checkpointCaptureRng(Checkpoint *ck);
+void checkpointRestoreRng(const Checkpoint *ck);
+int writeCheckpoint(const char *fileName, const Checkpoint *ck);
+int readCheckpoint(const char *fileName, Checkpoint *ck);
+void freeCheckpoint(Checkpoint *ck);
+
+#endif
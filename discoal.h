@@ -4,16 +4,19 @@
 #ifndef __DISCOAL_GLOBALS__
 #define __DISCOAL_GLOBALS__
 
+#include <stddef.h>
 #include <stdint.h>
+#include <math.h>
 #include "ancestrySegment.h"
 #include "activeSegment.h"
+#include "rngStream.h"
 
 /******************************************************************************/
 /* Global constants and limits                                                */
 /*                                                                            */
 
 /* Still needed for various static arrays and limits */
-#define MAXSITES 100000000   /* Maximum number of sites - used for input validation */
+#define MAXSITES 2000000000  /* Maximum number of sites: site indices are ints */
 #define MAXMUTS 40000        /* Maximum mutations for output formatting */
 #define MAXTIME 100000.0     /* Sentinel value representing "infinite" time */
 #define MAXPOPS 121          /* Maximum number of populations */
@@ -38,23 +41,30 @@
 /* they pass on to their children) as well as the number of descendents       */
 /* at each site                                                               */
 /* Nodes are used to build the coalescent tree and place mutations            */
+/* The node table is split in two: the fields the passes over the whole graph */
+/* stream through (times, branch lengths, links, nancSites) are columns       */
+/* indexed by the node's id, declared with the globals below. Links are       */
+/* int32 ids, NO_NODE when absent. A rootedNode is the cold rest of the node  */
 
 typedef struct rootedNode
 {
-	struct rootedNode *leftParent, *rightParent, *leftChild, *rightChild;
-	double time, branchLength, blProb;
-	double *muts;
-	int nancSites, lLim, rLim;  // Still needed, calculated from ancestry tree
-	int id, mutationNumber, population, sweepPopn;
+	int id;                     // row in the node columns, fixed for the replicate
+	int population, sweepPopn;
+	int lLim, rLim;  // Still needed, calculated from ancestry tree
+	int mutationNumber;
 	int mutsCapacity;  // Track allocated capacity for muts
-	int ndes[2],*leafs;
-	double times[2];
+	double *muts;               // NULL until the first mutation
 	// Ancestry segment tree for tracking which sites this node is ancestral to
 	AncestrySegment *ancestryRoot;
-
 }
 rootedNode;
 
+/* Nodes are handed out from blocks of NODE_BLOCK_SIZE rather than malloc'd   */
+/* one at a time, so a replicate's graph sits in contiguous memory with no    */
+/* per-node allocator overhead. freeTree() recycles the blocks                */
+#define NODE_BLOCK_SIZE 4096
+#define NO_NODE (-1)
+
 /******************************************************************************/
 
 /******************************************************************************/
@@ -84,6 +94,25 @@ event;
 
 rootedNode  **nodes, **allNodes;
 int nodesCapacity, allNodesCapacity;
+rootedNode **nodeBlocks;
+int nodeBlockCount, nodeBlocksCapacity;
+long nodeStoreUsed;
+/* node columns, one row per slot of the node store; a node's id is its row */
+/* and, since addNode() appends in creation order, its index in allNodes    */
+double *nodeTime, *nodeBranchLength;
+int32_t *nodeLeftParent, *nodeRightParent, *nodeLeftChild, *nodeRightChild;
+int32_t *nodeNancSites;
+long nodeColumnsCapacity;
+
+//nodeAt-- the node stored in row id, NULL for NO_NODE
+static inline rootedNode *nodeAt(int32_t id) {
+	return id == NO_NODE ? NULL : &nodeBlocks[id / NODE_BLOCK_SIZE][id % NODE_BLOCK_SIZE];
+}
+
+static inline rootedNode *leftParentOf(const rootedNode *aNode) { return nodeAt(nodeLeftParent[aNode->id]); }
+static inline rootedNode *rightParentOf(const rootedNode *aNode) { return nodeAt(nodeRightParent[aNode->id]); }
+static inline rootedNode *leftChildOf(const rootedNode *aNode) { return nodeAt(nodeLeftChild[aNode->id]); }
+static inline rootedNode *rightChildOf(const rootedNode *aNode) { return nodeAt(nodeRightChild[aNode->id]); }
 
 // int activeMaterial[MAXSITES];  // DEPRECATED - replaced by segment structure
 ActiveMaterial activeMaterialSegments;  // New segment-based structure
@@ -119,6 +148,7 @@ int priorTheta, priorRho, priorAlpha, priorTau, priorX, priorF0, priorE1, priorE
 double gammaCoRatioMode, gammaCoRatio;
 double pThetaUp, pThetaLow,pRhoMean,pRhoUp,pRhoLow,pAlphaUp,pAlphaLow,pTauUp,pTauLow,pXUp,pXLow,pF0Up,pF0Low,pUALow,pUAUp,pCUp,pCLow;
 double pE2TLow,pE1TLow, pE2THigh, pE1THigh, pE1SLow, pE1SHigh, pE2SLow,pE2SHigh;
+double pE1T, pE1S, pE2T, pE2S;  /* the epoch times and sizes last drawn from -Pe1 and -Pe2 */
 double migMat[MAXPOPS][MAXPOPS], migMatConst[MAXPOPS][MAXPOPS];
 double recurSweepRate;
 
@@ -137,6 +167,33 @@ char trajectoryFilename[256];  // Current trajectory file
 int trajectoryFd;              // File descriptor for mmap
 size_t trajectoryFileSize;     // Size of mmap'd region
 
+/* The loop state of proposeTrajectory, so a trajectory can be generated one */
+/* step at a time. In replay mode the accepted trajectory is not stored;     */
+/* the stepper is restarted from the RNG state at proposal start instead.    */
+/* Steppers with explicitStream set draw from rng rather than from ranf().   */
+/* With a tolerance above 0 a step spans substeps base time steps            */
+typedef struct trajectoryStepper
+{
+	int event, insweepphase, explicitStream;
+	char sweepMode;
+	float x;
+	long substeps;
+	double alpha, startTime, ttau, tInc, tIncOrig, minF, N, Nmax, currentSizeRatio, localNextTime;
+	double tolerance;
+	RngStream rng;
+}
+trajectoryStepper;
+
+int trajectoryReplayMode;
+trajectoryStepper replayStepper;
+int trajectoryThreads;         /* concurrent proposals with --traj-threads */
+
+/* Adaptive time steps (--adaptive-dt): 0 keeps the fixed step of -i. Stored */
+/* adaptive trajectories hold the frequency and the substep count per step   */
+#define ADAPTIVE_MAX_SUBSTEPS (1L << 24)
+double adaptiveStepTolerance;
+long trajectorySubstepsLeft;   /* base steps left in the current coarse step */
+
 struct event *events;          /* Dynamic array of demographic events */
 int eventsCapacity;            /* Allocated capacity for events array */
 
@@ -155,5 +212,42 @@ int ancSampleTime;
 
 int hidePartialSNP;
 
+/* set by default: mutations are not pushed down to the leaves; genotypes    */
+/* come from a left-to-right sweep over the marginal trees. --push-down      */
+/* clears it                                                                 */
+int leafBitsetMode;
+int segmentMutationMode;       /* --segment-mutations: rejection-free placement */
+int keepBuffersMode;           /* --keep-buffers: storage kept between replicates */
+char alleleCodes[3];           /* ancestral, derived and missing cells of the genotype matrix */
+
+/* Positions along the region are fractions in [0,1); site bp covers         */
+/* [bp/nSites, (bp+1)/nSites). discoal has always mapped positions to sites  */
+/* in float arithmetic, which keeps earlier output reproducible but misplaces */
+/* positions by up to nSites/2^24 sites. exactPositionMode (--exact-positions,*/
+/* and always above FLOAT_SITE_LIMIT sites) keeps them in double precision    */
+/* and prints positions with enough decimals to tell the sites apart          */
+#define FLOAT_SITE_LIMIT 16777216
+int exactPositionMode;
+int positionDigits;
+
+static inline int siteAt(double position){
+	if(exactPositionMode)
+		return (int) floor(position * nSites);
+	return floor((float) position * nSites);
+}
+
+/* the position where site bp starts */
+static inline double siteStart(int bp){
+	if(exactPositionMode)
+		return (double) bp / nSites;
+	return (float) bp / nSites;
+}
+
+/* index of a site in the sample x segsites haplotype matrix; in size_t, as  */
+/* a wide build's samples times MAXMUTS sites outgrow an int                 */
+static inline size_t haplotypeCell(int sample, int site, int segsites){
+	return (size_t) sample * segsites + site;
+}
+
 
 #endif
@@ -0,0 +1,85 @@
+"""Send simulation requests to a discoal server started with discoal --serve.
+
+usage: python discoalClient.py socketPath sampleSize numReplicates nSites [options] > out
+
+writes the server's ms output for that command line. From Python, ms() returns
+the same text and replicates() the decoded --binary reply: a list with the
+(positions, haplotypes) of each replicate, haplotypes being one list of 0, 1
+and -1 per sample, or under -T a list of (sites, newick) per replicate.
+"""
+import socket
+import struct
+import sys
+
+
+def request(socketPath, args, binary=False):
+    """Raw reply bytes for the command line args (a string or a list of words)."""
+    if not isinstance(args, str):
+        args = " ".join(str(a) for a in args)
+    if binary:
+        args += " --binary"
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    try:
+        s.connect(socketPath)
+        s.sendall(args.encode() + b"\n")
+        chunks = []
+        while True:
+            chunk = s.recv(1 << 16)
+            if not chunk:
+                break
+            chunks.append(chunk)
+    finally:
+        s.close()
+    data = b"".join(chunks)
+    if data.startswith(b"error:"):
+        raise ValueError(data.decode().strip())
+    return data
+
+
+def ms(socketPath, args):
+    return request(socketPath, args).decode()
+
+
+def replicates(socketPath, args):
+    """Seeds and replicates of the binary reply, as (seed1, seed2, replicates)."""
+    data = request(socketPath, args, binary=True)
+    if data[:8] != b"DISCOAL\x01":
+        raise ValueError("not a discoal binary reply")
+    seed1, seed2 = struct.unpack_from("=qq", data, 8)
+    at = 24
+    reps = []
+    while at < len(data):
+        kind = data[at:at + 1]
+        at += 1
+        if kind == b"H":
+            n, segsites = struct.unpack_from("=ii", data, at)
+            at += 8
+            positions = list(struct.unpack_from("=%dd" % segsites, data, at))
+            at += 8 * segsites
+            cells = struct.unpack_from("=%db" % (n * segsites), data, at)
+            at += n * segsites
+            reps.append((positions, [list(cells[i * segsites:(i + 1) * segsites]) for i in range(n)]))
+        elif kind == b"T":
+            (numTrees,) = struct.unpack_from("=i", data, at)
+            at += 4
+            trees = []
+            for _ in range(numTrees):
+                sites, length = struct.unpack_from("=ii", data, at)
+                at += 8
+                trees.append((sites, data[at:at + length].decode()))
+                at += length
+            reps.append(trees)
+        else:
+            raise ValueError("unknown record %r at byte %d" % (kind, at - 1))
+    return seed1, seed2, reps
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 5:
+        sys.stderr.write(__doc__)
+        sys.exit(1)
+    try:
+        sys.stdout.write(ms(sys.argv[1], sys.argv[2:]))
+    except ValueError as e:
+        sys.stderr.write(str(e) + "\n")
+        sys.exit(1)
@@ -0,0 +1,1135 @@
+// discoalEngine.c
+// command line parameters and the simulation of one replicate, shared by the
+// discoal executable and libdiscoal
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <setjmp.h>
+#include "ranlib.h"
+#include "discoal.h"
+#include "discoalFunctions.h"
+#include "discoalEngine.h"
+#include "alleleTraj.h"
+#include "perfStats.h"
+#include "outputWriter.h"
+#include "marginalTrees.h"
+#include "paramTable.h"
+
+int locusNumber; 
+int leftRhoFlag=0;
+int untilMode = 0;
+const char *fileName;
+double uTime;
+double *currentSize;
+long seed1, seed2;
+const char *perfStatsFileName = NULL;
+const char *checkpointFileName = NULL;
+long checkpointEvery = 1000;
+int resumeFlag = 0;
+int replicateStreamMode = 0;
+long replicateStart = 0;
+int seedsGiven = 0;
+int asyncOutput = 0;
+int outputCompression = OUTPUT_PLAIN;
+int compressBlockReplicates = 1;
+int compressThreadCount = 0;
+const char *blockIndexFileName = NULL;
+const char *paramTableFileName = NULL;
+const char *paramOutFileName = NULL;
+
+// Helper function to ensure events array has enough capacity
+void ensureEventsCapacity() {
+	if (eventNumber >= eventsCapacity) {
+		int newCapacity = eventsCapacity * 2;
+		struct event *newEvents = (struct event*) realloc(events, newCapacity * sizeof(struct event));
+		if (newEvents == NULL) {
+			fprintf(stderr, "Error: Failed to reallocate events array\n");
+			exit(1);
+		}
+		events = newEvents;
+		eventsCapacity = newCapacity;
+		// Initialize new elements to zero
+		memset(&events[eventNumber], 0, (newCapacity - eventNumber) * sizeof(struct event));
+	}
+}
+
+// while tryParameters() runs, errors in the parameters jump back to it
+// instead of ending the process
+static jmp_buf *parameterErrorJump = NULL;
+
+void parameterError(int status){
+	if(parameterErrorJump != NULL)
+		longjmp(*parameterErrorJump, 1);
+	exit(status);
+}
+
+// tryParameters-- getParameters() for callers that outlive a bad command
+// line; returns 0, with the message on stderr, if it is rejected
+int tryParameters(int argc, const char **argv){
+	jmp_buf jump;
+
+	if(setjmp(jump)){
+		parameterErrorJump = NULL;
+		paramTableFree();
+		free(events);
+		free(currentSize);
+		events = NULL;
+		currentSize = NULL;
+		return 0;
+	}
+	parameterErrorJump = &jump;
+	getParameters(argc, argv);
+	parameterErrorJump = NULL;
+	return 1;
+}
+
+// seeds for runs without -d come from /dev/urandom, or from a generator
+// seeded once when a long-lived caller sets one up with seedSeedSource()
+static uint64_t seedSourceState = 0;
+
+void seedSeedSource(uint64_t state){
+	seedSourceState = state ? state : 1;
+}
+
+static unsigned int drawSeed(){
+	uint64_t z;
+
+	if(seedSourceState == 0)
+		return devrand();
+	// splitmix64
+	z = (seedSourceState += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return (unsigned int) ((z ^ (z >> 31)) >> 32);
+}
+
+// beginRun-- trajectory storage starts out empty; called once before the
+// first replicate
+void beginRun(){
+	trajectoryCapacity = TRAJSTEPSTART;
+	trajectoryFd = -1;  // Initialize to invalid
+	trajectoryFilename[0] = '\0';  // Empty filename
+	currentTrajectory = NULL;  // Will be mmap'd when needed
+	if(paramOutFileName != NULL && !paramOutOpen(paramOutFileName))
+		exit(1);
+}
+
+// simulateReplicate-- runs the coalescent back through the events and drops
+// mutations on the result; the graph is left in allNodes for output. The
+// replicate index picks the --param-table row and labels the --param-out row
+void simulateReplicate(long replicate){
+	int j;
+	double nextTime, currentFreq, probAccept;
+	double N = EFFECTIVE_POPN_SIZE; // effective population size
+
+	currentTime=0;
+	nextTime=999;
+	currentSize[0]=1.0;
+	currentFreq = 1.0 - (1.0 / (2.0 * N * currentSize[0])); //just to initialize the value
+//		printf("popnsize[0]:%d",popnSizes[0]);
+	maxTrajSteps = trajectoryCapacity;
+#ifdef DISCOAL_PERF_STATS
+	perfStatsReset();
+#endif
+	
+	if(paramTableFileName != NULL)
+		paramTableApply(replicate);
+	initialize();
+
+	j=0;
+	activeSweepFlag = 0;
+	for(j=0;j<eventNumber && alleleNumber > 1;j++){
+		currentEventNumber=j; //need this annoying global for trajectory generation
+		if(j == eventNumber - 1){
+			nextTime = MAXTIME;
+			}
+		else{
+			nextTime = events[j+1].time;
+		}
+		// printf("type: %c popID: %d size: %f currentTime: %f nextTime: %f alleleNumber: %d\n",events[j].type,events[j].popID,events[j].popnSize,
+		//	currentTime,nextTime,alleleNumber);	
+		switch(events[j].type){
+			case 'n':
+			currentTime = events[j].time;
+			currentSize[events[j].popID] = events[j].popnSize;
+			//for(i=0;i<npops;i++)
+			//	for(j=0;j<npops;j++) printf("%f\n",migMat[i][j]);
+			if(activeSweepFlag == 0){
+				if(recurSweepMode ==0){
+					currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, currentSize);
+				}
+				else{
+					currentTime = recurrentSweepPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, &currentFreq, alpha, sweepMode, currentSize);
+				}
+			}
+			else{
+				if(recurSweepMode ==0){
+					currentTime = sweepPhaseEventsConditionalTrajectory(breakPoints, currentTime, nextTime, sweepSite, \
+				 		currentFreq, &currentFreq, &activeSweepFlag, alpha, currentSize, sweepMode, f0, uA);
+					if (currentTime < nextTime)
+                                               		currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, currentSize);
+				}
+				else{
+					currentTime = sweepPhaseEventsConditionalTrajectory(breakPoints, currentTime, nextTime, sweepSite, \
+				 		currentFreq, &currentFreq, &activeSweepFlag, alpha, currentSize, sweepMode, f0, uA);
+					if (currentTime < nextTime)
+                                               		currentTime = recurrentSweepPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, &currentFreq, alpha, sweepMode, currentSize);
+				}
+			}
+		//	printf("pn0:%d pn1:%d alleleNumber: %d sp1: %d sp2: %d \n", popnSizes[0],popnSizes[1], alleleNumber,sweepPopnSizes[1],
+		//							sweepPopnSizes[0]);
+			break;
+			case 's':
+			assert(activeSweepFlag == 0);
+			currentTime = events[j].time;
+			if (partialSweepMode == 1){
+				currentFreq = MIN(partialSweepFinalFreq,1.0 - (1.0 / (2.0 * N * currentSize[0])));
+			}
+			else{
+				currentFreq = 1.0 - (1.0 / (2.0 * N * currentSize[0]));
+			}
+		//	printf("event%d currentTime: %f nextTime: %f popnSize: %f\n",j,currentTime,nextTime,currentSize);
+
+			//generate a proposed trajectory
+			char previousTrajectoryFile[256] = "";
+			if(trajectoryThreads > 1){
+				proposeTrajectorySpeculative(currentEventNumber, currentSize, sweepMode, currentFreq, alpha, f0, currentTime);
+			}
+			else{
+				probAccept = proposeTrajectory(currentEventNumber, currentTrajectory, currentSize, sweepMode, currentFreq, &currentFreq, alpha, f0, currentTime);
+				while(ranf()>probAccept){
+					PERF_ADD(proposalsRejected, 1);
+					// Clean up rejected trajectory
+					if (previousTrajectoryFile[0] != '\0') {
+						cleanupRejectedTrajectory(previousTrajectoryFile);
+					}
+					strcpy(previousTrajectoryFile, trajectoryFilename);
+					
+					probAccept = proposeTrajectory(currentEventNumber, currentTrajectory, currentSize, sweepMode, currentFreq, &currentFreq, alpha, f0, currentTime);
+					//printf("probAccept: %lf\n",probAccept);
+				}
+			}
+			
+			// Clean up any remaining rejected trajectory
+			if (previousTrajectoryFile[0] != '\0' && strcmp(previousTrajectoryFile, trajectoryFilename) != 0) {
+				cleanupRejectedTrajectory(previousTrajectoryFile);
+			}
+			
+			// Now mmap the accepted trajectory
+			if(!trajectoryReplayMode)
+				mmapAcceptedTrajectory(trajectoryFilename, totalTrajectorySteps);
+			
+			currentTime = sweepPhaseEventsConditionalTrajectory(&breakPoints[0], currentTime, nextTime, sweepSite, \
+				 currentFreq, &currentFreq, &activeSweepFlag, alpha, currentSize, sweepMode, f0, uA);
+			//printf("currentFreqAfter: %f alleleNumber:%d currentTime:%f\n",currentFreq,alleleNumber,currentTime);
+			//printf("pn0:%d pn1:%d alleleNumber: %d sp1: %d sp2: %d \n", popnSizes[0],popnSizes[1], alleleNumber,sweepPopnSizes[1],
+			//			sweepPopnSizes[0]);
+			if (currentTime < nextTime)
+                                        currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, currentSize);
+					
+			break;
+			case 'p': //merging populations
+			currentTime = events[j].time;
+			//printf("here at P flag time=%f\n",currentTime);
+			mergePopns(events[j].popID, events[j].popID2);
+
+			if(activeSweepFlag == 0){
+				if(recurSweepMode ==0){
+					currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, currentSize);
+				}
+				else{
+					currentTime = recurrentSweepPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, &currentFreq, alpha, sweepMode, currentSize);
+				}
+			}
+			else{
+				if(recurSweepMode ==0){
+					currentTime = sweepPhaseEventsConditionalTrajectory(breakPoints, currentTime, nextTime, sweepSite, \
+					 	currentFreq, &currentFreq, &activeSweepFlag, alpha, currentSize, sweepMode, f0, uA);
+					if (currentTime < nextTime)
+                                        		currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, currentSize);
+				}
+				else{
+					currentTime = sweepPhaseEventsConditionalTrajectory(breakPoints, currentTime, nextTime, sweepSite, \
+				 		currentFreq, &currentFreq, &activeSweepFlag, alpha, currentSize, sweepMode, f0, uA);
+					if (currentTime < nextTime)
+                                               		currentTime = recurrentSweepPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, &currentFreq, alpha, sweepMode, currentSize);
+				}
+			}
+			break;
+			case 'a':
+			currentTime = events[j].time;
+			admixPopns(events[j].popID, events[j].popID2, events[j].popID3, events[j].admixProp);
+			if(activeSweepFlag == 0){
+				if(recurSweepMode ==0){
+					currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, currentSize);
+				}
+				else{
+					currentTime = recurrentSweepPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, &currentFreq, alpha, sweepMode,currentSize);
+				}
+			}
+			else{
+				if(recurSweepMode ==0){
+					currentTime = sweepPhaseEventsConditionalTrajectory(breakPoints, currentTime, nextTime, sweepSite, \
+					 	currentFreq, &currentFreq, &activeSweepFlag, alpha, currentSize, sweepMode, f0, uA);
+					if (currentTime < nextTime)
+                                        	currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, currentSize);
+				}
+				else{
+					currentTime = sweepPhaseEventsConditionalTrajectory(breakPoints, currentTime, nextTime, sweepSite, \
+				 		currentFreq, &currentFreq, &activeSweepFlag, alpha, currentSize, sweepMode, f0, uA);
+					if (currentTime < nextTime)
+                                               		currentTime = recurrentSweepPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, &currentFreq, alpha, sweepMode,currentSize);
+				}
+			}
+			break;
+			case 'A':
+			currentTime = events[j].time;
+			//printAllActiveNodes();
+			addAncientSample(events[j].lineageNumber, events[j].popID, events[j].time, activeSweepFlag, currentFreq);
+			//printAllActiveNodes();
+			if(activeSweepFlag == 0){
+				if(recurSweepMode ==0){
+					currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, currentSize);
+				}
+				else{
+					currentTime = recurrentSweepPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, &currentFreq, alpha, sweepMode,currentSize);
+				}
+			}
+			else{
+				if(recurSweepMode ==0){
+					currentTime = sweepPhaseEventsConditionalTrajectory(breakPoints, currentTime, nextTime, sweepSite, \
+					 	currentFreq, &currentFreq, &activeSweepFlag, alpha, currentSize, sweepMode, f0, uA);
+					if (currentTime < nextTime)
+                                        	currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, currentSize);
+				}
+				else{
+					currentTime = sweepPhaseEventsConditionalTrajectory(breakPoints, currentTime, nextTime, sweepSite, \
+				 		currentFreq, &currentFreq, &activeSweepFlag, alpha, currentSize, sweepMode, f0, uA);
+					if (currentTime < nextTime)
+                                               		currentTime = recurrentSweepPhaseGeneralPopNumber(breakPoints, currentTime, nextTime, &currentFreq, alpha, sweepMode,currentSize);
+				}
+			}
+			break;
+		}
+		
+	}
+	//finish up the coalescing action!
+	if(alleleNumber > 1){
+		currentTime = neutralPhaseGeneralPopNumber(breakPoints, currentTime, MAXTIME, currentSize);
+	}
+	//assign root
+//	root = nodes[0];
+	PERF_END_PHASE();
+	//add Mutations
+	PERF_TIMER_START(mutation);
+	if(untilMode==0)
+		dropMutations();
+	else
+		dropMutationsUntilTime(uTime);	
+	PERF_TIMER_STOP(mutation, PERF_TIME_MUTATION);
+	if(condRecMode == 0 || condRecMet == 1)
+		paramOutWrite(replicate);
+}
+
+static void writeTree(MarginalTrees *mt, double site, int sites, void (*treeWritten)(int sites, void *arg), void *arg){
+	if(treeWritten == NULL){
+		outputPutc('[');
+		outputInt(sites);
+		outputPutc(']');
+	}
+	printMarginalTree(mt, site);
+	if(treeWritten != NULL)
+		treeWritten(sites, arg);
+}
+
+// writeTrees-- the -T output of a replicate: each marginal tree in Newick
+// form after the number of sites it covers. With treeWritten the counts are
+// not printed; it is called after each tree instead, with the tree's text
+// still in the output buffer
+void writeTrees(MarginalTrees *mt, void (*treeWritten)(int sites, void *arg), void *arg){
+	int k, lastBreak;
+	double tempSite;
+
+	sortBreakPoints();
+	lastBreak = 0;
+	marginalTreesInit(mt);
+	for(k=0;k<breakNumber;k++){
+		tempSite = siteStart(breakPoints[k]) - (0.5/nSites) ; //padding
+		if(breakPoints[k] - lastBreak > 0){
+			writeTree(mt, tempSite, breakPoints[k] - lastBreak, treeWritten, arg);
+			lastBreak = breakPoints[k];
+		}
+	}
+	writeTree(mt, 1.0 - (1.0/nSites), nSites - lastBreak, treeWritten, arg);
+	if(!keepBuffersMode)
+		marginalTreesFree(mt);
+}
+
+// releaseTrajectory-- unmaps and deletes the stored sweep trajectory, if any
+void releaseTrajectory(){
+	if (trajectoryFd != -1) {
+		if (currentTrajectory && currentTrajectory != MAP_FAILED) {
+			munmap(currentTrajectory, trajectoryFileSize);
+		}
+		close(trajectoryFd);
+		if (trajectoryFilename[0] != '\0') {
+			unlink(trajectoryFilename);
+		}
+		trajectoryFd = -1;
+		trajectoryFilename[0] = '\0';
+		currentTrajectory = NULL;
+	}
+}
+
+// finishReplicate-- frees the replicate's graph once its output is written
+void finishReplicate(){
+	freeTree(nodes[0]);
+	if(!keepBuffersMode)
+		releaseReplicateBuffers();
+	
+	// Clean up trajectory after each simulation
+	releaseTrajectory();
+}
+
+// endRun-- frees what getParameters and the replicates left behind
+void endRun(){
+	// Clean up any remaining trajectory storage
+	releaseTrajectory();
+	free(currentSize);
+	free(events);
+	currentSize = NULL;
+	events = NULL;
+	
+	// Clean up node arrays
+	releaseReplicateBuffers();
+	freeNodeStore();
+	paramTableFree();
+	paramOutClose();
+}
+
+
+void getParameters(int argc,const char **argv){
+	int args;
+	int i,j;
+	double migR;
+	int selCheck,nChangeCheck;
+	long shardIndex, shardCount, rangeStart, rangeCount;
+	
+	if( argc < 3){
+		usage();
+	}
+
+	sampleSize = atoi(argv[1]);
+	if(sampleSize > ANCESTRY_COUNT_MAX){
+		printf("Error: sampleSize > %ld. This exceeds the maximum supported by %d-bit ancestry counts; rebuild with make WIDE_COUNTS=1 for larger samples.\n",
+			ANCESTRY_COUNT_MAX, ANCESTRY_COUNT_BITS);
+		parameterError(666);
+	}
+	sampleNumber = atoi(argv[2]);
+	if(atol(argv[3]) > MAXSITES){
+		printf("Error: number of sites set higher than the limit of %d. Please reduce the number of sites\n", MAXSITES);
+		parameterError(666);
+	}
+	nSites = atoi(argv[3]);
+	args = 4;
+
+	npops = 1;
+	popnSizes[0]=sampleSize;
+	popnSizes[1]=0;
+	sampleSizes[0]=sampleSize;
+	sampleSizes[1]=0;
+	leftRho = 0.0;
+	rho = 0.0;
+	my_gamma = 0.0;
+	gcMean = 0;
+	theta = 0.0;
+	alpha = 0.0;
+	lambda = 0.0;
+	tau = 0;
+	ancestralSizeRatio = 1.0;
+	f0=0.0;
+        uA=0.0;
+
+	seed1 = (long) (drawSeed() % 2147483399);
+	seed2 = (long) (drawSeed() % 2147483399);
+	
+
+	EFFECTIVE_POPN_SIZE = 1000000;
+	sweepSite = 0.5;
+	tDiv=666;
+        gammaCoRatioMode = 0;
+	priorTheta=priorRho=priorAlpha=priorTau=priorX=priorF0=priorUA=priorC=0;
+
+	eventFlag = 1;
+	effectiveSampleSize = sampleSize;
+	finiteOutputFlag = 0;
+	outputStyle = 'h';
+	mask = 0;
+	migFlag = 0;
+	deltaTMod = 40;
+	recurSweepMode = 0;
+	treeOutputMode= 0;
+	partialSweepMode = 0;
+	softSweepMode = 0;
+	ancSampleFlag = 0;
+	ancSampleSize = 0;
+	hidePartialSNP = 0;
+	leafBitsetMode = 1;
+	segmentMutationMode = 0;
+	keepBuffersMode = 0;
+	alleleCodes[0] = '0';
+	alleleCodes[1] = '1';
+	alleleCodes[2] = 'N';
+	trajectoryReplayMode = 0;
+	trajectoryThreads = 0;
+	adaptiveStepTolerance = 0.0;
+	recurSweepRate = 0.0;
+	leftRhoFlag = 0;
+	untilMode = 0;
+	runMode = 0;
+	sweepMode = 0;
+	priorE1=priorE2=0;
+	memset(migMatConst, 0, sizeof(migMatConst));
+	replicateStreamMode = 0;
+	replicateStart = 0;
+	seedsGiven = 0;
+	paramTableFileName = NULL;
+	paramOutFileName = NULL;
+	rngBackend = RNG_RANLIB;
+	exactPositionMode = 0;
+	
+	// Initialize events array with initial capacity
+	eventsCapacity = 50;  // Start with reasonable capacity
+	events = (struct event*) calloc(eventsCapacity, sizeof(struct event));
+	if (events == NULL) {
+		fprintf(stderr, "Error: Failed to allocate events array\n");
+		parameterError(1);
+	}
+	
+	//set up first bogus event
+	eventNumber = 0;
+	events[eventNumber].time = 0.0;
+	events[eventNumber].popID = 0;
+	events[eventNumber].popnSize = 1.0;
+	events[eventNumber].type = 'n';
+	eventNumber++;
+	currentSize = malloc(sizeof(double) * MAXPOPS);
+
+	condRecMode= 0;
+	while(args < argc){
+		switch(argv[args][1]){
+			case 'S' :
+			runMode = 'S';
+			fileName = argv[++args];
+			break;
+			case 's' :
+			segSites =  atoi(argv[++args]);
+			break;
+			case 't' :
+			theta = atof(argv[++args]);
+			break;
+			case 'i' :
+			deltaTMod = atof(argv[++args]);
+			break;
+			case 'r' :
+			rho = atof (argv[++args]);
+			break;
+			case 'g' :
+                        if (argv[args][2] == 'r')
+                        {
+			  gammaCoRatio = atof (argv[++args]);
+			  gcMean = atoi (argv[++args]);
+                          gammaCoRatioMode = 1;
+                        }
+                        else
+                        {
+			  my_gamma = atof (argv[++args]);
+			  gcMean = atoi (argv[++args]);
+                        }
+			break;
+			case 'a' :
+			alpha = atof(argv[++args]);
+			break;
+			case 'x' :
+			sweepSite = atof(argv[++args]);
+			break;
+			case 'M' :
+			if(npops==1){
+				fprintf(stderr,"Error: attempting to set migration but only one population! Be sure that 'm' flags are specified after 'p' flag\n");
+				parameterError(1);
+			}
+			migR = atof(argv[++args]);
+			for(i=0;i<npops;i++){
+				for(j=0;j<npops;j++){
+					if(i!=j){
+						migMatConst[i][j]=migR;
+					}
+					else{
+						migMatConst[i][j]= 0.0;
+					}
+				}
+			}
+			migFlag = 1;
+			break;
+			case 'm' :
+			if(npops==1){
+				fprintf(stderr,"Error: attempting to set migration but only one population! Be sure that 'm' flags are specified after 'p' flag\n");
+				parameterError(1);
+			}
+			i = atoi(argv[++args]);
+			j = atoi(argv[++args]);
+			migR = atof(argv[++args]);
+			migMatConst[i][j]=migR;
+			migFlag = 1;
+			break;
+			case 'p' :
+			npops = atoi(argv[++args]);
+			if(npops > MAXPOPS){
+				fprintf(stderr,"Error: too many populations defined. Current maximum number = %d. Change MAXPOPS define in discoal.h and recompile... if you dare\n",MAXPOPS);
+				parameterError(1);
+			}
+			for(i=0;i<npops;i++){
+				sampleSizes[i]=atoi(argv[++args]);
+				currentSize[i] = 1.0;
+			}
+			
+			break;
+			case 'e' :
+				switch(argv[args][2]){
+					case 'n':
+					ensureEventsCapacity();
+					events[eventNumber].time = atof(argv[++args]) * 2.0;
+					events[eventNumber].popID = atoi(argv[++args]);
+					events[eventNumber].popnSize = atof(argv[++args]);
+					events[eventNumber].type = 'n'; //size change
+					eventNumber++;
+					break;
+					case 'd' :
+					tDiv =  atof(argv[++args]);
+						ensureEventsCapacity();
+					events[eventNumber].time = tDiv * 2.0;
+					events[eventNumber].popID = atoi(argv[++args]);
+					events[eventNumber].popID2 = atoi(argv[++args]);
+					events[eventNumber].type = 'p'; //pop split
+					eventNumber++;
+					break;
+					case 'a' :
+						ensureEventsCapacity();
+					events[eventNumber].time = atof(argv[++args]) * 2.0;
+					events[eventNumber].popID = atoi(argv[++args]);
+					events[eventNumber].popID2 = atoi(argv[++args]);
+					events[eventNumber].popID3 = atoi(argv[++args]);
+					events[eventNumber].admixProp = atof(argv[++args]);
+					events[eventNumber].type = 'a'; //admix split
+					eventNumber++;
+					break;
+				}
+			break;
+			case 'w':
+				switch(argv[args][2]){
+					case 'd':
+					sweepMode = 'd';
+					break;
+					case 's':
+					sweepMode = 's';
+					break;
+					case 'n':
+					sweepMode = 'N';
+					break;
+					}
+				tau = atof(argv[++args]) * 2.0;
+					ensureEventsCapacity();
+				events[eventNumber].time = tau;
+				events[eventNumber].type = 's'; //sweep event
+				eventNumber++;
+				break;
+			case 'l':
+				switch(argv[args][2]){
+					case 'd':
+                	                sweepMode = 'd';
+                        	        break;
+                                	case 's':
+	                                sweepMode = 's';
+        	                        break;
+                	                case 'n':
+                        	        sweepMode = 'N';
+                                	break;
+				}
+				sweepSite = -1.0;
+				tau = atof(argv[++args]) * 2.0;
+				leftRho = atof(argv[++args]) * 2.0;
+				leftRhoFlag=1;
+					ensureEventsCapacity();
+				events[eventNumber].time = tau;
+				events[eventNumber].type = 's'; //sweep event
+				eventNumber++;
+					break;
+			case 'f':
+			f0 = atof(argv[++args]);
+			softSweepMode = 1;
+			break;
+                        case 'u':
+                        uA = atof(argv[++args]);
+                        break;
+			case 'P' :
+			  switch(argv[args][2]){
+				case 't':
+				  priorTheta = 1;
+				  pThetaLow=atof(argv[++args]);
+				  pThetaUp=atof(argv[++args]);
+				break;
+				case 'c':
+				  priorC = 1;
+			          partialSweepMode = 1;
+				  pCLow=atof(argv[++args]);
+				  pCUp=atof(argv[++args]);
+				break;
+                                case 'r':
+                                  if (strlen(argv[args]) == 4 && argv[args][3] == 'e'){
+                                        priorRho = 2;
+                                        pRhoMean=atof(argv[++args]);
+                                        pRhoUp=atof(argv[++args]);
+                                  }
+                                  else{
+                                        priorRho = 1;
+                                        pRhoLow=atof(argv[++args]);
+                                        pRhoUp=atof(argv[++args]);
+                                  }
+                                break;
+				case 'a':
+				  priorAlpha = 1;
+				  pAlphaLow=atof(argv[++args]);
+				  pAlphaUp=atof(argv[++args]);
+				break;
+				case 'u':
+                                	if (strlen(argv[args]) == 4 && argv[args][3] == 'A'){
+					  priorUA = 1;
+					  pUALow=atof(argv[++args]);
+					  pUAUp=atof(argv[++args]);
+					}
+                                	else{
+					  priorTau = 1;
+					  pTauLow=atof(argv[++args]) * 2.0;
+					  pTauUp=atof(argv[++args]) * 2.0;
+					}
+				break;
+				case 'x':
+				  priorX = 1;
+				  pXLow=atof(argv[++args]);
+				  pXUp=atof(argv[++args]);
+				break;
+				case 'f':
+				  priorF0 = 1;
+				  pF0Low=atof(argv[++args]);
+				  pF0Up=atof(argv[++args]);
+				break;
+				case 'e':
+				switch(argv[args][3]){
+					case '1':
+					priorE1 = 1;
+					pE1TLow=atof(argv[++args])*2.0;
+					pE1THigh=atof(argv[++args])*2.0;
+					pE1SLow=atof(argv[++args]);
+					pE1SHigh=atof(argv[++args]);
+						ensureEventsCapacity();
+					events[eventNumber].type = 'n';
+					eventNumber++;
+					break;
+					case '2':
+					priorE2 = 1;
+					pE2TLow=atof(argv[++args])*2.0;
+					pE2THigh=atof(argv[++args])*2.0;
+					pE2SLow=atof(argv[++args]);
+					pE2SHigh=atof(argv[++args]);
+						ensureEventsCapacity();
+					events[eventNumber].type = 'n';
+					eventNumber++;
+					break;
+				}
+				break;
+			}
+                        break;
+			case 'U' :
+			untilMode= 1;
+			uTime=atof(argv[++args])*2.0;
+			break; 
+			case 'd' :
+			seed1=atoi(argv[++args]);
+			seed2=atoi(argv[++args]);
+			seedsGiven = 1;
+			break;
+			case 'N' :
+			EFFECTIVE_POPN_SIZE=atoi(argv[++args]);
+			break;
+			case 'T' :
+			treeOutputMode= 1;
+			break;
+			case 'C' :
+			condRecMode= 1;
+			condRecMet = 0;
+			lSpot=atoi(argv[++args]);
+			rSpot=atoi(argv[++args]);
+			break;
+			case 'R' :
+			recurSweepMode = 1;
+			sweepMode = 's';
+			recurSweepRate = atof(argv[++args]);
+			break;
+			case 'L' :
+			recurSweepMode = 1;
+			sweepMode = 's';
+			sweepSite = -1.0;
+			recurSweepRate = atof(argv[++args]);
+            if (recurSweepRate <= 0)
+            {
+                fprintf(stderr,"recurSweepRate must be > 0\n");
+                parameterError(0);
+            }
+			break;
+			case 'c' :
+			partialSweepMode = 1;
+			sweepMode = 's';
+			partialSweepFinalFreq = atof(argv[++args]);
+            if (partialSweepFinalFreq <= 0.0 || partialSweepFinalFreq >= 1.0)
+            {
+                fprintf(stderr,"partialSweepFinalFreq must be > 0 and < 1.0\n");
+                parameterError(1);
+            }
+			break;
+			case 'h' :
+			hidePartialSNP = 1;
+			break;
+			case 'z' :
+			args++;
+			if(args < argc && strcmp(argv[args], "gzip") == 0){
+				outputCompression = OUTPUT_GZIP;
+			}
+			else if(args < argc && strcmp(argv[args], "zstd") == 0){
+#ifdef DISCOAL_ZSTD
+				outputCompression = OUTPUT_ZSTD;
+#else
+				fprintf(stderr,"Error: -z zstd requires a build with zstd (make ZSTD=1)\n");
+				parameterError(1);
+#endif
+			}
+			else{
+				fprintf(stderr,"Error: -z expects gzip or zstd\n");
+				parameterError(1);
+			}
+			break;
+			case 'A' :
+				ensureEventsCapacity();
+			events[eventNumber].lineageNumber = atoi(argv[++args]);
+			events[eventNumber].popID = atoi(argv[++args]);	 
+			events[eventNumber].time = atof(argv[++args]) * 2.0; 
+			ancSampleSize += events[eventNumber].lineageNumber;
+			events[eventNumber].type = 'A'; //ancient sample
+			ancSampleFlag = 1;
+			eventNumber++;
+			assert(events[eventNumber-1].lineageNumber < sampleSize);
+			break;
+			case '-' :
+			if(strcmp(argv[args], "--checkpoint") == 0){
+				checkpointFileName = argv[++args];
+			}
+			else if(strcmp(argv[args], "--checkpoint-every") == 0){
+				checkpointEvery = atol(argv[++args]);
+				if(checkpointEvery < 1){
+					fprintf(stderr,"Error: --checkpoint-every must be >= 1\n");
+					parameterError(1);
+				}
+			}
+			else if(strcmp(argv[args], "--resume") == 0){
+				resumeFlag = 1;
+			}
+			else if(strcmp(argv[args], "--async-io") == 0){
+				asyncOutput = 1;
+			}
+			else if(strcmp(argv[args], "--replay-trajectory") == 0){
+				trajectoryReplayMode = 1;
+			}
+			else if(strcmp(argv[args], "--traj-threads") == 0){
+				trajectoryThreads = atoi(argv[++args]);
+				if(trajectoryThreads < 1){
+					fprintf(stderr,"Error: --traj-threads must be >= 1\n");
+					parameterError(1);
+				}
+			}
+			else if(strcmp(argv[args], "--segment-mutations") == 0){
+				segmentMutationMode = 1;
+			}
+			else if(strcmp(argv[args], "--leaf-bitsets") == 0){
+				leafBitsetMode = 1;
+			}
+			else if(strcmp(argv[args], "--push-down") == 0){
+				leafBitsetMode = 0;
+			}
+			else if(strcmp(argv[args], "--keep-buffers") == 0){
+				keepBuffersMode = 1;
+			}
+			else if(strcmp(argv[args], "--adaptive-dt") == 0){
+				adaptiveStepTolerance = atof(argv[++args]);
+				if(adaptiveStepTolerance <= 0.0 || adaptiveStepTolerance >= 0.5){
+					fprintf(stderr,"Error: --adaptive-dt tolerance must be between 0 and 0.5\n");
+					parameterError(1);
+				}
+			}
+			else if(strcmp(argv[args], "--z-block") == 0){
+				compressBlockReplicates = atoi(argv[++args]);
+				if(compressBlockReplicates < 1){
+					fprintf(stderr,"Error: --z-block must be >= 1\n");
+					parameterError(1);
+				}
+			}
+			else if(strcmp(argv[args], "--z-threads") == 0){
+				compressThreadCount = atoi(argv[++args]);
+				if(compressThreadCount < 1){
+					fprintf(stderr,"Error: --z-threads must be >= 1\n");
+					parameterError(1);
+				}
+			}
+			else if(strcmp(argv[args], "--z-index") == 0){
+				blockIndexFileName = argv[++args];
+			}
+			else if(strcmp(argv[args], "--shard") == 0){
+				if(args + 1 >= argc || sscanf(argv[++args], "%ld/%ld", &shardIndex, &shardCount) != 2 ||
+					shardCount < 1 || shardIndex < 0 || shardIndex >= shardCount){
+					fprintf(stderr,"Error: --shard expects k/N with 0 <= k < N\n");
+					parameterError(1);
+				}
+				replicateStreamMode = 1;
+			}
+			else if(strcmp(argv[args], "--replicates") == 0){
+				if(args + 1 >= argc || sscanf(argv[++args], "%ld:%ld", &rangeStart, &rangeCount) != 2 ||
+					rangeStart < 0 || rangeCount < 0){
+					fprintf(stderr,"Error: --replicates expects start:count\n");
+					parameterError(1);
+				}
+				replicateStreamMode = 2;
+			}
+			else if(strcmp(argv[args], "--param-table") == 0){
+				paramTableFileName = argv[++args];
+			}
+			else if(strcmp(argv[args], "--param-out") == 0){
+				paramOutFileName = argv[++args];
+			}
+			else if(strcmp(argv[args], "--rng") == 0){
+				if(args + 1 < argc && strcmp(argv[args + 1], "xoshiro") == 0)
+					rngBackend = RNG_XOSHIRO;
+				else if(args + 1 < argc && strcmp(argv[args + 1], "ranlib") == 0)
+					rngBackend = RNG_RANLIB;
+				else{
+					fprintf(stderr,"Error: --rng expects ranlib or xoshiro\n");
+					parameterError(1);
+				}
+				args++;
+			}
+			else if(strcmp(argv[args], "--exact-positions") == 0){
+				exactPositionMode = 1;
+			}
+			else if(strcmp(argv[args], "--perf-stats") == 0){
+#ifdef DISCOAL_PERF_STATS
+				perfStatsFileName = argv[++args];
+#else
+				fprintf(stderr,"Error: --perf-stats requires a build with performance counters (make discoal_perf)\n");
+				parameterError(1);
+#endif
+			}
+			else{
+				fprintf(stderr,"Error: unknown option %s\n", argv[args]);
+				usage();
+			}
+			break;
+			 
+		}
+		args++;
+	}
+	sortEventArray(events,eventNumber);
+	//single precision cannot tell sites apart beyond FLOAT_SITE_LIMIT
+	if(nSites > FLOAT_SITE_LIMIT)
+		exactPositionMode = 1;
+	positionDigits = 6;
+	if(exactPositionMode)
+		while(positionDigits < 10 && pow(10, positionDigits) < nSites)
+			positionDigits++;
+	if(replicateStreamMode){
+		if(!seedsGiven){
+			fprintf(stderr,"Error: --shard and --replicates need fixed seeds (-d seed1 seed2) shared by all shards\n");
+			parameterError(1);
+		}
+		if(replicateStreamMode == 1){
+			replicateStart = shardIndex * sampleNumber / shardCount;
+			rangeCount = (shardIndex + 1) * sampleNumber / shardCount - replicateStart;
+		}
+		else{
+			if(rangeStart + rangeCount > sampleNumber){
+				fprintf(stderr,"Error: --replicates %ld:%ld runs past numReplicates (%d)\n", rangeStart, rangeCount, sampleNumber);
+				parameterError(1);
+			}
+			replicateStart = rangeStart;
+		}
+		if(sampleNumber > MAX_REPLICATE_STREAMS){
+			fprintf(stderr,"Error: --shard and --replicates support at most %ld replicates\n", MAX_REPLICATE_STREAMS);
+			parameterError(1);
+		}
+		sampleNumber = rangeCount;
+	}
+	if(resumeFlag && checkpointFileName == NULL){
+		fprintf(stderr,"Error: --resume requires --checkpoint file\n");
+		parameterError(1);
+	}
+	if(outputCompression == OUTPUT_PLAIN && (blockIndexFileName != NULL || compressBlockReplicates != 1 || compressThreadCount != 0)){
+		fprintf(stderr,"Error: --z-block, --z-threads and --z-index require -z\n");
+		parameterError(1);
+	}
+
+	//make sure events are kosher
+	selCheck = 0;
+	nChangeCheck=0;
+	for(i=0;i<eventNumber;i++){
+		//printf("event %d: type is %c\n", i, events[i].type);
+	 		if(events[i].type == 's'){
+				selCheck = 1;
+	 		}
+			if(events[i].type == 'n'){
+				nChangeCheck += 1;
+	 		}
+	}
+	if(selCheck == 1){
+		if(recurSweepMode == 1){
+			printf("Error with event specification: a single sweep event has been found but recurrentSweep mode has been specified\n");
+			parameterError(666);
+		}
+		if(nChangeCheck > 1 && sweepMode=='d'){
+			printf("Error with event specification: you chose 1 or more population size changes with a deterministic sweep. Please us -ws flag instead\n");
+			parameterError(666);
+		}
+		if(softSweepMode == 1 && partialSweepMode == 1){
+			if(f0 >= partialSweepFinalFreq){
+				printf("Error with event specification: you specified a partial soft sweep but final frequency of partial sweep <= f_0\n");
+				parameterError(666);
+			}
+		}
+	}
+	if(paramOutFileName != NULL && checkpointFileName != NULL){
+		fprintf(stderr,"Error: --param-out cannot be combined with --checkpoint\n");
+		parameterError(1);
+	}
+	if(paramTableFileName != NULL){
+		if(!paramTableLoad(paramTableFileName))
+			parameterError(1);
+		if(paramTableRows() < replicateStart + sampleNumber){
+			fprintf(stderr,"Error: --param-table %s has %ld rows but replicates up to %ld are requested\n",
+				paramTableFileName, paramTableRows(), replicateStart + sampleNumber);
+			parameterError(1);
+		}
+		if(paramTableHasColumn("tau") && selCheck == 0){
+			fprintf(stderr,"Error: the tau column of --param-table needs a sweep (-ws, -wd, -wn or -l)\n");
+			parameterError(1);
+		}
+		if(paramTableHasColumn("c") && partialSweepMode == 0){
+			fprintf(stderr,"Error: the c column of --param-table needs a partial sweep (-c or -Pc)\n");
+			parameterError(1);
+		}
+		if(paramTableHasColumn("f0") && softSweepMode == 0){
+			fprintf(stderr,"Error: the f0 column of --param-table needs a soft sweep (-f)\n");
+			parameterError(1);
+		}
+		if(((paramTableHasColumn("e1time") || paramTableHasColumn("e1size")) && !priorE1) ||
+		   ((paramTableHasColumn("e2time") || paramTableHasColumn("e2size")) && !priorE2)){
+			fprintf(stderr,"Error: the epoch columns of --param-table need the epoch (-Pe1 or -Pe2)\n");
+			parameterError(1);
+		}
+	}
+	if(leftRhoFlag && sweepSite >= 0.0){
+		printf("Error with event specification: you chose leftRho mode but the sweep site is within the locus\n");
+		parameterError(666);
+	}
+	if(softSweepMode == 1 && recurSweepMode == 1){
+		printf("Error with event specification: currently recurrent soft sweeps are not implemented. this will be a future addition\n");
+		parameterError(666);
+	}
+	
+}
+		
+
+
+void usage(){
+	fprintf(stderr,"usage: discoal sampleSize numReplicates nSites -ws tau\n");
+	fprintf(stderr,"parameters: \n");
+
+	fprintf(stderr,"\t -t theta \n");
+	fprintf(stderr,"\t -r rho (=zero if not specified)\n");
+	fprintf(stderr,"\t -g conversionRate tractLengthMean (gene conversion)\n");
+	fprintf(stderr,"\t -gr conversionToCrossoverRatio tractLengthMean (gene conversion where initiation rate = rho*conversionToCrossoverRatio)\n");
+	fprintf(stderr,"\t -p npops sampleSize1 sampleSize2 etc.\n");
+	fprintf(stderr,"\t -en time popnID size (changes size of popID)\n");	
+	fprintf(stderr,"\t -ed time popnID1 popnID2 (joins popnID1 into popnID2)\n");
+	fprintf(stderr,"\t -ea time daughterPopnID founderPopnID1 founderPopnID2 admixProp (admixture-- back in time daughterPopnID into two founders)\n");
+	
+	fprintf(stderr,"\t -ws tau (sweep happend tau generations ago- stochastic sweep)\n");  
+	fprintf(stderr,"\t -wd tau (sweep happend tau generations ago- deterministic sweep)\n"); 
+	fprintf(stderr,"\t -wn tau (sweep happend tau generations ago- neutral sweep)\n");
+	fprintf(stderr,"\t -ls tau leftRho (stochastic sweep some genetic distance to the left of the simulated window--specified by leftRho=4Nr)\n");
+	fprintf(stderr,"\t\t similarly, ld and ln simulate deterministic and neutral sweeps to the left of the window, respectively\n");
+	fprintf(stderr,"\t -f first frequency at which selection acts on allele (F0; sweep models only)\n");
+	fprintf(stderr,"\t -uA rate at which adaptive mutation recurs during the sweep phase (sweep models only)\n");
+	fprintf(stderr,"\t -N sweepEffectivePopnSize (sweep models only)\n");	
+	fprintf(stderr,"\t -a alpha (=2Ns)\n");
+	fprintf(stderr,"\t -x sweepSite (0-1)\n");
+	fprintf(stderr,"\t -c partialSweepFinalFrequency (partial sweeps)\n");	
+	fprintf(stderr,"\t -i dt (sweep time increment scalar; default 400 -> 1/400N)\n");
+	
+	fprintf(stderr,"\t -M migRate (sets all rates to migRate)\n");
+	fprintf(stderr,"\t -m popnID1 popnID2 migRate (sets migRate from popnID1 to popnID2)\n");
+	fprintf(stderr,"\t -A sampleSize popnID time (ancient sample from popnID at specified time)\n");
+	
+	fprintf(stderr,"\t -Pt low high (prior on theta)\n");
+	fprintf(stderr,"\t -Pr low high (prior on rho)\n");
+        fprintf(stderr,"\t -Pre mean upperBound (prior on rho -- exponentially distributed but truncated at an upper bound)\n");
+	fprintf(stderr,"\t -Pa low high (prior on alpha)\n");
+	fprintf(stderr,"\t -Pu low high (prior on tau; sweep models only; still must use \"-ws tau\" and \"tau\" will be ignored)\n");
+	fprintf(stderr,"\t -PuA low high (prior on uA; sweep models only)\n");
+	fprintf(stderr,"\t -Px low high (prior on sweepSite; sweep models only)\n");
+	fprintf(stderr,"\t -Pf low high (prior on F0; sweep models only)\n");
+	fprintf(stderr,"\t -Pc low high (prior on partialSweepFinalFreq; sweep models only)\n");
+	fprintf(stderr,"\t -Pe1 lowTime highTime lowSize highSize (priors on first demographic move time and size)\n");
+	fprintf(stderr,"\t -Pe2 lowTime highTime lowSize highSize (priors on second demographic move time and size)\n");
+	//fprintf(stderr,"\t -U time (only record mutations back to specified time)\n");
+	fprintf(stderr,"\t -R rhhRate (recurrent hitch hiking mode at the locus; rhh is rate per 2N individuals / generation)\n");
+	fprintf(stderr,"\t -L rhhRate (recurrent hitch hiking mode to the side of locus; leftRho is ~Unif(0,4Ns); rhh is rate per 2N individuals / generation)\n");
+	fprintf(stderr,"\t -h (hide selected SNP in partial sweep mode)\n");
+	fprintf(stderr,"\t -T (tree output mode)\n");
+	fprintf(stderr,"\t -d seed1 seed2 (set random number generator seeds)\n");
+	fprintf(stderr,"\t --checkpoint file (save progress to file every 1000 replicates; stdout must be a file)\n");
+	fprintf(stderr,"\t --checkpoint-every n (replicates between checkpoints)\n");
+	fprintf(stderr,"\t --resume (continue from the checkpoint; redirect stdout with >> to the same output file)\n");
+	fprintf(stderr,"\t --shard k/N (run the k-th of N equal slices of the replicates; needs -d)\n");
+	fprintf(stderr,"\t --replicates start:count (run replicates start..start+count-1 of numReplicates; needs -d)\n");
+	fprintf(stderr,"\t --replay-trajectory (regenerate sweep trajectories step by step instead of storing them)\n");
+	fprintf(stderr,"\t --traj-threads K (propose K sweep trajectories at a time on K threads)\n");
+	fprintf(stderr,"\t --segment-mutations (place mutations directly on each branch's polymorphic segments)\n");
+	fprintf(stderr,"\t --push-down (copy each mutation down the tree to its carriers instead of sweeping the marginal trees)\n");
+	fprintf(stderr,"\t --keep-buffers (keep per-replicate storage between replicates instead of freeing it)\n");
+	fprintf(stderr,"\t --param-table file (one row of theta, rho, alpha, tau, x, f0, uA, c or epoch values per replicate)\n");
+	fprintf(stderr,"\t --param-out file (write the parameters of each replicate as a table)\n");
+	fprintf(stderr,"\t --rng ranlib|xoshiro (random number generator: ranlib, the default, reproduces earlier runs; xoshiro256++ is faster)\n");
+	fprintf(stderr,"\t --exact-positions (map positions to sites in double precision and print enough digits to tell sites apart; automatic above 2^24 sites)\n");
+	fprintf(stderr,"\t --serve socketPath (alone on the command line: serve requests on a Unix socket; see discoalServer.h)\n");
+	fprintf(stderr,"\t --adaptive-dt tol (lengthen sweep time steps while the frequency moves by less than tol*min(x,1-x))\n");
+	fprintf(stderr,"\t --async-io (write output from a separate thread while simulating)\n");
+	fprintf(stderr,"\t -z gzip|zstd (compress output in independent blocks; zstd needs make ZSTD=1)\n");
+	fprintf(stderr,"\t --z-block n (replicates per compressed block; default 1)\n");
+	fprintf(stderr,"\t --z-threads n (compression threads; default one per CPU)\n");
+	fprintf(stderr,"\t --z-index file (write the offset of each compressed block to file)\n");
+	fprintf(stderr,"\t --perf-stats file (write per-simulation performance counters as JSON lines; needs make discoal_perf)\n");
+	
+	parameterError(1);
+}
+
@@ -0,0 +1,54 @@
+#ifndef __DISCOAL_ENGINE_H__
+#define __DISCOAL_ENGINE_H__
+
+// The simulation as the discoal executable and libdiscoal drive it.
+// getParameters() reads a command line into the globals of discoal.h and the
+// run settings below; a run is then beginRun(), and for each replicate
+// simulateReplicate() with its index in the run (counting from 0, across
+// shards), output read off allNodes, and finishReplicate(), with
+// endRun() after the last. Everything is process-wide state, so one run is in
+// progress at a time.
+
+#include <stdint.h>
+
+struct MarginalTrees;
+
+extern int locusNumber;
+extern int leftRhoFlag;
+extern int untilMode;
+extern const char *fileName;
+extern double uTime;
+extern double *currentSize;
+extern long seed1, seed2;
+
+// settings of the executable only (output, checkpoints, sharding)
+extern const char *perfStatsFileName;
+extern const char *checkpointFileName;
+extern long checkpointEvery;
+extern int resumeFlag;
+extern int replicateStreamMode;
+extern long replicateStart;
+extern int seedsGiven;
+extern int asyncOutput;
+extern int outputCompression;
+extern int compressBlockReplicates;
+extern int compressThreadCount;
+extern const char *blockIndexFileName;
+extern const char *paramTableFileName;
+extern const char *paramOutFileName;
+
+void getParameters(int argc,const char **argv);
+int tryParameters(int argc, const char **argv);
+void parameterError(int status);
+void seedSeedSource(uint64_t state);
+void usage();
+void ensureEventsCapacity();
+
+void beginRun();
+void simulateReplicate(long replicate);
+void writeTrees(struct MarginalTrees *mt, void (*treeWritten)(int sites, void *arg), void *arg);
+void finishReplicate();
+void releaseTrajectory();
+void endRun();
+
+#endif
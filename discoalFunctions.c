@@ -3,6 +3,7 @@
 #include <string.h>
 #include <math.h>
 #include <stdint.h>
+#include <limits.h>
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -10,18 +11,30 @@
 #include <sys/stat.h>
 #include "ancestryVerify.h"
 #include "ancestryWrapper.h"
+#include "ancestrySegmentAVL.h"
 #include "activeSegment.h"
 #include <time.h>
+#include <pthread.h>
 #include "discoal.h"
 #include "discoalFunctions.h"
 #include "ranlib.h"
 #include "alleleTraj.h"
+#include "perfStats.h"
+#include "outputWriter.h"
+#include "rngStream.h"
+#include "marginalTrees.h"
 
 
 // Initial capacity for breakPoints array
 #define INITIAL_BREAKPOINTS_CAPACITY 1000
 
 void initializeBreakPoints() {
+	// --keep-buffers reuses the array of the last replicate
+	if (keepBuffersMode && breakPoints != NULL) {
+		breakPoints[0] = 666;
+		breakNumber = 0;
+		return;
+	}
 	// Clean up any existing allocation first
 	if (breakPoints != NULL) {
 		free(breakPoints);
@@ -71,7 +84,6 @@ void addBreakPoint(int bp) {
 
 void initialize(){
 	int i,j,p, count=0;
-	int leafID=0;
 	int tmpCount = 0;
 	
 	
@@ -83,14 +95,13 @@ void initialize(){
 		popnSizes[p]=sampleSizes[p];
 		for( i = 0; i < sampleSizes[p]; i++){
 			nodes[count] = newRootedNode(0,p);
-			nodes[count]->nancSites = nSites;
+			nodeNancSites[nodes[count]->id] = nSites;
 			nodes[count]->lLim=0;
 			nodes[count]->rLim=nSites-1;
 			// Initialize ancestry segment tree for leaf node
 			nodes[count]->ancestryRoot = newSegment(0, nSites, NULL, NULL);
 
 			if(p>0)nodes[count]->sweepPopn = 0;
-			nodes[count]->id=leafID++;
 			allNodes[count] = nodes[count];
 			count += 1;
 		}
@@ -172,12 +183,12 @@ void initialize(){
 	  }
 	}
 	if(priorE1==1){
-		events[1].time = genunf(pE1TLow,pE1THigh);
-		events[1].popnSize = genunf(pE1SLow,pE1SHigh);
+		events[1].time = pE1T = genunf(pE1TLow,pE1THigh);
+		events[1].popnSize = pE1S = genunf(pE1SLow,pE1SHigh);
 	}
 	if(priorE2==1){
-		events[2].time = genunf(pE2TLow,pE2THigh);
-		events[2].popnSize = genunf(pE2SLow,pE2SHigh);
+		events[2].time = pE2T = genunf(pE2TLow,pE2THigh);
+		events[2].popnSize = pE2S = genunf(pE2SLow,pE2SHigh);
 	}
 	sortEventArray(events,eventNumber);
 	
@@ -185,7 +196,6 @@ void initialize(){
 
 void initializeTwoSite(){
 	int i,j,p, count=0;
-	int leafID=0;
 	/* initialize the arrays */
 	totChunkNumber = 0;
 	initializeBreakPoints();
@@ -194,13 +204,12 @@ void initializeTwoSite(){
 		popnSizes[p]=sampleSizes[p];
 		for( i = 0; i < sampleSizes[p]; i++){
 			nodes[count] = newRootedNode(0,p);
-			nodes[count]->nancSites = nSites;
+			nodeNancSites[nodes[count]->id] = nSites;
 			nodes[count]->lLim=0;
 			nodes[count]->rLim=nSites-1;
 			// Initialize ancestry segment tree for leaf node
 			nodes[count]->ancestryRoot = newSegment(0, nSites, NULL, NULL);
 			if(p>0)nodes[count]->sweepPopn = 0;
-			nodes[count]->id=leafID++;
 			//do stuff for leafs containers
 			//nodes->leafs = calloc(sizeof(int) * sampleSize);
 			//nodes->leafs[nodes[count]->id] = 1;
@@ -258,38 +267,117 @@ void initializeTwoSite(){
 	  }
 	}
 	if(priorE1==1){
-		events[1].time = genunf(pE1TLow,pE1THigh);
-		events[1].popnSize = genunf(pE1SLow,pE1SHigh);
+		events[1].time = pE1T = genunf(pE1TLow,pE1THigh);
+		events[1].popnSize = pE1S = genunf(pE1SLow,pE1SHigh);
 	}
 	if(priorE2==1){
-		events[2].time = genunf(pE2TLow,pE2THigh);
-		events[2].popnSize = genunf(pE2SLow,pE2SHigh);
+		events[2].time = pE2T = genunf(pE2TLow,pE2THigh);
+		events[2].popnSize = pE2S = genunf(pE2SLow,pE2SHigh);
 	}
 	sortEventArray(events,eventNumber);
 }
 
 
-rootedNode *newRootedNode(double cTime, int popn) {
-	rootedNode *temp;
+//growNodeColumns-- makes room for capacity rows in every node column
+static void growNodeColumns(long capacity) {
+	double *newTime = realloc(nodeTime, sizeof(double) * capacity);
+	double *newBranchLength = realloc(nodeBranchLength, sizeof(double) * capacity);
+	int32_t *newLeftParent = realloc(nodeLeftParent, sizeof(int32_t) * capacity);
+	int32_t *newRightParent = realloc(nodeRightParent, sizeof(int32_t) * capacity);
+	int32_t *newLeftChild = realloc(nodeLeftChild, sizeof(int32_t) * capacity);
+	int32_t *newRightChild = realloc(nodeRightChild, sizeof(int32_t) * capacity);
+	int32_t *newNancSites = realloc(nodeNancSites, sizeof(int32_t) * capacity);
 
-	temp =  malloc(sizeof(rootedNode));
-	if(temp==NULL){
-		printf("fucked: out o' memory from rootedNode alloc\n");
+	if (newTime == NULL || newBranchLength == NULL || newLeftParent == NULL || newRightParent == NULL ||
+	    newLeftChild == NULL || newRightChild == NULL || newNancSites == NULL) {
+		fprintf(stderr, "Error: Failed to reallocate node columns (requested: %ld rows)\n", capacity);
+		exit(1);
+	}
+	nodeTime = newTime;
+	nodeBranchLength = newBranchLength;
+	nodeLeftParent = newLeftParent;
+	nodeRightParent = newRightParent;
+	nodeLeftChild = newLeftChild;
+	nodeRightChild = newRightChild;
+	nodeNancSites = newNancSites;
+	nodeColumnsCapacity = capacity;
+}
+
+//allocNodeFromStore-- next free node slot, adding a block when all are in use
+static rootedNode *allocNodeFromStore(void) {
+	int block = (int) (nodeStoreUsed / NODE_BLOCK_SIZE);
+
+	if (block == nodeBlockCount) {
+		if (nodeBlockCount == nodeBlocksCapacity) {
+			int newCapacity = nodeBlocksCapacity ? nodeBlocksCapacity * 2 : 16;
+			rootedNode **newBlocks = realloc(nodeBlocks, sizeof(rootedNode*) * newCapacity);
+			if (newBlocks == NULL) {
+				fprintf(stderr, "Error: Failed to reallocate node block list (requested: %d blocks)\n", newCapacity);
+				exit(1);
+			}
+			nodeBlocks = newBlocks;
+			nodeBlocksCapacity = newCapacity;
+		}
+		nodeBlocks[nodeBlockCount] = calloc(NODE_BLOCK_SIZE, sizeof(rootedNode));
+		if (nodeBlocks[nodeBlockCount] == NULL) {
+			fprintf(stderr, "Error: Failed to allocate node block (%d nodes)\n", NODE_BLOCK_SIZE);
+			exit(1);
+		}
+		nodeBlockCount += 1;
 	}
-	temp->rightParent = NULL;
-	temp->leftParent = NULL;
-	temp->rightChild = NULL;
-	temp->leftChild = NULL; 
-	temp->time = cTime;
-	temp->branchLength=0.0;
+	if (nodeStoreUsed == nodeColumnsCapacity)
+		growNodeColumns(nodeColumnsCapacity ? nodeColumnsCapacity * 2 : NODE_BLOCK_SIZE);
+	return &nodeBlocks[block][nodeStoreUsed++ % NODE_BLOCK_SIZE];
+}
+
+//resetNodeStore-- makes every node slot available again; nodes handed out
+//before must no longer be used
+void resetNodeStore() {
+	nodeStoreUsed = 0;
+}
+
+//freeNodeStore-- releases the node blocks and columns themselves
+void freeNodeStore() {
+	int i;
+
+	for (i = 0; i < nodeBlockCount; i++)
+		free(nodeBlocks[i]);
+	free(nodeBlocks);
+	nodeBlocks = NULL;
+	nodeBlockCount = nodeBlocksCapacity = 0;
+	nodeStoreUsed = 0;
+	free(nodeTime);
+	free(nodeBranchLength);
+	free(nodeLeftParent);
+	free(nodeRightParent);
+	free(nodeLeftChild);
+	free(nodeRightChild);
+	free(nodeNancSites);
+	nodeTime = nodeBranchLength = NULL;
+	nodeLeftParent = nodeRightParent = nodeLeftChild = nodeRightChild = nodeNancSites = NULL;
+	nodeColumnsCapacity = 0;
+}
+
+rootedNode *newRootedNode(double cTime, int popn) {
+	rootedNode *temp;
+	int32_t id;
+
+	id = (int32_t) nodeStoreUsed;
+	temp = allocNodeFromStore();
+	temp->id = id;
+	nodeLeftParent[id] = nodeRightParent[id] = NO_NODE;
+	nodeLeftChild[id] = nodeRightChild[id] = NO_NODE;
+	nodeTime[id] = cTime;
+	nodeBranchLength[id] = 0.0;
+	nodeNancSites[id] = 0;
+	temp->lLim = temp->rLim = 0;
 	temp->mutationNumber = 0;
 	temp->population = popn;
 	temp->sweepPopn = -1;
 	
-	// Initialize muts array dynamically
-	initializeMuts(temp, 10);  // Start small, grow as needed
-//	temp->leafs = malloc(sizeof(int) * sampleSize);
-//	for(i=0;i<nSites;i++)temp->ancSites[i]=1;
+	// muts is carved from the mutation arena by the first addMutation
+	temp->muts = NULL;
+	temp->mutsCapacity = 0;
 
 	// Initialize ancestry segment tree to NULL (will be set during initialization)
 	temp->ancestryRoot = NULL;
@@ -310,7 +398,7 @@ void migrateAtTime(double cTime,int srcPopn, int destPopn){
 	popnSizes[destPopn]+=1;
 	if (srcPopn==0)
 		sweepPopnSizes[temp->sweepPopn]-=1;
-
+	PERF_EVENT(migration);
 }
 
 //recurrentMutAtTime -- this adds a non-sweeping node to the sweep or vice-versa
@@ -321,6 +409,7 @@ void recurrentMutAtTime(double cTime,int srcPopn, int sp){
         temp->sweepPopn = (sp+1)%2;
         sweepPopnSizes[sp]-=1;
         sweepPopnSizes[temp->sweepPopn]+=1;
+        PERF_EVENT(recurrentMutation);
 }
 
 
@@ -351,22 +440,23 @@ void coalesceAtTimePopn(double cTime, int popn){
 	rootedNode *temp, *lChild, *rChild;
 	int i;
 
+	PERF_EVENT(coalescence);
 	temp = newRootedNode(cTime,popn);
 
 	lChild = pickNodePopn(popn);
-	temp->leftChild = lChild;
-	lChild->leftParent = temp;
-	lChild->branchLength = cTime - lChild->time;
+	nodeLeftChild[temp->id] = lChild->id;
+	nodeLeftParent[lChild->id] = temp->id;
+	nodeBranchLength[lChild->id] = cTime - nodeTime[lChild->id];
 	removeNode(lChild);
 
 	rChild =  pickNodePopn(popn);
-	temp->rightChild = rChild;
-	rChild->leftParent = temp;
-	rChild->branchLength = cTime - rChild->time;
+	nodeRightChild[temp->id] = rChild->id;
+	nodeLeftParent[rChild->id] = temp->id;
+	nodeBranchLength[rChild->id] = cTime - nodeTime[rChild->id];
 	removeNode(rChild);
 	
 	//deal with ancMaterial
-	temp->nancSites = 0;
+	nodeNancSites[temp->id] = 0;
 	temp->lLim = nSites;
 	temp->rLim = 0;
 	// Merge ancestry segment trees
@@ -399,19 +489,19 @@ void coalesceAtTimePopnTrackLeafs(double cTime, int popn){
 	temp = newRootedNode(cTime,popn);
 	temp->leafs = calloc(sizeof(int) * sampleSize);
 	lChild = pickNodePopn(popn);
-	temp->leftChild = lChild;
-	lChild->leftParent = temp;
-	lChild->branchLength = cTime - lChild->time;
+	nodeLeftChild[temp->id] = lChild->id;
+	nodeLeftParent[lChild->id] = temp->id;
+	nodeBranchLength[lChild->id] = cTime - nodeTime[lChild->id];
 	removeNode(lChild);
 
 	rChild =  pickNodePopn(popn);
-	temp->rightChild = rChild;
-	rChild->leftParent = temp;
-	rChild->branchLength = cTime - rChild->time;
+	nodeRightChild[temp->id] = rChild->id;
+	nodeLeftParent[rChild->id] = temp->id;
+	nodeBranchLength[rChild->id] = cTime - nodeTime[rChild->id];
 	removeNode(rChild);
 	
 	//deal with ancMaterial
-	temp->nancSites = 0;
+	nodeNancSites[temp->id] = 0;
 	temp->lLim = nSites;
 	temp->rLim = 0;
 	// Merge ancestry segment trees
@@ -433,7 +523,7 @@ void coalesceAtTimePopnTrackLeafs(double cTime, int popn){
 void updateAncestryStatsFromTree(rootedNode *node) {
 	if (!node || !node->ancestryRoot) return;
 	
-	node->nancSites = 0;
+	nodeNancSites[node->id] = 0;
 	node->lLim = nSites;
 	node->rLim = 0;
 	
@@ -443,7 +533,7 @@ void updateAncestryStatsFromTree(rootedNode *node) {
 		// Check if this segment is polymorphic (has ancestry but not fixed)
 		if (seg->count > 0 && seg->count < sampleSize) {
 			// Add all sites in this polymorphic segment
-			node->nancSites += (seg->end - seg->start);
+			nodeNancSites[node->id] += (seg->end - seg->start);
 			
 			// Update left boundary
 			if (seg->start < node->lLim) {
@@ -470,7 +560,7 @@ void updateActiveMaterial(rootedNode *aNode){
 	
 	#ifdef DEBUG_ACTIVE_MATERIAL
 	fprintf(stderr, "DEBUG updateActiveMaterial: node at time %f, %d sites still active\n", 
-	        aNode->time, activeSites);
+	        nodeTime[aNode->id], activeSites);
 	printActiveSegments(&activeMaterialSegments);
 	#endif
 	
@@ -497,33 +587,27 @@ int siteBetweenChunks(rootedNode *aNode, int xOverSite){
 	}
 }
 
-int isAncestralHere(rootedNode *aNode, float site){
-	int bp;
-	bp = floor(site * nSites);
-	return isPolymorphicAt(aNode, bp, sampleSize);
+int isAncestralHere(rootedNode *aNode, double site){
+	return isPolymorphicAt(aNode, siteAt(site), sampleSize);
 }
 
-int hasMaterialHere(rootedNode *aNode, float site){
-	int bp;
-	bp = floor(site * nSites);
-	return hasAncestryAt(aNode, bp);
+int hasMaterialHere(rootedNode *aNode, double site){
+	return hasAncestryAt(aNode, siteAt(site));
 }
 
-int nAncestorsHere(rootedNode *aNode, float site){
-	int bp;
-	bp = floor(site * nSites);
-	return getAncestryAt(aNode, bp);
+int nAncestorsHere(rootedNode *aNode, double site){
+	return getAncestryAt(aNode, siteAt(site));
 }
 
 int isLeaf(rootedNode *aNode){
-	if(aNode->leftChild == NULL && aNode->rightChild == NULL)
+	if(nodeLeftChild[aNode->id] == NO_NODE && nodeRightChild[aNode->id] == NO_NODE)
 		return(1);
 	else
 		return(0);
 }
 
 int isCoalNode(rootedNode *aNode){
-	if(aNode->leftChild != NULL && aNode->rightChild != NULL)
+	if(nodeLeftChild[aNode->id] != NO_NODE && nodeRightChild[aNode->id] != NO_NODE)
 		return(1);
 	else
 		return(0);
@@ -544,19 +628,20 @@ int recombineAtTimePopn(double cTime, int popn){
 //	printf("there xover: %d t1: %d t2: %d\n",xOver,siteBetweenChunks(aNode, xOver),isActive(xOver));
 		
 	if (siteBetweenChunks(aNode, xOver) == 1 &&  isActive(xOver) == 1  ){
+		PERF_EVENT(recombination);
 		// Early exit if no ancestral material
-		if(aNode->nancSites == 0 || aNode->lLim > aNode->rLim) {
+		if(nodeNancSites[aNode->id] == 0 || aNode->lLim > aNode->rLim) {
 			return xOver;
 		}
 		
 		removeNode(aNode); 
 		lParent = newRootedNode(cTime,popn);
 		rParent = newRootedNode(cTime,popn);
-		aNode->leftParent = lParent;
-		aNode->rightParent = rParent;
-		aNode->branchLength = cTime - aNode->time;
-		lParent->leftChild = aNode;
-		rParent->leftChild = aNode;
+		nodeLeftParent[aNode->id] = lParent->id;
+		nodeRightParent[aNode->id] = rParent->id;
+		nodeBranchLength[aNode->id] = cTime - nodeTime[aNode->id];
+		nodeLeftChild[lParent->id] = aNode->id;
+		nodeLeftChild[rParent->id] = aNode->id;
 		lParent->population = aNode->population;
 		rParent->population = aNode->population;
 		
@@ -576,6 +661,7 @@ int recombineAtTimePopn(double cTime, int popn){
 		//printNode(aNode);
 		return xOver;
 	}
+	PERF_EVENT(recombinationRejected);
 	return 666;
 }
 
@@ -595,18 +681,19 @@ void geneConversionAtTimePopn(double cTime, int popn){
 //	printf("\n");
 		
 	if (siteBetweenChunks(aNode, xOver) == 1 &&  isActive(xOver) == 1  ){
+		PERF_EVENT(geneConversion);
 		removeNode(aNode); 
 		lParent = newRootedNode(cTime,popn);
 		rParent = newRootedNode(cTime,popn);
-		aNode->leftParent = lParent;
-		aNode->rightParent = rParent;
-		aNode->branchLength = cTime - aNode->time;
-		lParent->leftChild = aNode;
-		rParent->leftChild = aNode;
+		nodeLeftParent[aNode->id] = lParent->id;
+		nodeRightParent[aNode->id] = rParent->id;
+		nodeBranchLength[aNode->id] = cTime - nodeTime[aNode->id];
+		nodeLeftChild[lParent->id] = aNode->id;
+		nodeLeftChild[rParent->id] = aNode->id;
 		lParent->population = aNode->population;
 		rParent->population = aNode->population;
-		lParent->nancSites=0;
-		rParent->nancSites=0;
+		nodeNancSites[lParent->id]=0;
+		nodeNancSites[rParent->id]=0;
 		lParent->lLim= nSites;
 		lParent->rLim=0;
 		rParent->lLim = nSites;
@@ -849,16 +936,20 @@ double neutralPhaseMigExclude(int *bpArray,double startTime, double endTime, dou
 }
 
 
-/*neutralPhaseGeneralPopNumber--coalescent, recombination, gc events until
-specified time. returns endTime. can handle multiple popns*/
-double neutralPhaseGeneralPopNumber(int *bpArray,double startTime, double endTime, double *sizeRatio){
-	double cTime, cRate[npops], rRate[npops], gcRate[npops], mRate[npops],totRate, waitTime, bp,r, r2;
+/*neutralPhaseKernel--coalescent, recombination, gc and migration events
+until endTime in P populations. P, withGC and withMigration are constants at
+each call below, so the compiler builds a separate loop for each model shape
+with the unused rates and loops removed. a rate left out is zero in that
+model, and adding a zero changes no sum, so every variant draws the same
+random numbers and makes the same choices as the general loop. the
+population picks stop at the last population, which rounding in the
+cumulative sum could otherwise step past*/
+static inline double neutralPhaseKernel(double startTime, double endTime, double *sizeRatio, \
+	const int P, const int withGC, const int withMigration){
+	double cTime, cRate[P], rRate[P], gcRate[P], mRate[P],totRate, waitTime, bp,r, r2;
 	double totCRate, totRRate, totGCRate,totMRate, eSum;
 	int  i,j;
 
-	if(startTime == endTime){
-		return(endTime);
-	}
 	cTime = 0.0;
 	cTime += startTime;
 	waitTime = 0.0;
@@ -869,24 +960,25 @@ double neutralPhaseGeneralPopNumber(int *bpArray,double startTime, double endTim
 		totRRate = 0.0;
 		totGCRate = 0.0;
 		totMRate = 0.0;
-		for(i=0;i<npops;i++){
-			mRate[i]=0.0;
-		}
-		//printf("currPopSize[0]: %d currPopSize[1]: %d alleleNumber: %d totNodeNumber: %d activeSites: %d cTime: %f\n",popnSizes[0],popnSizes[1],alleleNumber,totNodeNumber, activeSites, cTime);
-		for(i=0;i<npops;i++){
+		for(i=0;i<P;i++){
 			cRate[i] = popnSizes[i] * (popnSizes[i] - 1) * 0.5 / sizeRatio[i];
 			rRate[i] = rho * popnSizes[i] * 0.5;// * ((float)activeSites/nSites);
-			gcRate[i] = my_gamma * popnSizes[i] * 0.5 ;
-			
-			for(j=0;j<npops;j++) mRate[i]+=migMat[i][j];
-			mRate[i] *= popnSizes[i] * 0.5;
 			totCRate += cRate[i];
 			totRRate += rRate[i];
-			totMRate += mRate[i];
-			totGCRate += gcRate[i];
-			totRate += cRate[i] + rRate[i] + mRate[i] + gcRate[i];
+			if(withGC){
+				gcRate[i] = my_gamma * popnSizes[i] * 0.5 ;
+				totGCRate += gcRate[i];
+			}
+			if(withMigration){
+				mRate[i]=0.0;
+				for(j=0;j<P;j++) mRate[i]+=migMat[i][j];
+				mRate[i] *= popnSizes[i] * 0.5;
+				totMRate += mRate[i];
+			}
+			totRate += withGC && withMigration ? cRate[i] + rRate[i] + mRate[i] + gcRate[i] :
+			           withGC ? cRate[i] + rRate[i] + gcRate[i] :
+			           withMigration ? cRate[i] + rRate[i] + mRate[i] : cRate[i] + rRate[i];
 		}
-		//printf("totRate: %f totCRate: %f totRRate: %f \n",totRate,totCRate,totRRate);
 
 		//find time of next event
 		waitTime = genexp(1.0)  * (1.0/ totRate);
@@ -895,70 +987,89 @@ double neutralPhaseGeneralPopNumber(int *bpArray,double startTime, double endTim
 			return(endTime);
 		}
 		//find event type
-		else{ 
-			r =ranf();
-			if (r < (totRRate/ totRate)){
-				//pick popn
-				eSum = rRate[0];
-				i = 0;
-				r2 = ranf();
-				while(eSum/totRRate < r2) eSum += rRate[++i];
-				bp = recombineAtTimePopn(cTime,i);
-				if (bp != 666){
-					addBreakPoint(bp);
-				}
+		r =ranf();
+		if (r < (totRRate/ totRate)){
+			//pick popn
+			eSum = rRate[0];
+			i = 0;
+			r2 = ranf();
+			while(i < P-1 && eSum/totRRate < r2) eSum += rRate[++i];
+			bp = recombineAtTimePopn(cTime,i);
+			if (bp != 666){
+				addBreakPoint(bp);
 			}
-			else{
-				if(r < ((totRRate + totGCRate)/totRate)){
-					//pick popn
-					eSum = gcRate[0];
-					i = 0;
-					r2 = ranf();
-					while(eSum/totGCRate < r2) eSum += gcRate[++i];
-					geneConversionAtTimePopn(cTime,i);
-				}
-				else{
-					if(r < ((totMRate+totRRate + totGCRate)/totRate)){
-						//pick source popn
-						eSum = mRate[0];
-						i = 0;
-						j = 0;
-						r2 = ranf();
-						while(eSum/totMRate < r2) eSum += mRate[++i];
-						//printf("outer totMRate: %f eSum: %f i:%d\n",totMRate,eSum,i);
-						//pick dest popn
-						eSum = migMat[i][0]* popnSizes[i] * 0.5;
-						//printf("outer eSumNew:%f mRate[%d]:%f\n",eSum,i,mRate[i]);
-						r2 = ranf();
-						while(eSum/mRate[i] < r2){
-						//	printf("eSum: %f mRate[%d]:%f migMat[%d][0]:%f migMat[%d][1]:%f popnSize: %d\n",eSum,i,mRate[i],i,migMat[i][0],i,migMat[i][1], popnSizes[i]);
-							eSum += migMat[i][++j] * popnSizes[i] * 0.5;
-						//	printf("eSum: %f mRate[%d]:%f migMat[%d][0]:%f migMat[%d][1]:%f popnSize: %d\n",eSum,i,mRate[i],i,migMat[i][0],i,migMat[i][1], popnSizes[i]);
-							
-						} 
-						migrateAtTime(cTime,i,j);
-					}
-				
-					else{
-						//coalesce 
-						//pick popn
-						eSum = cRate[0];
-						i = 0;
-						r2 = ranf();
-						while(eSum/totCRate < r2){
-							 eSum += cRate[++i];
-							}
-						coalesceAtTimePopn(cTime,i);
-					
-					
-					}
+		}
+		else if(withGC && r < ((totRRate + totGCRate)/totRate)){
+			//pick popn
+			eSum = gcRate[0];
+			i = 0;
+			r2 = ranf();
+			while(i < P-1 && eSum/totGCRate < r2) eSum += gcRate[++i];
+			geneConversionAtTimePopn(cTime,i);
+		}
+		else if(withMigration && r < ((totMRate+totRRate + totGCRate)/totRate)){
+			//pick source popn
+			eSum = mRate[0];
+			i = 0;
+			j = 0;
+			r2 = ranf();
+			while(i < P-1 && eSum/totMRate < r2) eSum += mRate[++i];
+			//pick dest popn
+			eSum = migMat[i][0]* popnSizes[i] * 0.5;
+			r2 = ranf();
+			while(j < P-1 && eSum/mRate[i] < r2){
+				eSum += migMat[i][++j] * popnSizes[i] * 0.5;
+			} 
+			migrateAtTime(cTime,i,j);
+		}
+		else{
+			//coalesce 
+			//pick popn
+			eSum = cRate[0];
+			i = 0;
+			r2 = ranf();
+			while(i < P-1 && eSum/totCRate < r2){
+				 eSum += cRate[++i];
 				}
-			}
+			coalesceAtTimePopn(cTime,i);
 		}
 	}
 	return(cTime);
 }
 
+static double neutralPhaseOnePop(double startTime, double endTime, double *sizeRatio){
+	return neutralPhaseKernel(startTime, endTime, sizeRatio, 1, 0, 0);
+}
+
+static double neutralPhaseOnePopGC(double startTime, double endTime, double *sizeRatio){
+	return neutralPhaseKernel(startTime, endTime, sizeRatio, 1, 1, 0);
+}
+
+static double neutralPhaseTwoPops(double startTime, double endTime, double *sizeRatio){
+	return neutralPhaseKernel(startTime, endTime, sizeRatio, 2, 0, 1);
+}
+
+static double neutralPhaseTwoPopsGC(double startTime, double endTime, double *sizeRatio){
+	return neutralPhaseKernel(startTime, endTime, sizeRatio, 2, 1, 1);
+}
+
+/*neutralPhaseGeneralPopNumber--coalescent, recombination, gc events until
+specified time. returns endTime. can handle multiple popns; the common model
+shapes get a specialized loop*/
+double neutralPhaseGeneralPopNumber(int *bpArray,double startTime, double endTime, double *sizeRatio){
+	if(startTime == endTime){
+		return(endTime);
+	}
+	PERF_SET_PHASE(PERF_PHASE_NEUTRAL);
+	if(npops == 1 && migMat[0][0] == 0.0)
+		return my_gamma == 0.0 ? neutralPhaseOnePop(startTime, endTime, sizeRatio) :
+		                         neutralPhaseOnePopGC(startTime, endTime, sizeRatio);
+	if(npops == 2)
+		return my_gamma == 0.0 ? neutralPhaseTwoPops(startTime, endTime, sizeRatio) :
+		                         neutralPhaseTwoPopsGC(startTime, endTime, sizeRatio);
+	return neutralPhaseKernel(startTime, endTime, sizeRatio, npops, 1, 1);
+}
+
 void ensureTrajectoryCapacity(long int requiredSize) {
 	// This function is now deprecated - we use file-based trajectories
 	// Keeping it for compatibility but it just checks size limits
@@ -987,8 +1098,8 @@ void mmapAcceptedTrajectory(const char *filename, long int numSteps) {
 		exit(1);
 	}
 	
-	// Calculate file size
-	trajectoryFileSize = numSteps * sizeof(float);
+	// Calculate file size; adaptive steps store their length after x
+	trajectoryFileSize = numSteps * sizeof(float) * (adaptiveStepTolerance > 0.0 ? 2 : 1);
 	
 	// Memory map the file
 	currentTrajectory = (float *)mmap(NULL, trajectoryFileSize, PROT_READ, 
@@ -1007,119 +1118,366 @@ void cleanupRejectedTrajectory(const char *filename) {
 	}
 }
 
-/*proposeTrajectory-- this function creates a sweep trajectory and deals with
-complications like changing population size, or soft sweeps, etc 
-returns the acceptance probability of the trajectory */
-double proposeTrajectory(int currentEventNumber, float *currentTrajectory, double *sizeRatio, char sweepMode, \
-double initialFreq, double *finalFreq, double alpha, double f0, double currentTime)
-{	
-	double tInc, tIncOrig, minF,ttau, N;
+/*trajectoryStepperInit-- sets up a trajectory starting at initialFreq at
+currentTime in the epoch of event currentEventNumber */
+void trajectoryStepperInit(trajectoryStepper *ts, int currentEventNumber, double *sizeRatio, char sweepMode, \
+double initialFreq, double alpha, double f0, double currentTime)
+{
+	double N_0 = (double) EFFECTIVE_POPN_SIZE;
+
+	ts->tIncOrig = 1.0 / (deltaTMod * EFFECTIVE_POPN_SIZE);
+	ts->N = (double) floor(N_0 * sizeRatio[0]);
+	ts->Nmax = ts->currentSizeRatio = sizeRatio[0];
+	ts->x = initialFreq;
+	ts->minF = f0;
+	ts->insweepphase = 1;
+	ts->ttau = 0.0;
+	ts->sweepMode = sweepMode;
+	ts->alpha = alpha;
+	ts->startTime = currentTime;
+	ts->tInc = 0.0;
+	ts->explicitStream = 0;
+	ts->substeps = 1;
+	ts->tolerance = adaptiveStepTolerance;
+	//no epoch entered yet
+	ts->event = currentEventNumber - 1;
+	ts->localNextTime = -MAXTIME;
+}
+
+/*adaptiveSubsteps-- how many base steps the next step may span: drift and
+diffusion over it may move x by at most tolerance * min(x, 1-x), so the rates
+that depend on x stay within that bound of the fixed-step values. never runs
+past the end of the epoch */
+static long adaptiveSubsteps(trajectoryStepper *ts, int sweeping)
+{
+	double p = ts->x, q = 1.0 - ts->x;
+	double limit = ts->tolerance * MIN(p, q);
+	double alpha = ts->alpha * ts->currentSizeRatio;
+	double drift, variance, maxTime, unit, toEpochEnd;
+	long m;
+
+	unit = ts->tInc;
+	if(sweeping && ts->sweepMode == 'd'){
+		//deterministic logistic sweep in units of tIncOrig
+		drift = alpha * p * q;
+		variance = 0.0;
+		unit = ts->tIncOrig;
+	}
+	else if(sweeping && ts->sweepMode == 's'){
+		drift = alpha * p * q / tanh(alpha * q);
+		variance = p * q;
+	}
+	else{
+		drift = p;
+		variance = p * q;
+	}
+
+	maxTime = ADAPTIVE_MAX_SUBSTEPS * unit;
+	if(variance > 0.0) maxTime = MIN(maxTime, limit * limit / variance);
+	if(drift > 0.0) maxTime = MIN(maxTime, limit / drift);
+	m = (long) (maxTime / unit);
+
+	toEpochEnd = ceil((ts->localNextTime - ts->startTime - ts->ttau) / ts->tIncOrig);
+	if(m > toEpochEnd) m = (long) toEpochEnd;
+	return m < 1 ? 1 : m;
+}
+
+/*trajectoryStepperNext-- moves the sweep allele frequency ts->x one step on,
+entering later epochs as needed. returns 0 once the last epoch is done */
+int trajectoryStepperNext(trajectoryStepper *ts)
+{
 	double N_0 = (double) EFFECTIVE_POPN_SIZE;
-	double Nmax, localNextTime,localCurrentTime, currentSizeRatio;
-	int i, insweepphase;
+	RngStream *rs = ts->explicitStream ? &ts->rng : NULL;
+	struct event *e;
+	double dt;
+	int sweeping;
+
+	//iterate until epoch time or sweep freq, then go on to the next epoch
+	while(!(ts->x > 1.0/(2.*ts->N) && (ts->startTime+ts->ttau) < ts->localNextTime)){
+		if(++ts->event >= eventNumber)
+			return 0;
+		e = &events[ts->event];
+		if(ts->event == eventNumber - 1){
+			ts->localNextTime = MAXTIME;
+		}
+		else{
+			ts->localNextTime = events[ts->event+1].time;
+		}
+		if(e->type == 'n'){
+			ts->currentSizeRatio = e->popnSize;
+			ts->N = floor(N_0 * e->popnSize);
+			if(ts->currentSizeRatio > ts->Nmax) ts->Nmax = ts->currentSizeRatio;
+		}
+		if(ts->minF < 1.0/(2.*ts->N)) ts->minF = 1.0/(2.*ts->N);
+		ts->tInc = 1.0 / (deltaTMod * ts->N);
+	}
+
+	sweeping = ts->x > ts->minF && ts->insweepphase;
+	if(!sweeping){
+		ts->insweepphase = 0;
+		ts->tInc = 1.0 / (deltaTMod * ts->N );
+	}
+	if(ts->tolerance > 0.0)
+		ts->substeps = adaptiveSubsteps(ts, sweeping);
+	ts->ttau += ts->substeps * ts->tIncOrig;
+	dt = ts->substeps * ts->tInc;
+	if(sweeping){
+		//get next sweep allele freq
+		switch(ts->sweepMode){
+			case 'd':
+			ts->x = detSweepFreq(ts->ttau, ts->alpha * ts->currentSizeRatio);
+			break;
+			case 's':
+			ts->x = 1.0 - genicSelectionStochasticForwardsStream(dt, (1.0 - ts->x), ts->alpha * ts->currentSizeRatio, rs);
+			break;
+			case 'N':
+			ts->x = neutralStochasticStream(dt, ts->x, rs);
+			break;
+		}
+	}
+	else{
+		ts->x = neutralStochasticStream(dt, ts->x, rs);
+	}
+	return 1;
+}
+
+/*writeTrajectoryBuffer-- writes count floats to fd, retrying short writes */
+static void writeTrajectoryBuffer(int fd, const float *buffer, int count)
+{
+	const char *p = (const char *) buffer;
+	size_t left = (size_t) count * sizeof(float);
+	ssize_t written;
+
+	while(left > 0){
+		written = write(fd, p, left);
+		if(written < 0){
+			perror("Failed to write trajectory file");
+			exit(1);
+		}
+		p += written;
+		left -= (size_t) written;
+	}
+}
+
+/*generateTrajectory-- runs a stepper to the end of the last epoch, writing
+each step to fileName unless it is NULL. returns the number of steps, or -1
+if *cancel was set before it finished */
+static long generateTrajectory(trajectoryStepper *ts, const char *fileName, const int *cancel)
+{
+	int trajFd = -1;
 	long int j;
-	float x;
-	
-	// For sweep simulations, write directly to a temporary file
-	char tempFilename[256];
-	snprintf(tempFilename, sizeof(tempFilename), "/tmp/discoal_traj_%d_%ld_%d.tmp", 
-	         getpid(), time(NULL), rand());
-	
-	FILE *trajFile = fopen(tempFilename, "wb");
-	if (!trajFile) {
-		perror("Failed to create trajectory file");
-		exit(1);
+
+	//raw descriptor rather than stdio: the steps are buffered below and a
+	//FILE would cost an allocation per proposal
+	if(fileName != NULL){
+		trajFd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (trajFd == -1) {
+			perror("Failed to create trajectory file");
+			exit(1);
+		}
 	}
 	
 	// Use buffered writes for efficiency
 	float writeBuffer[1024];
 	int bufferPos = 0;
 	
-	tIncOrig = 1.0 / (deltaTMod * EFFECTIVE_POPN_SIZE);
 	j=0;
-	N = (double) floor(N_0 * sizeRatio[0]);
-	Nmax = currentSizeRatio = sizeRatio[0];
-	x = initialFreq;
-	minF = f0;
-	insweepphase = 1;
-	ttau=0.0;
-	//go through each event until last one
-	for(i=currentEventNumber;i<eventNumber;i++){
-		localCurrentTime = events[i].time;
-		if(i == eventNumber - 1){
-			localNextTime = MAXTIME;
+	while(trajectoryStepperNext(ts)){
+		//printf("j: %ld x: %f\n",j,ts->x);
+		
+		// Check trajectory size to prevent runaway
+		if (j >= 500000000) {  // Match legacy limit
+			fprintf(stderr, "trajectory too bigly. step= %ld. killing myself gently\n", j);
+			if (trajFd != -1) {
+				close(trajFd);
+				unlink(fileName);
 			}
-		else{
-			localNextTime = events[i+1].time;
-		}
-		if(events[i].type == 'n'){
-			currentSizeRatio = events[i].popnSize;
-			N = floor(N_0 *events[i].popnSize);
-			if(currentSizeRatio > Nmax) Nmax = currentSizeRatio;
+			exit(1);
 		}
-		if(minF < 1.0/(2.*N)) minF = 1.0/(2.*N);
-		tInc = 1.0 / (deltaTMod * N);
-		//iterate until epoch time or sweep freq
-		while( x > 1.0/(2.*N) && (currentTime+ttau) < localNextTime){
-			ttau += tIncOrig;
-			if(x > minF && insweepphase){
-				//get next sweep allele freq
-				switch(sweepMode){
-					case 'd':
-					x = detSweepFreq(ttau, alpha * currentSizeRatio);
-					break;
-					case 's':
-					x = 1.0 - genicSelectionStochasticForwardsOptimized(tInc, (1.0 - x), alpha * currentSizeRatio);
-					break;
-					case 'N':
-					x = neutralStochasticOptimized(tInc, x);
-					break;
-				}
+		if (cancel && (j & 4095) == 0 && __atomic_load_n(cancel, __ATOMIC_RELAXED)) {
+			if (trajFd != -1) {
+				close(trajFd);
+				unlink(fileName);
 			}
-			else{
-				insweepphase = 0;
-				tInc = 1.0 / (deltaTMod * N );
-				x = neutralStochasticOptimized(tInc, x);
-			}
-			//printf("j: %ld x: %f\n",j,x);
-			
-			// Check trajectory size to prevent runaway
-			if (j >= 500000000) {  // Match legacy limit
-				fprintf(stderr, "trajectory too bigly. step= %ld. killing myself gently\n", j);
-				fclose(trajFile);
-				unlink(tempFilename);
-				exit(1);
-			}
-			
-			// Write to buffer
-			writeBuffer[bufferPos++] = x;
-			if (bufferPos >= 1024) {
+			return -1;
+		}
+		
+		// Write to buffer; adaptive steps also record their length
+		if (trajFd != -1) {
+			writeBuffer[bufferPos++] = ts->x;
+			if (ts->tolerance > 0.0)
+				writeBuffer[bufferPos++] = (float) ts->substeps;
+			if (bufferPos >= 1023) {
 				// Flush buffer to file
-				fwrite(writeBuffer, sizeof(float), bufferPos, trajFile);
+				writeTrajectoryBuffer(trajFd, writeBuffer, bufferPos);
 				bufferPos = 0;
 			}
-			j++;
 		}
+		j++;
 	}
 	
-	// Flush any remaining data in buffer
-	if (bufferPos > 0) {
-		fwrite(writeBuffer, sizeof(float), bufferPos, trajFile);
+	if (trajFd != -1) {
+		// Flush any remaining data in buffer
+		if (bufferPos > 0) {
+			writeTrajectoryBuffer(trajFd, writeBuffer, bufferPos);
+		}
+		close(trajFd);
 	}
-	fclose(trajFile);
+	return j;
+}
+
+/*proposeTrajectory-- this function creates a sweep trajectory and deals with
+complications like changing population size, or soft sweeps, etc 
+returns the acceptance probability of the trajectory */
+double proposeTrajectory(int currentEventNumber, float *currentTrajectory, double *sizeRatio, char sweepMode, \
+double initialFreq, double *finalFreq, double alpha, double f0, double currentTime)
+{	
+	trajectoryStepper ts;
+	long int j;
+	char tempFilename[256];
+	PERF_TIMER_START(proposal);
 	
-	// Store the filename and trajectory length globally
-	strncpy(trajectoryFilename, tempFilename, sizeof(trajectoryFilename) - 1);
+	trajectoryStepperInit(&ts, currentEventNumber, sizeRatio, sweepMode, initialFreq, alpha, f0, currentTime);
+	if(trajectoryReplayMode){
+		//keep only the starting point; the sweep replays the steps
+		replayStepper = ts;
+		rngStreamCapture(&replayStepper.rng);
+		replayStepper.explicitStream = 1;
+		j = generateTrajectory(&ts, NULL, NULL);
+	}
+	else{
+		// For sweep simulations, write directly to a temporary file
+		snprintf(tempFilename, sizeof(tempFilename), "/tmp/discoal_traj_%d_%ld_%d.tmp", 
+		         getpid(), time(NULL), rand());
+		j = generateTrajectory(&ts, tempFilename, NULL);
+		
+		// Store the filename globally
+		strncpy(trajectoryFilename, tempFilename, sizeof(trajectoryFilename) - 1);
+	}
 	currentTrajectoryStep = 0;
 	totalTrajectorySteps = j;
+	trajectorySubstepsLeft = 0;
+	PERF_ADD(trajectoryStepsGenerated, j);
+	PERF_TIMER_STOP(proposal, PERF_TIME_TRAJECTORY);
 	
 	// Note: We don't mmap here because this function may be called multiple times
 	// during rejection sampling. The accepted trajectory will be mmap'd later.
 	
-	return(currentSizeRatio/Nmax);
+	return(ts.currentSizeRatio/ts.Nmax);
 	
 }
 
+/* one proposal of a speculative round, run on its own thread */
+typedef struct
+{
+	trajectoryStepper start, ts;
+	char fileName[256];
+	long steps;
+	int index, accepted, cancel;
+}
+speculativeProposal;
+
+static speculativeProposal *proposalRound;
+static int proposalRoundSize;
+
+static void *runSpeculativeProposal(void *arg)
+{
+	speculativeProposal *p = (speculativeProposal *) arg;
+	int k;
+
+	p->ts = p->start;
+	p->steps = generateTrajectory(&p->ts, trajectoryReplayMode ? NULL : p->fileName, &p->cancel);
+	if(p->steps < 0)
+		return NULL;
+	//same acceptance draw as the serial loop, taken from this proposal's stream
+	p->accepted = rngStreamRanf(&p->ts.rng) <= p->ts.currentSizeRatio/p->ts.Nmax;
+	//later proposals can no longer be the first accepted one
+	if(p->accepted){
+		for(k = p->index + 1; k < proposalRoundSize; k++)
+			__atomic_store_n(&proposalRound[k].cancel, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/*proposeTrajectorySpeculative-- the rejection loop for a sweep trajectory with
+trajectoryThreads proposals at a time on worker threads. proposal k of a round
+draws from its own substream, 2^PROPOSAL_STREAM_LOG2 * k draws past a seed
+taken from the main stream, and the first accepted proposal in order of k
+wins. The result depends on the number of threads but not on their timing.
+Leaves the accepted trajectory where proposeTrajectory would */
+#define PROPOSAL_STREAM_LOG2 40
+void proposeTrajectorySpeculative(int currentEventNumber, double *sizeRatio, char sweepMode, \
+double initialFreq, double alpha, double f0, double currentTime)
+{
+	speculativeProposal *round;
+	pthread_t *threads;
+	RngStream base;
+	long seed1, seed2;
+	int k, winner;
+	static long proposalFileCount = 0;
+	PERF_TIMER_START(proposal);
+
+	round = (speculativeProposal *) malloc(sizeof(speculativeProposal) * trajectoryThreads);
+	threads = (pthread_t *) malloc(sizeof(pthread_t) * trajectoryThreads);
+	if(round == NULL || threads == NULL){
+		fprintf(stderr, "Error: Failed to allocate trajectory proposals\n");
+		exit(1);
+	}
+	proposalRound = round;
+	proposalRoundSize = trajectoryThreads;
+
+	winner = -1;
+	while(winner < 0){
+		seed1 = ignlgi();
+		seed2 = ignlgi();
+		for(k = 0; k < trajectoryThreads; k++){
+			round[k].index = k;
+			round[k].accepted = 0;
+			round[k].cancel = 0;
+			trajectoryStepperInit(&round[k].start, currentEventNumber, sizeRatio, sweepMode, initialFreq, alpha, f0, currentTime);
+			rngStreamSeed(&base, seed1, seed2);
+			rngStreamJump(&base, PROPOSAL_STREAM_LOG2, k);
+			round[k].start.rng = base;
+			round[k].start.explicitStream = 1;
+			snprintf(round[k].fileName, sizeof(round[k].fileName), "/tmp/discoal_traj_%d_%ld_%ld.tmp",
+			         getpid(), time(NULL), proposalFileCount++);
+			if(pthread_create(&threads[k], NULL, runSpeculativeProposal, &round[k]) != 0){
+				fprintf(stderr, "Error: Failed to start trajectory proposal thread\n");
+				exit(1);
+			}
+		}
+		for(k = 0; k < trajectoryThreads; k++)
+			pthread_join(threads[k], NULL);
+
+		for(k = 0; k < trajectoryThreads; k++){
+			if(round[k].steps < 0)
+				continue;
+			PERF_ADD(trajectoryStepsGenerated, round[k].steps);
+			if(winner < 0 && round[k].accepted){
+				winner = k;
+				continue;
+			}
+			if(winner < 0)
+				PERF_ADD(proposalsRejected, 1);
+			if(!trajectoryReplayMode)
+				unlink(round[k].fileName);
+		}
+	}
+
+	if(trajectoryReplayMode){
+		replayStepper = round[winner].start;
+	}
+	else{
+		strncpy(trajectoryFilename, round[winner].fileName, sizeof(trajectoryFilename) - 1);
+	}
+	currentTrajectoryStep = 0;
+	totalTrajectorySteps = round[winner].steps;
+	trajectorySubstepsLeft = 0;
+	free(round);
+	free(threads);
+	PERF_TIMER_STOP(proposal, PERF_TIME_TRAJECTORY);
+}
+
 
 /*sweepPhaseEventsGeneralPopNumber-- this does the compressed time sweep thing. 
   generalized to account for popnSize changes returns the time after the sweep.
@@ -1140,6 +1498,7 @@ double *sizeRatio, char sweepMode,double f0, double uA)
 	double cTime = startTime;
 	int insweepphase, i;
 
+	PERF_SET_PHASE(PERF_PHASE_SWEEP);
 	//initialize stuff
 	pCoalB = pCoalb = pRecB = pRecb = totRate = pRecurMut = pLeftRecB = pLeftRecb = totGCRate = totCRate = totRRate = 0;
 	sweepPopTotRate = pGCB = pGCb = 0;
@@ -1390,6 +1749,50 @@ double *sizeRatio, char sweepMode,double f0, double uA)
 	return(cTime+(ttau));
 }
 
+/*nextTrajectoryStep-- the sweep allele frequency at the next step of the accepted
+trajectory, read from the stored file or regenerated in replay mode. in adaptive
+mode substeps receives the number of base time steps the step spans */
+static inline double nextTrajectoryStep(long *substeps)
+{
+	double x;
+
+	if (currentTrajectoryStep >= totalTrajectorySteps) {
+		fprintf(stderr, "Error: trajectory step %ld exceeds total steps %ld\n", 
+				currentTrajectoryStep, totalTrajectorySteps);
+		exit(1);
+	}
+	if (trajectoryReplayMode) {
+		trajectoryStepperNext(&replayStepper);
+		x = replayStepper.x;
+		if (substeps) *substeps = replayStepper.substeps;
+	}
+	else if (substeps) {
+		x = currentTrajectory[2 * currentTrajectoryStep];
+		*substeps = (long) currentTrajectory[2 * currentTrajectoryStep + 1];
+	}
+	else {
+		x = currentTrajectory[currentTrajectoryStep];
+	}
+	currentTrajectoryStep++;
+	PERF_ADD(trajectoryStepsConsumed, 1);
+	return x;
+}
+
+/*substepsUntilEvent-- with a per base step event probability rate, the number of
+base steps (at most maxSteps) after which the running no-event probability
+eventProb first falls to eventRand or below. the same count the fixed step loop
+would reach one step at a time */
+static long substepsUntilEvent(double eventProb, double eventRand, double rate, long maxSteps)
+{
+	double k;
+
+	if (maxSteps <= 1 || rate <= 0.0) return maxSteps < 1 ? 1 : maxSteps;
+	if (rate >= 1.0 || eventProb <= eventRand) return 1;
+	k = ceil(log(eventRand / eventProb) / log1p(-rate));
+	if (k < 1.0) return 1;
+	return k > maxSteps ? maxSteps : (long) k;
+}
+
 /*sweepPhaseEventsConditionalTrajectory-- does sweep phase with trajectory created externally */
 double sweepPhaseEventsConditionalTrajectory(int *bpArray, double startTime, double endTime, double sweepSite,\
 double initialFreq, double *finalFreq, int *stillSweeping, double alpha,\
@@ -1406,7 +1809,9 @@ double *sizeRatio, char sweepMode,double f0, double uA)
 	double minF;
 	double cTime = startTime;
 	int insweepphase, i;
+	long substeps;
 
+	PERF_SET_PHASE(PERF_PHASE_SWEEP);
 	//initialize stuff
 	pCoalB = pCoalb = pRecB = pRecb = totRate = pRecurMut = pLeftRecB = pLeftRecb = totGCRate = totCRate = totRRate = 0;
 	sweepPopTotRate = pGCB = pGCb = 0;
@@ -1459,14 +1864,15 @@ double *sizeRatio, char sweepMode,double f0, double uA)
 		eventProb = 1.0;
 		//wait for something
 		while(eventProb > eventRand && x > (1.0 / (2*N)) && (cTime+ttau) < endTime ){
-			ttau += tIncOrig;
-
-			if (currentTrajectoryStep >= totalTrajectorySteps) {
-			fprintf(stderr, "Error: trajectory step %ld exceeds total steps %ld\n", 
-					currentTrajectoryStep, totalTrajectorySteps);
-			exit(1);
-		}
-		x = currentTrajectory[currentTrajectoryStep++];
+			if(adaptiveStepTolerance > 0.0){
+				//rates are held over every base step of a coarse step
+				if(trajectorySubstepsLeft == 0)
+					x = nextTrajectoryStep(&trajectorySubstepsLeft);
+			}
+			else{
+				ttau += tIncOrig;
+				x = nextTrajectoryStep(NULL);
+			}
 
 			//calculate event probs
 			//first 4 events are probs of events in population 0
@@ -1502,7 +1908,15 @@ double *sizeRatio, char sweepMode,double f0, double uA)
 			}
 			
 
-			eventProb *= 1-totRate;
+			if(adaptiveStepTolerance > 0.0){
+				substeps = substepsUntilEvent(eventProb, eventRand, totRate,
+					MIN(trajectorySubstepsLeft, (long) ceil((endTime - cTime - ttau) / tIncOrig)));
+				ttau += substeps * tIncOrig;
+				eventProb *= pow(1-totRate, substeps);
+				trajectorySubstepsLeft -= substeps;
+			}
+			else
+				eventProb *= 1-totRate;
 			//printf("x(t): %g t: %g tinc: %g eventProb: %g eventRand: %g totRate: %g swPopnSize1: %d swPopnSize2: %d\n",x,ttau,tInc, eventProb,
 			//	eventRand,totRate,sweepPopnSizes[0],sweepPopnSizes[1]);	
 
@@ -1655,6 +2069,7 @@ double recurrentSweepPhaseGeneralPopNumber(int *bpArray,double startTime, double
 	if(startTime == endTime){
 		return(endTime);
 	}
+	PERF_SET_PHASE(PERF_PHASE_NEUTRAL);
 	cTime = 0.0;
 	cTime += startTime;
 	waitTime = 0.0;
@@ -1756,6 +2171,7 @@ double recurrentSweepPhaseGeneralPopNumber(int *bpArray,double startTime, double
 							else{
 								curSweepSite = ranf();
 							}
+							PERF_EVENT(recurrentSweep);
 							if(partialSweepMode==1){
 								initFreq=MIN(partialSweepFinalFreq,1.0-(1.0/(2*sizeRatio[0]*EFFECTIVE_POPN_SIZE)));
 							}
@@ -1763,14 +2179,21 @@ double recurrentSweepPhaseGeneralPopNumber(int *bpArray,double startTime, double
 								initFreq=1.0-(1.0/(2*sizeRatio[0]*EFFECTIVE_POPN_SIZE));
 							}
 							//generate a proposed trajectory
-							probAccept = proposeTrajectory(currentEventNumber, currentTrajectory, sizeRatio, sweepMode, initFreq, finalFreq, alpha, f0, cTime);
-							while(ranf()>probAccept){
+							if(trajectoryThreads > 1){
+								proposeTrajectorySpeculative(currentEventNumber, sizeRatio, sweepMode, initFreq, alpha, f0, cTime);
+							}
+							else{
 								probAccept = proposeTrajectory(currentEventNumber, currentTrajectory, sizeRatio, sweepMode, initFreq, finalFreq, alpha, f0, cTime);
-								//printf("probAccept: %lf\n",probAccept);
+								while(ranf()>probAccept){
+									PERF_ADD(proposalsRejected, 1);
+									probAccept = proposeTrajectory(currentEventNumber, currentTrajectory, sizeRatio, sweepMode, initFreq, finalFreq, alpha, f0, cTime);
+									//printf("probAccept: %lf\n",probAccept);
+								}
 							}
 							cTime= sweepPhaseEventsConditionalTrajectory(bpArray, cTime, endTime, curSweepSite,\
 								initFreq, finalFreq, &activeSweepFlag, alpha,\
 								sizeRatio, sweepMode,0, 0);
+							PERF_SET_PHASE(PERF_PHASE_NEUTRAL);
 							
 						}
 					
@@ -1804,18 +2227,19 @@ int recombineAtTimePopnSweep(double cTime, int popn, int sp, double sweepSite, d
 	//	printf("\n");
 
 		if (siteBetweenChunks(aNode, xOver) == 1 &&  isActive(xOver) == 1  ){
+			PERF_EVENT(recombination);
 			removeNode(aNode); 
 			lParent = newRootedNode(cTime,popn);
 			rParent = newRootedNode(cTime,popn);
-			aNode->leftParent = lParent;
-			aNode->rightParent = rParent;
-			aNode->branchLength = cTime - aNode->time;
-			lParent->leftChild = aNode;
-			rParent->leftChild = aNode;
+			nodeLeftParent[aNode->id] = lParent->id;
+			nodeRightParent[aNode->id] = rParent->id;
+			nodeBranchLength[aNode->id] = cTime - nodeTime[aNode->id];
+			nodeLeftChild[lParent->id] = aNode->id;
+			nodeLeftChild[rParent->id] = aNode->id;
 			lParent->population = aNode->population;
 			rParent->population = aNode->population;
-			lParent->nancSites=0;
-			rParent->nancSites=0;
+			nodeNancSites[lParent->id]=0;
+			nodeNancSites[rParent->id]=0;
 			lParent->lLim= nSites;
 			lParent->rLim=0;
 			rParent->lLim = nSites;
@@ -1824,7 +2248,7 @@ int recombineAtTimePopnSweep(double cTime, int popn, int sp, double sweepSite, d
 			//determine sweep popn affinity
 			//left side?
 		//	printf("here-- popnFreq:%f sweepSite:%f xOver: %d test: %d \n",popnFreq,sweepSite,xOver,sweepSite < (float) xOver / nSites);
-			if(sweepSite < (float) xOver / nSites){ //lParent has sweep site set to same as child node,rParent is then random
+			if(sweepSite < siteStart(xOver)){ //lParent has sweep site set to same as child node,rParent is then random
 				lParent->sweepPopn = sp;
 				r = ranf();
 				if (r < popnFreq)rParent->sweepPopn = sp;
@@ -1852,6 +2276,7 @@ int recombineAtTimePopnSweep(double cTime, int popn, int sp, double sweepSite, d
 			//sweepPopnSizes[sp]++;
 			return xOver;
 		}
+		PERF_EVENT(recombinationRejected);
 		return 666; //debuging
 }
 
@@ -1863,6 +2288,7 @@ int recombineToLeftPopnSweep(int popn, int sp, double popnFreq){
 
 	aNode->sweepPopn = (sp == 0) ? 1:0;
 	sweepPopnSizes[aNode->sweepPopn]++;
+	PERF_EVENT(leftRecombination);
 	return 0;
 }
 
@@ -1888,18 +2314,19 @@ void geneConversionAtTimePopnSweep(double cTime, int popn, int sp, double sweepS
 	//	printf("\n");
 
 	if (siteBetweenChunks(aNode, xOver) == 1 &&  isActive(xOver) == 1  ){
+		PERF_EVENT(geneConversion);
 		removeNode(aNode); 
 		lParent = newRootedNode(cTime,popn);
 		rParent = newRootedNode(cTime,popn);
-		aNode->leftParent = lParent;
-		aNode->rightParent = rParent;
-		aNode->branchLength = cTime - aNode->time;
-		lParent->leftChild = aNode;
-		rParent->leftChild = aNode;
+		nodeLeftParent[aNode->id] = lParent->id;
+		nodeRightParent[aNode->id] = rParent->id;
+		nodeBranchLength[aNode->id] = cTime - nodeTime[aNode->id];
+		nodeLeftChild[lParent->id] = aNode->id;
+		nodeLeftChild[rParent->id] = aNode->id;
 		lParent->population = aNode->population;
 		rParent->population = aNode->population;
-		lParent->nancSites=0;
-		rParent->nancSites=0;
+		nodeNancSites[lParent->id]=0;
+		nodeNancSites[rParent->id]=0;
 		lParent->lLim= nSites;
 		lParent->rLim=0;
 		rParent->lLim = nSites;
@@ -1923,7 +2350,7 @@ void geneConversionAtTimePopnSweep(double cTime, int popn, int sp, double sweepS
 			//determine sweep popn affinity
 			//left side?
 		//	printf("here-- popnFreq:%f sweepSite:%f xOver: %d test: %d \n",popnFreq,sweepSite,xOver,sweepSite < (float) xOver / nSites);
-		if(sweepSite >= (float) xOver / nSites  || sweepSite < (float) (xOver+tractL) / nSites ){ //lParent has sweep site set to same as child node,rParent is then random
+		if(sweepSite >= siteStart(xOver)  || sweepSite < siteStart(xOver+tractL) ){ //lParent has sweep site set to same as child node,rParent is then random
 			lParent->sweepPopn = sp;
 			r = ranf();
 			if (r < popnFreq)rParent->sweepPopn = sp;
@@ -1946,23 +2373,24 @@ void coalesceAtTimePopnSweep(double cTime, int popn, int sp){
 	rootedNode *temp, *lChild, *rChild;
 	int i;
 
+	PERF_EVENT(coalescence);
 	temp = newRootedNode(cTime,popn);
 
 	lChild = pickNodePopnSweep(popn,sp);
-	temp->leftChild = lChild;
+	nodeLeftChild[temp->id] = lChild->id;
 	temp->sweepPopn = sp;
-	lChild->leftParent = temp;
-	lChild->branchLength = cTime - lChild->time;
+	nodeLeftParent[lChild->id] = temp->id;
+	nodeBranchLength[lChild->id] = cTime - nodeTime[lChild->id];
 	removeNode(lChild);
 
 	rChild =  pickNodePopnSweep(popn,sp);
-	temp->rightChild = rChild;
-	rChild->leftParent = temp;
-	rChild->branchLength = cTime - rChild->time;
+	nodeRightChild[temp->id] = rChild->id;
+	nodeLeftParent[rChild->id] = temp->id;
+	nodeBranchLength[rChild->id] = cTime - nodeTime[rChild->id];
 	removeNode(rChild);
 	
 	//deal with ancMaterial
-	temp->nancSites = 0;
+	nodeNancSites[temp->id] = 0;
 	temp->lLim = nSites;
 	temp->rLim = 0;
 	// Merge ancestry segment trees
@@ -1980,26 +2408,93 @@ void coalesceAtTimePopnSweep(double cTime, int popn, int sp){
 
 
 /*******************************************************/
+/* Direct placement (--segment-mutations): instead of drawing uniformly on
+[lLim, rLim] and rejecting sites the node is not polymorphic at, a position is
+drawn from the node's polymorphic segments, each picked in proportion to its
+length from a prefix sum built once per node */
+static int *placementStart;
+static long *placementPrefix;
+static int placementSegments, placementCapacity;
+
+static void buildPlacementTable(rootedNode *aNode){
+	AncestrySegment *seg;
+	long total = 0;
+
+	placementSegments = 0;
+	for(seg = aNode->ancestryRoot; seg != NULL; seg = seg->next){
+		if(seg->count == 0 || seg->count >= sampleSize)
+			continue;
+		if(placementSegments == placementCapacity){
+			placementCapacity = placementCapacity ? placementCapacity * 2 : 64;
+			placementStart = realloc(placementStart, sizeof(int) * placementCapacity);
+			placementPrefix = realloc(placementPrefix, sizeof(long) * placementCapacity);
+			if(placementStart == NULL || placementPrefix == NULL){
+				fprintf(stderr, "Error: Failed to allocate mutation placement table (%d segments)\n", placementCapacity);
+				exit(1);
+			}
+		}
+		total += seg->end - seg->start;
+		placementStart[placementSegments] = seg->start;
+		placementPrefix[placementSegments] = total;
+		placementSegments++;
+	}
+}
+
+static double placeMutationOnSegments(rootedNode *aNode){
+	double u, site;
+	int lo, hi, mid;
+
+	do{
+		u = ranf() * placementPrefix[placementSegments - 1];
+		lo = 0;
+		hi = placementSegments - 1;
+		while(lo < hi){
+			mid = (lo + hi) / 2;
+			if(placementPrefix[mid] > u)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		site = (placementStart[lo] + u - (lo > 0 ? placementPrefix[lo - 1] : 0)) / nSites;
+	//mapping the position back to a site in siteAt() can round onto a segment end
+	}while(isAncestralHere(aNode, site) != 1);
+	return site;
+}
+
+//branchWeight-- node n's share of the tree's mutational target: its branch
+//length times the fraction of sites it is ancestral to
+static inline double branchWeight(int n, double siteLength){
+	return siteLength * nodeNancSites[n] * nodeBranchLength[n];
+}
+
 void dropMutations(){
 	int i, j, m;
-	double p;
+	double p, siteLength;
 	double mutSite, error;
+	rootedNode *lChild, *rChild;
 	
 	//get time and set probs
 	coaltime = totalTimeInTree();
+	siteLength = 1.0/nSites;
 	//printf("%f\n",coaltime);
 	for(i=0;i<totNodeNumber;i++){
 		//add Mutations
-		p = allNodes[i]->blProb * theta * 0.5;
+		p = branchWeight(i, siteLength) * theta * 0.5;
 		if(p>0.0){
 			m = ignpoi(p);
+			if(segmentMutationMode && m > 0){
+				//draw straight from the polymorphic segments, no rejection
+				buildPlacementTable(allNodes[i]);
+				for(; m > 0 && placementSegments > 0; m--)
+					addMutation(allNodes[i], placeMutationOnSegments(allNodes[i]));
+			}
 			while(m>0){
-				mutSite = genunf((float)allNodes[i]->lLim / nSites, (float) allNodes[i]->rLim / nSites);
+				mutSite = genunf(siteStart(allNodes[i]->lLim), siteStart(allNodes[i]->rLim));
 				while(isAncestralHere(allNodes[i],mutSite) != 1){
 				//	printf("in here\n");
 					if (allNodes[i]->lLim == allNodes[i]->rLim){
-						if (mutSite*nSites < (float)allNodes[i]->lLim)
-							error = (float)allNodes[i]->lLim-(mutSite*nSites);
+						if (mutSite*nSites < (double)allNodes[i]->lLim)
+							error = (double)allNodes[i]->lLim-(mutSite*nSites);
 						else
 							error = 0.0;
 						p = allNodes[i]->rLim + (1.0/nSites);
@@ -2015,14 +2510,18 @@ void dropMutations(){
 		}
 	}
 //	printf("coaltime: %f totM: %d\n",coaltime,tm);
-	//push mutations down tree
+	//push mutations down tree; with leaf bitsets makeGametesMS finds the carriers
+	if(leafBitsetMode)
+		return;
 	for(i=totNodeNumber-1;i>=0;i--){
+		lChild = nodeAt(nodeLeftChild[i]);
+		rChild = nodeAt(nodeRightChild[i]);
 		for(j=0;j<allNodes[i]->mutationNumber;j++){
 			mutSite = allNodes[i]->muts[j];
-			if(allNodes[i]->leftChild != NULL && isAncestralHere(allNodes[i]->leftChild,mutSite))
-				addMutation(allNodes[i]->leftChild,mutSite);
-			if(allNodes[i]->rightChild != NULL && isAncestralHere(allNodes[i]->rightChild,mutSite))
-				addMutation(allNodes[i]->rightChild,mutSite);
+			if(lChild != NULL && isAncestralHere(lChild,mutSite))
+				addMutation(lChild,mutSite);
+			if(rChild != NULL && isAncestralHere(rChild,mutSite))
+				addMutation(rChild,mutSite);
 				
 		}
 	}
@@ -2030,24 +2529,31 @@ void dropMutations(){
 
 void dropMutationsRecurse(){
 	int i, j, m;
-	double p;
-	float mutSite, error;
+	double p, siteLength;
+	double mutSite, error;
 	
 	//get time and set probs
 	coaltime = totalTimeInTree();
+	siteLength = 1.0/nSites;
 	//printf("%f\n",coaltime);
 	for(i=0;i<totNodeNumber;i++){
 		//add Mutations
-		p = allNodes[i]->blProb * theta * 0.5;
+		p = branchWeight(i, siteLength) * theta * 0.5;
 		if(p>0.0){
 			m = ignpoi(p);
+			if(segmentMutationMode && m > 0){
+				//draw straight from the polymorphic segments, no rejection
+				buildPlacementTable(allNodes[i]);
+				for(; m > 0 && placementSegments > 0; m--)
+					addMutation(allNodes[i], placeMutationOnSegments(allNodes[i]));
+			}
 			while(m>0){
-				mutSite = genunf((float)allNodes[i]->lLim / nSites, (float) allNodes[i]->rLim / nSites);
+				mutSite = genunf(siteStart(allNodes[i]->lLim), siteStart(allNodes[i]->rLim));
 				while(isAncestralHere(allNodes[i],mutSite) != 1){
 				//	printf("in here\n");
 					if (allNodes[i]->lLim == allNodes[i]->rLim){
-						if (mutSite*nSites < (float)allNodes[i]->lLim)
-							error = (float)allNodes[i]->lLim-(mutSite*nSites);
+						if (mutSite*nSites < (double)allNodes[i]->lLim)
+							error = (double)allNodes[i]->lLim-(mutSite*nSites);
 						else
 							error = 0.0;
 						p = allNodes[i]->rLim + (1.0/nSites);
@@ -2071,7 +2577,7 @@ void dropMutationsRecurse(){
 		}
 	}
 }
-//calculates the total time in the tree, then set blProbs for each node
+//calculates the total time in the tree
 double totalTimeInTree(){
 	double tTime, siteLength;
 	int i;
@@ -2079,19 +2585,16 @@ double totalTimeInTree(){
 
 	tTime=0.0;
 	siteLength=1.0/nSites;
-	for(i=0;i<totNodeNumber;i++){
-		allNodes[i]->blProb = siteLength * allNodes[i]->nancSites * allNodes[i]->branchLength;
-		tTime += allNodes[i]->blProb;
-	}
-//	for(i=0;i<totNodeNumber;i++)allNodes[i]->blProb /= tTime;
+	for(i=0;i<totNodeNumber;i++)
+		tTime += branchWeight(i, siteLength);
 	return tTime;
 }
 
-void recurseTreePushMutation(rootedNode *aNode, float site){
-	if(aNode->leftChild != NULL && isAncestralHere(aNode->leftChild,site))
-		recurseTreePushMutation(aNode->leftChild,site);
-	if(aNode->rightChild != NULL && isAncestralHere(aNode->rightChild,site))
-		recurseTreePushMutation(aNode->rightChild,site);
+void recurseTreePushMutation(rootedNode *aNode, double site){
+	if(nodeLeftChild[aNode->id] != NO_NODE && isAncestralHere(leftChildOf(aNode),site))
+		recurseTreePushMutation(leftChildOf(aNode),site);
+	if(nodeRightChild[aNode->id] != NO_NODE && isAncestralHere(rightChildOf(aNode),site))
+		recurseTreePushMutation(rightChildOf(aNode),site);
 	if( isLeaf(aNode) && isAncestralHere(aNode,site)){
 		if(hasMutation(aNode,site)==0) addMutation(aNode, site);
 	}
@@ -2106,7 +2609,7 @@ void addMutation(rootedNode *aNode, double site){
 /* Sort mutations on a single node */
 void sortNodeMutations(rootedNode *node) {
 	if (node != NULL && node->mutationNumber > 1) {
-		qsort(node->muts, node->mutationNumber, sizeof(double), compare_doubles);
+		sortSites(node->muts, node->mutationNumber);
 	}
 }
 
@@ -2155,7 +2658,7 @@ int hasMutation(rootedNode *aNode, double site){
 }
 
 //findRootAtSite-- returns the index of the node that is the root at a given site
-int findRootAtSite(float site){
+int findRootAtSite(double site){
 	int j;
 	j = 0;
 	while(nAncestorsHere(allNodes[j], site) != sampleSize){
@@ -2165,62 +2668,108 @@ int findRootAtSite(float site){
 }
 
 //printTreeAtSite-- prints a newick tree at a given site
-void printTreeAtSite(float site){
+void printTreeAtSite(double site){
 	int rootIdx;
     float tPtr;
 	
     tPtr = 0;
 	rootIdx = findRootAtSite(site);
 	newickRecurse(allNodes[rootIdx],site,tPtr);
-	printf(";\n");
+	outputWrite(";\n", 2);
 
 }
 
-void newickRecurse(rootedNode *aNode, float site, float tempTime){
+void newickRecurse(rootedNode *aNode, double site, float tempTime){
 	//printf("site: %f tempTime: %f\n",site,tempTime);
 	//printNode(aNode);
     if(isCoalNode(aNode)){
 		
-		if(hasMaterialHere(aNode->leftChild,site) && hasMaterialHere(aNode->rightChild,site)){	
-			printf("(");
-			newickRecurse(aNode->leftChild,site,0.0);
-			printf(",");
-			newickRecurse(aNode->rightChild,site,0.0);
-			printf(")");
+		if(hasMaterialHere(leftChildOf(aNode),site) && hasMaterialHere(rightChildOf(aNode),site)){	
+			outputPutc('(');
+			newickRecurse(leftChildOf(aNode),site,0.0);
+			outputPutc(',');
+			newickRecurse(rightChildOf(aNode),site,0.0);
+			outputPutc(')');
 			if(nAncestorsHere(aNode, site) != sampleSize){
-				printf(":%f",(aNode->branchLength + tempTime)*0.5);
+				outputPutc(':');
+				outputFixed((nodeBranchLength[aNode->id] + tempTime)*0.5, 6);
 			}
 			
 		}
 		else{
-            if(hasMaterialHere(aNode->leftChild,site)){
-                tempTime += aNode->branchLength;
-                newickRecurse(aNode->leftChild,site, \
+            if(hasMaterialHere(leftChildOf(aNode),site)){
+                tempTime += nodeBranchLength[aNode->id];
+                newickRecurse(leftChildOf(aNode),site, \
                         tempTime);
             }
-			else if(hasMaterialHere(aNode->rightChild,site)){
-                tempTime += aNode->branchLength;
-                newickRecurse(aNode->rightChild,site, \
+			else if(hasMaterialHere(rightChildOf(aNode),site)){
+                tempTime += nodeBranchLength[aNode->id];
+                newickRecurse(rightChildOf(aNode),site, \
                         tempTime);
             }
 		}
 	}
 	else{
 		if(isLeaf(aNode)){
-			printf("%d:%f",aNode->id, \
-                    (aNode->branchLength +tempTime)*0.5);
+			outputInt(aNode->id);
+			outputPutc(':');
+			outputFixed((nodeBranchLength[aNode->id] +tempTime)*0.5, 6);
 		}
 		else{ //recombination node
-			if(hasMaterialHere(aNode->leftChild,site) && \
+			if(hasMaterialHere(leftChildOf(aNode),site) && \
                     hasMaterialHere(aNode,site)){
-               tempTime+= aNode->branchLength; 
-               newickRecurse(aNode->leftChild,site, \
+               tempTime+= nodeBranchLength[aNode->id]; 
+               newickRecurse(leftChildOf(aNode),site, \
                         tempTime);
             }
 		}
 	}
 }
 
+/*printMarginalTree-- the same newick tree as printTreeAtSite, read off the
+tree iterator instead of querying every node's ancestry; sites must be
+visited left to right */
+static void newickMarginalRecurse(const MarginalTrees *mt, int n, int root, float tempTime){
+	rootedNode *aNode = allNodes[n];
+	int left, right;
+
+	left = nodeLeftChild[aNode->id] != NO_NODE && mt->parent[nodeLeftChild[aNode->id]] == n;
+	right = nodeRightChild[aNode->id] != NO_NODE && mt->parent[nodeRightChild[aNode->id]] == n;
+	if(isCoalNode(aNode)){
+		if(left && right){
+			outputPutc('(');
+			newickMarginalRecurse(mt, nodeLeftChild[aNode->id], root, 0.0);
+			outputPutc(',');
+			newickMarginalRecurse(mt, nodeRightChild[aNode->id], root, 0.0);
+			outputPutc(')');
+			if(n != root){
+				outputPutc(':');
+				outputFixed((nodeBranchLength[aNode->id] + tempTime)*0.5, 6);
+			}
+		}
+		else if(left)
+			newickMarginalRecurse(mt, nodeLeftChild[aNode->id], root, tempTime + nodeBranchLength[aNode->id]);
+		else if(right)
+			newickMarginalRecurse(mt, nodeRightChild[aNode->id], root, tempTime + nodeBranchLength[aNode->id]);
+	}
+	else if(isLeaf(aNode)){
+		outputInt(aNode->id);
+		outputPutc(':');
+		outputFixed((nodeBranchLength[aNode->id] + tempTime)*0.5, 6);
+	}
+	else if(left) //recombination node
+		newickMarginalRecurse(mt, nodeLeftChild[aNode->id], root, tempTime + nodeBranchLength[aNode->id]);
+}
+
+void printMarginalTree(MarginalTrees *mt, double site){
+	int root;
+
+	marginalTreesSeek(mt, siteAt(site));
+	root = marginalTreeRoot(mt);
+	newickMarginalRecurse(mt, root, root, 0.0);
+	outputWrite(";\n", 2);
+}
+
 /* Hash table entry for mutation duplicate detection */
 typedef struct MutHashEntry {
 	double mutation;
@@ -2240,11 +2789,403 @@ static inline unsigned int hashMutation(double mut) {
 }
 
 /*makeGametesMS-- MS style sample output */
-void makeGametesMS(int argc,const char *argv[]){
-	int i,j, size, mutNumber;
-	double allMuts[MAXMUTS];
+/* Leaf bitsets: with mutations left on the node they were placed on, the
+carriers of a mutation are the leaves reached from its node through children
+ancestral at its site -- the same ones the push-down in dropMutations reaches.
+Sites are visited left to right. Each node keeps the bitset of its leaves and
+the site where that set may next change (an end of one of its descendants'
+ancestry segments), so a marginal tree is only rebuilt where it changes; each
+node's bits are the OR of its children's. Every node's segment list is walked
+once with a cursor */
+
+typedef struct placedMutation {
+	double site;
+	int node;
+} placedMutation;
+
+/*sortPlacedMutations-- orders by site, keeping the given order among equal
+sites; a least-significant-byte-first radix sort on the bits of the site
+(non-negative doubles order like their bit patterns) that needs no memory
+beyond tmp */
+static void sortPlacedMutations(placedMutation *placed, placedMutation *tmp, int total) {
+	placedMutation *src = placed, *dst = tmp, *swap;
+	size_t count[256], sum, c;
+	uint64_t key;
+	int pass, i, b;
+
+	for (pass = 0; pass < 64; pass += 8) {
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < total; i++) {
+			memcpy(&key, &src[i].site, sizeof(key));
+			count[(key >> pass) & 255]++;
+		}
+		memcpy(&key, &src[0].site, sizeof(key));
+		if (count[(key >> pass) & 255] == (size_t) total)
+			continue;  // every site has the same byte here
+		for (b = 0, sum = 0; b < 256; b++) {
+			c = count[b];
+			count[b] = sum;
+			sum += c;
+		}
+		for (i = 0; i < total; i++) {
+			memcpy(&key, &src[i].site, sizeof(key));
+			dst[count[(key >> pass) & 255]++] = src[i];
+		}
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != placed)
+		memcpy(placed, src, sizeof(placedMutation) * total);
+}
+
+typedef struct leafBitsets {
+	int words;                  /* uint64_t words per bitset */
+	uint64_t *pool;             /* one bitset per node that has needed one */
+	int poolUsed, poolCapacity;
+	int *slot, *validUntil, *expanded, *stack;  /* indexed by allNodes position */
+	AncestrySegment **cursor;
+	int current;                /* stamp of the current query */
+} leafBitsets;
+
+/*ancestralAt-- isAncestralHere for allNodes[n] at site index bp, with bp
+never decreasing between calls; *until gets the first site where the answer
+may differ */
+static inline int ancestralAt(leafBitsets *lb, int n, int bp, int *until) {
+	AncestrySegment *seg = lb->cursor[n];
+
+	while (seg != NULL && seg->end <= bp)
+		seg = seg->next;
+	lb->cursor[n] = seg;
+	if (seg == NULL) {
+		*until = INT_MAX;
+		return 0;
+	}
+	if (seg->start > bp) {
+		*until = seg->start;
+		return 0;
+	}
+	*until = seg->end;
+	return seg->count > 0 && seg->count < sampleSize;
+}
+
+static inline uint64_t *leafBitset(leafBitsets *lb, int n) {
+	return lb->pool + (size_t) lb->slot[n] * lb->words;
+}
+
+static inline void orLeafBitset(uint64_t *restrict dst, const uint64_t *restrict src, int words) {
+	int w;
+	for (w = 0; w < words; w++)
+		dst[w] |= src[w];
+}
+
+/*leafBitsetOfNode-- the leaves below allNodes[root] at site index bp,
+rebuilding the stale part of its subtree in post-order off an explicit stack */
+static uint64_t *leafBitsetOfNode(leafBitsets *lb, int root, int bp) {
+	int top = 0, n, c, k, until, valid;
+	int32_t child[2];
+	uint64_t *bits;
+
+	lb->current++;
+	lb->stack[top++] = root;
+	while (top > 0) {
+		n = lb->stack[top - 1];
+		if (lb->validUntil[n] > bp) {
+			top--;
+			continue;
+		}
+		child[0] = nodeLeftChild[n];
+		child[1] = nodeRightChild[n];
+		if (lb->expanded[n] != lb->current) {
+			lb->expanded[n] = lb->current;
+			for (k = 0; k < 2; k++) {
+				if (child[k] == NO_NODE) continue;
+				c = child[k];
+				if (lb->validUntil[c] <= bp && ancestralAt(lb, c, bp, &until))
+					lb->stack[top++] = c;
+			}
+			continue;
+		}
+		if (lb->slot[n] < 0) {
+			if (lb->poolUsed == lb->poolCapacity) {
+				int newCapacity = lb->poolCapacity ? lb->poolCapacity * 2 : 256;
+				uint64_t *newPool = realloc(lb->pool, sizeof(uint64_t) * lb->words * newCapacity);
+				if (newPool == NULL) {
+					fprintf(stderr, "Error: Failed to allocate leaf bitsets (%d nodes)\n", newCapacity);
+					exit(1);
+				}
+				lb->pool = newPool;
+				lb->poolCapacity = newCapacity;
+			}
+			lb->slot[n] = lb->poolUsed++;
+		}
+		bits = leafBitset(lb, n);
+		memset(bits, 0, sizeof(uint64_t) * lb->words);
+		if (n < sampleSize)
+			bits[n / 64] |= (uint64_t) 1 << (n % 64);
+		valid = INT_MAX;
+		for (k = 0; k < 2; k++) {
+			if (child[k] == NO_NODE) continue;
+			c = child[k];
+			if (ancestralAt(lb, c, bp, &until)) {
+				orLeafBitset(bits, leafBitset(lb, c), lb->words);
+				valid = MIN(valid, lb->validUntil[c]);
+			}
+			valid = MIN(valid, until);
+		}
+		lb->validUntil[n] = valid;
+		top--;
+	}
+	return leafBitset(lb, root);
+}
+
+/* buffers of the genotype builders and the site sorts, grown as needed and
+kept between calls; releaseGenotypeScratch() frees them */
+static struct {
+	placedMutation *placed, *placedTmp;
+	uint64_t *pool, *carriers, *ancestral, *keys;
+	int *slot, *validUntil, *expanded, *stack;
+	AncestrySegment **cursor;
+	MutHashEntry *hashEntries;
+	char *column, *matrix;
+	size_t placedBytes, placedTmpBytes, poolBytes, carriersBytes, ancestralBytes, keysBytes, slotBytes,
+	       validUntilBytes, expandedBytes, stackBytes, cursorBytes, hashEntriesBytes, columnBytes, matrixBytes;
+} genotypeScratch;
+
+//reserveScratch-- at least bytes in buf, growing it at least twofold so a
+//replicate slightly larger than the last does not reallocate
+static void *reserveScratch(void *buf, size_t *capacity, size_t bytes) {
+	if (bytes <= *capacity)
+		return buf;
+	bytes = MAX(bytes, 2 * *capacity);
+	buf = realloc(buf, bytes);
+	if (buf == NULL) {
+		fprintf(stderr, "Error: Failed to allocate genotype buffers (%zu bytes)\n", bytes);
+		exit(1);
+	}
+	*capacity = bytes;
+	return buf;
+}
+
+#define RESERVE_SCRATCH(field, bytes) \
+	(genotypeScratch.field = reserveScratch(genotypeScratch.field, &genotypeScratch.field##Bytes, (bytes)))
+
+static void releaseGenotypeScratch(void) {
+	free(genotypeScratch.placed);
+	free(genotypeScratch.placedTmp);
+	free(genotypeScratch.pool);
+	free(genotypeScratch.carriers);
+	free(genotypeScratch.ancestral);
+	free(genotypeScratch.keys);
+	free(genotypeScratch.slot);
+	free(genotypeScratch.validUntil);
+	free(genotypeScratch.expanded);
+	free(genotypeScratch.stack);
+	free(genotypeScratch.cursor);
+	free(genotypeScratch.hashEntries);
+	free(genotypeScratch.column);
+	free(genotypeScratch.matrix);
+	memset(&genotypeScratch, 0, sizeof(genotypeScratch));
+}
+
+/*sortKeyed-- stable LSB radix sort of keys[0..n), carrying values along
+unless it is NULL; tmpKeys and tmpValues hold n entries each. Bytes that are
+the same in every key are skipped, so small keys take few passes */
+void sortKeyed(uint64_t *keys, int *values, uint64_t *tmpKeys, int *tmpValues, int n) {
+	uint64_t *src = keys, *dst = tmpKeys, *swap;
+	int *srcValues = values, *dstValues = tmpValues, *swapValues;
+	size_t count[256], sum, c;
+	int pass, i, b;
+
+	if (n < 2)
+		return;
+	for (pass = 0; pass < 64; pass += 8) {
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < n; i++)
+			count[(src[i] >> pass) & 255]++;
+		if (count[(src[0] >> pass) & 255] == (size_t) n)
+			continue;  // every key has the same byte here
+		for (b = 0, sum = 0; b < 256; b++) {
+			c = count[b];
+			count[b] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++) {
+			c = count[(src[i] >> pass) & 255]++;
+			dst[c] = src[i];
+			if (values != NULL)
+				dstValues[c] = srcValues[i];
+		}
+		swap = src;
+		src = dst;
+		dst = swap;
+		swapValues = srcValues;
+		srcValues = dstValues;
+		dstValues = swapValues;
+	}
+	if (src != keys) {
+		memcpy(keys, src, sizeof(uint64_t) * n);
+		if (values != NULL)
+			memcpy(values, srcValues, sizeof(int) * n);
+	}
+}
+
+/*sortSites-- sorts n positions in place. Positions are never negative, so
+their bit patterns sort like the values */
+void sortSites(double *sites, int n) {
+	uint64_t *keys;
+	int i;
+
+	if (n < 16) {
+		for (i = 1; i < n; i++) {
+			double x = sites[i];
+			int j = i;
+			while (j > 0 && sites[j - 1] > x) {
+				sites[j] = sites[j - 1];
+				j--;
+			}
+			sites[j] = x;
+		}
+		return;
+	}
+	keys = RESERVE_SCRATCH(keys, sizeof(uint64_t) * 2 * n);
+	memcpy(keys, sites, sizeof(double) * n);
+	sortKeyed(keys, NULL, keys + n, NULL, n);
+	memcpy(sites, keys, sizeof(double) * n);
+}
+
+/*sortBreakPoints-- puts breakPoints[0..breakNumber) in increasing order */
+void sortBreakPoints() {
+	uint64_t *keys;
+	int i;
+
+	keys = RESERVE_SCRATCH(keys, sizeof(uint64_t) * 2 * breakNumber);
+	for (i = 0; i < breakNumber; i++)
+		keys[i] = (uint32_t) breakPoints[i];
+	sortKeyed(keys, NULL, keys + breakNumber, NULL, breakNumber);
+	for (i = 0; i < breakNumber; i++)
+		breakPoints[i] = (int) keys[i];
+}
+
+/*leafBitsetGenotypes-- fills allMuts with the sorted segregating sites and
+returns their number; *presenceMatrix gets the sample x site matrix that
+makeGametesMS prints; both stay owned by the scratch buffers */
+static int leafBitsetGenotypes(double *allMuts, char **presenceMatrix) {
+	leafBitsets lb;
+	placedMutation *placed;
+	uint64_t *carriers, *ancestral;
+	int i, j, k, w, total, mutNumber, bp, until, ancestralUntil;
+	char *matrix, *column;
+
+	total = 0;
+	for (i = 0; i < totNodeNumber; i++)
+		total += allNodes[i]->mutationNumber;
+	*presenceMatrix = NULL;
+	if (total == 0)
+		return 0;
+	placed = RESERVE_SCRATCH(placed, sizeof(placedMutation) * total);
+	k = 0;
+	for (i = 0; i < totNodeNumber; i++) {
+		for (j = 0; j < allNodes[i]->mutationNumber; j++) {
+			placed[k].site = allNodes[i]->muts[j];
+			placed[k].node = i;
+			k++;
+		}
+	}
+	sortPlacedMutations(placed, RESERVE_SCRATCH(placedTmp, sizeof(placedMutation) * total), total);
+
+	memset(&lb, 0, sizeof(lb));
+	lb.words = (sampleSize + 63) / 64;
+	lb.slot = RESERVE_SCRATCH(slot, sizeof(int) * totNodeNumber);
+	lb.validUntil = RESERVE_SCRATCH(validUntil, sizeof(int) * totNodeNumber);
+	lb.expanded = RESERVE_SCRATCH(expanded, sizeof(int) * totNodeNumber);
+	lb.stack = RESERVE_SCRATCH(stack, sizeof(int) * (2 * totNodeNumber + 1));
+	lb.cursor = RESERVE_SCRATCH(cursor, sizeof(AncestrySegment*) * totNodeNumber);
+	lb.pool = genotypeScratch.pool;
+	lb.poolCapacity = genotypeScratch.poolBytes / (sizeof(uint64_t) * lb.words);
+	carriers = RESERVE_SCRATCH(carriers, sizeof(uint64_t) * lb.words);
+	ancestral = RESERVE_SCRATCH(ancestral, sizeof(uint64_t) * lb.words);
+	column = RESERVE_SCRATCH(column, sizeof(char) * sampleSize * total);
+	memset(lb.expanded, 0, sizeof(int) * totNodeNumber);
+	for (i = 0; i < totNodeNumber; i++) {
+		lb.slot[i] = -1;
+		lb.validUntil[i] = -1;
+		lb.cursor[i] = allNodes[i]->ancestryRoot;
+	}
+
+	/* one column per distinct site, filled column by column */
+	mutNumber = 0;
+	ancestralUntil = -1;
+	for (k = 0; k < total; k = j) {
+		bp = siteAt(placed[k].site);
+		if (bp >= ancestralUntil) {
+			memset(ancestral, 0, sizeof(uint64_t) * lb.words);
+			ancestralUntil = INT_MAX;
+			for (i = 0; i < sampleSize; i++) {
+				if (ancestralAt(&lb, i, bp, &until))
+					ancestral[i / 64] |= (uint64_t) 1 << (i % 64);
+				ancestralUntil = MIN(ancestralUntil, until);
+			}
+		}
+		memset(carriers, 0, sizeof(uint64_t) * lb.words);
+		for (j = k; j < total && placed[j].site == placed[k].site; j++)
+			orLeafBitset(carriers, leafBitsetOfNode(&lb, placed[j].node, bp), lb.words);
+		for (w = 0; w < lb.words && carriers[w] == 0; w++)
+			;
+		if (w == lb.words)
+			continue;
+		assert(mutNumber < MAXMUTS);
+		allMuts[mutNumber] = placed[k].site;
+		for (i = 0; i < sampleSize; i++) {
+			if (!(ancestral[i / 64] >> (i % 64) & 1))
+				column[(size_t) mutNumber * sampleSize + i] = alleleCodes[2];
+			else
+				column[(size_t) mutNumber * sampleSize + i] = alleleCodes[carriers[i / 64] >> (i % 64) & 1];
+		}
+		mutNumber++;
+	}
+
+	/* transpose to one contiguous row per haplotype */
+	matrix = NULL;
+	if (mutNumber > 0) {
+		matrix = RESERVE_SCRATCH(matrix, sizeof(char) * sampleSize * mutNumber);
+		for (j = 0; j < mutNumber; j++)
+			for (i = 0; i < sampleSize; i++)
+				matrix[haplotypeCell(i, j, mutNumber)] = column[(size_t) j * sampleSize + i];
+	}
+	*presenceMatrix = matrix;
+
+	genotypeScratch.pool = lb.pool;
+	genotypeScratch.poolBytes = sizeof(uint64_t) * lb.words * lb.poolCapacity;
+	return mutNumber;
+}
+
+//releaseReplicateBuffers-- returns the storage a replicate grows: node and
+//breakpoint arrays, the mutation arena, segment free lists and genotype
+//buffers. Called after each replicate unless --keep-buffers holds it for the
+//next one
+void releaseReplicateBuffers(){
+	cleanupBreakPoints();
+	freeMutationArena();
+	cleanupNodeArrays();
+	trimAncestrySegmentPool();
+	trimAVLPool();
+	trimActiveSegmentPool();
+	releaseGenotypeScratch();
+	free(placementStart);
+	free(placementPrefix);
+	placementStart = NULL;
+	placementPrefix = NULL;
+	placementSegments = placementCapacity = 0;
+}
+
+/*pushedDownGenotypes-- the same from the mutations dropMutations pushed
+down to the leaves */
+static int pushedDownGenotypes(double *allMuts, char **presenceMatrixOut){
+	int i,j, size, mutNumber, total, entries;
 	MutHashEntry *hashTable[MUTATION_HASH_SIZE];
-	MutHashEntry *entry, *newEntry;
+	MutHashEntry *entry, *newEntry, *entryPool;
+	char *presenceMatrix = NULL;
 
 	/* Sort all mutations before output generation for binary search */
 	sortAllMutations();
@@ -2254,6 +3195,14 @@ void makeGametesMS(int argc,const char *argv[]){
 		hashTable[i] = NULL;
 	}
 
+	/* every distinct mutation takes one entry, so there are at most as many
+	   as the leaves carry */
+	total = 0;
+	for (i = 0; i < sampleSize; i++)
+		total += allNodes[i]->mutationNumber;
+	entryPool = RESERVE_SCRATCH(hashEntries, sizeof(MutHashEntry) * MAX(total, 1));
+	entries = 0;
+
 	/* get unique list of muts using hash table for O(n) duplicate detection */
 	size = 0;
 	for (i = 0; i < sampleSize; i++){
@@ -2276,7 +3225,7 @@ void makeGametesMS(int argc,const char *argv[]){
 				size++;
 				
 				/* Add to hash table */
-				newEntry = (MutHashEntry*)malloc(sizeof(MutHashEntry));
+				newEntry = &entryPool[entries++];
 				newEntry->mutation = mut;
 				newEntry->next = hashTable[hash];
 				hashTable[hash] = newEntry;
@@ -2284,62 +3233,86 @@ void makeGametesMS(int argc,const char *argv[]){
 		}
 	}
 	
-	/* Clean up hash table */
-	for (i = 0; i < MUTATION_HASH_SIZE; i++) {
-		entry = hashTable[i];
-		while (entry != NULL) {
-			MutHashEntry *temp = entry;
-			entry = entry->next;
-			free(temp);
-		}
-	}
-	
 	mutNumber = size;
-	qsort(allMuts, size, sizeof(allMuts[0]), compare_doubles);
-	printf("\n//\nsegsites: %d",mutNumber);
-	if(mutNumber > 0) printf("\npositions: ");
-	for(i = 0; i < mutNumber; i++)
-		fprintf(stdout,"%6.6lf ",allMuts[i] );
-	fprintf(stdout,"\n");
+	sortSites(allMuts, size);
 
 /* Phase 3 optimization: Pre-compute presence matrix */
-	char *presenceMatrix = NULL;
 	if (mutNumber > 0) {
-		presenceMatrix = (char*)calloc(sampleSize * mutNumber, sizeof(char));
-		if (presenceMatrix == NULL) {
-			fprintf(stderr, "Error: Failed to allocate presence matrix\n");
-			exit(1);
-		}
+		presenceMatrix = RESERVE_SCRATCH(matrix, (size_t) sampleSize * mutNumber);
 		
 		/* Pre-compute all ancestry and mutation information */
 		for (i = 0; i < sampleSize; i++) {
 			for (j = 0; j < mutNumber; j++) {
-				int idx = i * mutNumber + j;
+				size_t idx = haplotypeCell(i, j, mutNumber);
 				if (isAncestralHere(allNodes[i], allMuts[j])) {
 					if (hasMutation(allNodes[i], allMuts[j])) {
-						presenceMatrix[idx] = '1';
+						presenceMatrix[idx] = alleleCodes[1];
 					} else {
-						presenceMatrix[idx] = '0';
+						presenceMatrix[idx] = alleleCodes[0];
 					}
 				} else {
-					presenceMatrix[idx] = 'N';
+					presenceMatrix[idx] = alleleCodes[2];
 				}
 			}
 		}
 	}
-	
-	/* Output using pre-computed matrix */
+	*presenceMatrixOut = presenceMatrix;
+	return mutNumber;
+}
+
+/*replicateGenotypes-- the segregating sites of the replicate in allMuts
+(MAXMUTS long) and its sampleSize x sites haplotype matrix; returns the number
+of sites. The matrix is given back with releaseGenotypes() */
+int replicateGenotypes(double *allMuts, char **presenceMatrix){
+	if (leafBitsetMode)
+		return leafBitsetGenotypes(allMuts, presenceMatrix);
+	return pushedDownGenotypes(allMuts, presenceMatrix);
+}
+
+/*takeGenotypes-- detaches the matrix replicateGenotypes() returned from the
+genotype scratch and trims it to bytes, so the caller owns it and frees it
+with free(); the next replicate grows a new one */
+char *takeGenotypes(char *presenceMatrix, size_t bytes){
+	char *trimmed;
+
+	if (presenceMatrix == NULL)
+		return NULL;
+	assert(presenceMatrix == genotypeScratch.matrix);
+	genotypeScratch.matrix = NULL;
+	genotypeScratch.matrixBytes = 0;
+	trimmed = realloc(presenceMatrix, MAX(bytes, 1));
+	return trimmed != NULL ? trimmed : presenceMatrix;
+}
+
+void releaseGenotypes(char *presenceMatrix){
+	/* both builders leave the matrix in the genotype scratch, which the
+	   next call reuses */
+	(void) presenceMatrix;
+}
+
+void makeGametesMS(int argc,const char *argv[]){
+	int i, mutNumber;
+	double allMuts[MAXMUTS];
+	char *presenceMatrix;
+
+	mutNumber = replicateGenotypes(allMuts, &presenceMatrix);
+
+	outputPrintf("\n//\nsegsites: %d",mutNumber);
+	if(mutNumber > 0) outputPrintf("\npositions: ");
+	//positions have at least 6 decimals, so the old %6.6lf never padded them
+	for(i = 0; i < mutNumber; i++){
+		outputFixed(allMuts[i], positionDigits);
+		outputPutc(' ');
+	}
+	outputPutc('\n');
+
+	/* Output using pre-computed matrix; each haplotype is one contiguous row */
 	for (i = 0; i < sampleSize; i++) {
-		for (j = 0; j < mutNumber; j++) {
-			printf("%c", presenceMatrix[i * mutNumber + j]);
-		}
-		printf("\n");
+		if (mutNumber > 0)
+			outputWrite(presenceMatrix + haplotypeCell(i, 0, mutNumber), mutNumber);
+		outputPutc('\n');
 	}
-	
-	/* Clean up */
-	if (presenceMatrix) {
-		free(presenceMatrix);
-	}  
+	releaseGenotypes(presenceMatrix);
 }
 
 void errorCheckMutations(){
@@ -2357,24 +3330,31 @@ void errorCheckMutations(){
 //this will not return the "correct" number of mutations conditional on theta
 void dropMutationsUntilTime(double t){
 	int i, j, m;
-	double mutSite,p;
+	double mutSite,p,siteLength;
+	rootedNode *lChild, *rChild;
 	//get time and set probs
 	coaltime = totalTimeInTreeUntilTime(t);
+	siteLength = 1.0/nSites;
 	//printf("%f\n",coaltime);
 	for(i=0;i<totNodeNumber;i++){
 		//add Mutations
-		p = allNodes[i]->blProb * theta * 0.5;
+		p = branchWeight(i, siteLength) * theta * 0.5;
 		if(p>0.0){
 		  m = ignpoi(p);
+		  if(segmentMutationMode && m > 0){
+			  buildPlacementTable(allNodes[i]);
+			  for(; m > 0 && placementSegments > 0; m--)
+				  addMutation(allNodes[i], placeMutationOnSegments(allNodes[i]));
+		  }
 		  while(m>0){
-		  mutSite = genunf((float)allNodes[i]->lLim / nSites, (float) allNodes[i]->rLim / nSites);
+		  mutSite = genunf(siteStart(allNodes[i]->lLim), siteStart(allNodes[i]->rLim));
 		  while(isAncestralHere(allNodes[i],mutSite) != 1){
 				  if (allNodes[i]->lLim == allNodes[i]->rLim){
 				    p = allNodes[i]->rLim + (1.0/nSites);
-				    mutSite = genunf((float)allNodes[i]->lLim / nSites, p / nSites);
+				    mutSite = genunf(siteStart(allNodes[i]->lLim), p / nSites);
 				  }
 				  else
-				    mutSite = genunf((float)allNodes[i]->lLim / nSites, (float) allNodes[i]->rLim / nSites);
+				    mutSite = genunf(siteStart(allNodes[i]->lLim), siteStart(allNodes[i]->rLim));
 			  }
 		  //	printf("mut: %f\n",mutSite);
 			addMutation(allNodes[i],mutSite);
@@ -2383,20 +3363,24 @@ void dropMutationsUntilTime(double t){
 		}
 	}
 //	printf("coaltime: %f totM: %d\n",coaltime,tm);
-	//push mutations down tree
+	//push mutations down tree; with leaf bitsets makeGametesMS finds the carriers
+	if(leafBitsetMode)
+		return;
 	for(i=totNodeNumber-1;i>=0;i--){
+		lChild = nodeAt(nodeLeftChild[i]);
+		rChild = nodeAt(nodeRightChild[i]);
 		for(j=0;j<allNodes[i]->mutationNumber;j++){
 			mutSite = allNodes[i]->muts[j];
-			if(allNodes[i]->leftChild != NULL && isAncestralHere(allNodes[i]->leftChild,mutSite))
-				addMutation(allNodes[i]->leftChild,mutSite);
-			if(allNodes[i]->rightChild != NULL && isAncestralHere(allNodes[i]->rightChild,mutSite))
-				addMutation(allNodes[i]->rightChild,mutSite);
+			if(lChild != NULL && isAncestralHere(lChild,mutSite))
+				addMutation(lChild,mutSite);
+			if(rChild != NULL && isAncestralHere(rChild,mutSite))
+				addMutation(rChild,mutSite);
 				
 		}
 	}
 }
 
-//calculates the total time in the tree, then set blProbs for each node
+//calculates the total time in the tree
 double totalTimeInTreeUntilTime(double t){
 	double tTime, siteLength;
 	int i;
@@ -2406,13 +3390,11 @@ double totalTimeInTreeUntilTime(double t){
 	siteLength=1.0/nSites;
 	for(i=0;i<totNodeNumber;i++){
 		//censor times
-		if(allNodes[i]->leftParent == NULL || allNodes[i]->leftParent->time > t){
-			allNodes[i]->branchLength = MAX(t - allNodes[i]->time,0);
+		if(nodeLeftParent[i] == NO_NODE || nodeTime[nodeLeftParent[i]] > t){
+			nodeBranchLength[i] = MAX(t - nodeTime[i],0);
 		}
-		allNodes[i]->blProb = siteLength * allNodes[i]->nancSites * allNodes[i]->branchLength;
-		tTime += allNodes[i]->blProb;
+		tTime += branchWeight(i, siteLength);
 	}
-//	for(i=0;i<totNodeNumber;i++)allNodes[i]->blProb /= tTime;
 	return tTime;
 }
 
@@ -2492,14 +3474,14 @@ void addAncientSample(int lineageNumber, int popnDest, double addTime, int still
 	for(i=0; i < alleleNumber && count < lineageNumber; i++){
 		if(nodes[i]->population == (popnDest+1) * -1){
 			nodes[i]->population = popnDest;
-			nodes[i]->time = addTime;
+			nodeTime[nodes[i]->id] = addTime;
 			if(stillSweeping == 1){
 				rn = ranf();
 				if(rn<currentFreq){
 					nodes[i]->sweepPopn=1;
 				}
 			}
-			//printf("time for %d: %f\n", i, nodes[i]->time);
+			//printf("time for %d: %f\n", i, nodeTime[nodes[i]->id]);
 			popnSizes[popnDest]++;
 			count++;
 		}
@@ -2510,16 +3492,21 @@ void addAncientSample(int lineageNumber, int popnDest, double addTime, int still
 void initializeNodeArrays() {
 	int initialCapacity = 1000;  // Start small
 	
-	nodesCapacity = initialCapacity;
-	allNodesCapacity = initialCapacity;
-	
-	nodes = malloc(sizeof(rootedNode*) * nodesCapacity);
-	allNodes = malloc(sizeof(rootedNode*) * allNodesCapacity);
-	
-	if (nodes == NULL || allNodes == NULL) {
-		fprintf(stderr, "Error: Failed to allocate initial node arrays\n");
-		exit(1);
+	if (!keepBuffersMode || nodes == NULL || allNodes == NULL) {
+		nodesCapacity = initialCapacity;
+		allNodesCapacity = initialCapacity;
+		
+		nodes = malloc(sizeof(rootedNode*) * nodesCapacity);
+		allNodes = malloc(sizeof(rootedNode*) * allNodesCapacity);
+		
+		if (nodes == NULL || allNodes == NULL) {
+			fprintf(stderr, "Error: Failed to allocate initial node arrays\n");
+			exit(1);
+		}
 	}
+	// initialize() stores every sample before any event grows the arrays
+	ensureNodesCapacity(sampleSize);
+	ensureAllNodesCapacity(sampleSize);
 }
 
 void ensureNodesCapacity(int requiredSize) {
@@ -2582,6 +3569,8 @@ void addNode(rootedNode *aNode){
 	popnSizes[aNode->population]+=1;
 	if(aNode->population==0)
 		sweepPopnSizes[aNode->sweepPopn]+=1;
+	PERF_PEAK(peakAlleleNumber, alleleNumber);
+	PERF_PEAK(peakTotNodeNumber, totNodeNumber);
 }
 
 //removeNodeAt-- removes a node given an index   
@@ -2672,25 +3661,29 @@ rootedNode *pickNodePopnSweep(int popn,int sp){
 
 
 void printNode(rootedNode *aNode){
-	printf("node: %p time: %f lLim: %d rLim: %d nancSites: %d popn: %d sweepPopn: %d\n",aNode, aNode->time,aNode->lLim,\
-		aNode->rLim, aNode->nancSites, aNode->population, aNode->sweepPopn);
+	printf("node: %p time: %f lLim: %d rLim: %d nancSites: %d popn: %d sweepPopn: %d\n",aNode, nodeTime[aNode->id],aNode->lLim,\
+		aNode->rLim, nodeNancSites[aNode->id], aNode->population, aNode->sweepPopn);
 	// ancSites array removed - ancestry now tracked via tree
 }
 
 void freeTree(rootedNode *aNode){
+	long n;
 	int i;
+	rootedNode *slot;
 	//printf("final nodeNumber = %d\n",totNodeNumber);
-	//cleanup nodes
-	for (i = 0; i < totNodeNumber; i++){
-		cleanupMuts(allNodes[i]);      // Free muts array
+	//cleanup nodes, walking the store block by block rather than through allNodes
+	for (n = 0; n < nodeStoreUsed; n++){
+		slot = &nodeBlocks[n / NODE_BLOCK_SIZE][n % NODE_BLOCK_SIZE];
 		// Free ancestry segment tree
-		if (allNodes[i]->ancestryRoot) {
-			freeSegmentTree(allNodes[i]->ancestryRoot);
-			allNodes[i]->ancestryRoot = NULL;
+		if (slot->ancestryRoot) {
+			freeSegmentTree(slot->ancestryRoot);
+			slot->ancestryRoot = NULL;
 		}
-		free(allNodes[i]);
+	}
+	for (i = 0; i < totNodeNumber; i++)
 		allNodes[i] = NULL;
-	} 
+	resetNodeStore();
+	resetMutationArena();
 }
 
 /*nodePopnSize-- returns popnSize of popn from
@@ -2762,15 +3755,10 @@ int compare_doubles(const void *a,const void *b){
 		return -1;
 	}
 }
-int compare_floats(const void *a,const void *b){
-	float *pa = (float *) a;
-	float *pb = (float *) b;
-	if ((*pa - *pb) > 0 ){
-		return 1;
-	}
-	else{
-		return -1;
-	}
+int compare_ints(const void *a,const void *b){
+	int pa = *(const int *) a;
+	int pb = *(const int *) b;
+	return (pa > pb) - (pa < pb);
 }
 
 
@@ -2790,45 +3778,106 @@ unsigned int devrand(void) {
 
 
 // Muts dynamic memory management functions
+// A node's mutations are a chunk of the mutation arena, a chain of blocks of
+// at least MUTATION_BLOCK_SIZE doubles. A list that outgrows its chunk moves
+// to one twice the size; nothing is freed until the arena is reset with the
+// tree, and the blocks themselves stay until freeMutationArena(), so with
+// --keep-buffers a replicate only adds a block when it needs more room than
+// all the earlier ones did
+#define MUTATION_BLOCK_SIZE 8192
+
+typedef struct mutationBlock {
+	double *sites;
+	long size;
+} mutationBlock;
+
+static mutationBlock *mutationBlocks;
+static int mutationBlockCount, mutationBlocksCapacity, mutationBlockCurrent;
+static long mutationBlockUsed;
+
+//takeMutationChunk-- room for capacity mutations from the arena
+static double *takeMutationChunk(int capacity) {
+	double *chunk;
+	long size;
+
+	while (mutationBlockCurrent < mutationBlockCount &&
+	       mutationBlockUsed + capacity > mutationBlocks[mutationBlockCurrent].size) {
+		mutationBlockCurrent++;
+		mutationBlockUsed = 0;
+	}
+	if (mutationBlockCurrent == mutationBlockCount) {
+		if (mutationBlockCount == mutationBlocksCapacity) {
+			int newCapacity = mutationBlocksCapacity ? mutationBlocksCapacity * 2 : 16;
+			mutationBlock *newBlocks = realloc(mutationBlocks, sizeof(mutationBlock) * newCapacity);
+			if (newBlocks == NULL) {
+				fprintf(stderr, "Error: Failed to reallocate mutation block list (requested: %d blocks)\n", newCapacity);
+				exit(1);
+			}
+			mutationBlocks = newBlocks;
+			mutationBlocksCapacity = newCapacity;
+		}
+		size = MAX(capacity, MUTATION_BLOCK_SIZE);
+		mutationBlocks[mutationBlockCount].sites = malloc(sizeof(double) * size);
+		if (mutationBlocks[mutationBlockCount].sites == NULL) {
+			fprintf(stderr, "Error: Failed to allocate memory for muts array (capacity: %ld)\n", size);
+			exit(1);
+		}
+		mutationBlocks[mutationBlockCount].size = size;
+		mutationBlockCount += 1;
+		mutationBlockUsed = 0;
+	}
+	chunk = mutationBlocks[mutationBlockCurrent].sites + mutationBlockUsed;
+	mutationBlockUsed += capacity;
+	return chunk;
+}
+
+//resetMutationArena-- hands every block out again; mutation lists taken
+//before must no longer be used
+void resetMutationArena() {
+	mutationBlockCurrent = 0;
+	mutationBlockUsed = 0;
+}
+
+//freeMutationArena-- releases the arena's blocks
+void freeMutationArena() {
+	int i;
+
+	for (i = 0; i < mutationBlockCount; i++)
+		free(mutationBlocks[i].sites);
+	free(mutationBlocks);
+	mutationBlocks = NULL;
+	mutationBlockCount = mutationBlocksCapacity = 0;
+	resetMutationArena();
+}
+
 void initializeMuts(rootedNode *node, int capacity) {
 	if (capacity <= 0) {
 		capacity = 10;  // Start with small capacity, will grow as needed
 	}
 	
 	node->mutsCapacity = capacity;
-	node->muts = malloc(sizeof(double) * capacity);
-	
-	if (node->muts == NULL) {
-		fprintf(stderr, "Error: Failed to allocate memory for muts array (capacity: %d)\n", capacity);
-		exit(1);
-	}
+	node->muts = takeMutationChunk(capacity);
 }
 
 void ensureMutsCapacity(rootedNode *node, int requiredSize) {
 	if (requiredSize > node->mutsCapacity) {
-		int newCapacity = node->mutsCapacity;
+		int newCapacity = node->mutsCapacity > 0 ? node->mutsCapacity : 10;
 		
 		// Double capacity until we have enough
 		while (newCapacity < requiredSize) {
 			newCapacity *= 2;
 		}
 		
-		double *newMuts = realloc(node->muts, sizeof(double) * newCapacity);
-		if (newMuts == NULL) {
-			fprintf(stderr, "Error: Failed to reallocate memory for muts array (capacity: %d -> %d)\n", 
-					node->mutsCapacity, newCapacity);
-			exit(1);
-		}
-		
+		double *newMuts = takeMutationChunk(newCapacity);
+		if (node->muts != NULL)
+			memcpy(newMuts, node->muts, sizeof(double) * node->mutsCapacity);
 		node->muts = newMuts;
 		node->mutsCapacity = newCapacity;
 	}
 }
 
+// the chunk goes back with the rest of the arena when the tree is freed
 void cleanupMuts(rootedNode *node) {
-	if (node->muts != NULL) {
-		free(node->muts);
-		node->muts = NULL;
-		node->mutsCapacity = 0;
-	}
+	node->muts = NULL;
+	node->mutsCapacity = 0;
 }
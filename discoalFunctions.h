@@ -9,8 +9,13 @@ void addBreakPoint(int bp);
 void initializeMuts(rootedNode *node, int capacity);
 void ensureMutsCapacity(rootedNode *node, int requiredSize);
 void cleanupMuts(rootedNode *node);
+void resetMutationArena();
+void freeMutationArena();
 void cleanupNodeArrays();
 rootedNode *newRootedNode(double cTime, int popn);
+void resetNodeStore();
+void freeNodeStore();
+void releaseReplicateBuffers();
 
 void coalesceAtTimePopn(double cTime, int popn);
 void coalesceAtTimePopnSweep(double cTime, int popn, int sp);
@@ -25,8 +30,8 @@ void geneConversionAtTimePopnSweep(double cTime, int popn, int sp, double sweepS
 void updateActiveMaterial(rootedNode *aNode);
 void updateAncestryStatsFromTree(rootedNode *node);
 int isActive(int site);
-int isAncestralHere(rootedNode *aNode, float site);
-int nAncestorsHere(rootedNode *aNode, float site);
+int isAncestralHere(rootedNode *aNode, double site);
+int nAncestorsHere(rootedNode *aNode, double site);
 
 int siteBetweenChunks(rootedNode *aNode, int xOverSite);
 void dropMutations();
@@ -35,8 +40,11 @@ int hasMutation(rootedNode *aNode, double site);
 void sortNodeMutations(rootedNode *node);
 void sortAllMutations();
 void makeGametesMS(int argc,const char *argv[]);
+int replicateGenotypes(double *allMuts, char **presenceMatrix);
+char *takeGenotypes(char *presenceMatrix, size_t bytes);
+void releaseGenotypes(char *presenceMatrix);
 void dropMutationsRecurse();
-void recurseTreePushMutation(rootedNode *aNode, float site);
+void recurseTreePushMutation(rootedNode *aNode, double site);
 void errorCheckMutations();
 
 void mergePopns(int popnSrc, int popnDest);
@@ -62,6 +70,11 @@ double sweepPhaseEventsGeneralPopNumber(int *bpArray, double startTime, double e
 			
 double recurrentSweepPhaseGeneralPopNumber(int *bpArray,double startTime, double endTime, double *finalFreq, double alpha, char sweepMode, double *sizeRatio);
 		
+void trajectoryStepperInit(trajectoryStepper *ts, int currentEventNumber, double *sizeRatio, char sweepMode, \
+double initialFreq, double alpha, double f0, double currentTime);
+int trajectoryStepperNext(trajectoryStepper *ts);
+void proposeTrajectorySpeculative(int currentEventNumber, double *sizeRatio, char sweepMode, \
+double initialFreq, double alpha, double f0, double currentTime);
 double proposeTrajectory(int currentEventNumber, float *currentTrajectory, double *sizeRatio, char sweepMode, \
 	double initialFreq, double *finalFreq, double alpha, double f0, double currentTime);
 double sweepPhaseEventsConditionalTrajectory(int *bpArray, double startTime, double endTime, double sweepSite,\
@@ -97,17 +110,22 @@ rootedNode *pickNodePopnSweep(int popn,int sp);
 int compare_events(const void *a,const void *b);
 void sortEventArray(struct event *eArray, int eNumber);
 
-int findRootAtSite(float site);
-int hasMaterialHere(rootedNode *aNode, float site);
+int findRootAtSite(double site);
+int hasMaterialHere(rootedNode *aNode, double site);
 int isLeaf(rootedNode *aNode);
 int isCoalNode(rootedNode *aNode);
-void newickRecurse(rootedNode *aNode, float site,float tempTime);
-void printTreeAtSite(float site);
+void newickRecurse(rootedNode *aNode, double site,float tempTime);
+void printTreeAtSite(double site);
+struct MarginalTrees;
+void printMarginalTree(struct MarginalTrees *mt, double site);
 void printAllNodes();
 void printAllActiveNodes();
 
 unsigned int devrand(void);
 int compare_doubles(const void *a,const void *b);
-int compare_floats(const void *a,const void *b);
+int compare_ints(const void *a,const void *b);
+void sortKeyed(uint64_t *keys, int *values, uint64_t *tmpKeys, int *tmpValues, int n);
+void sortSites(double *sites, int n);
+void sortBreakPoints();
 
 #endif
@@ -0,0 +1,318 @@
+// discoalServer.c
+// serving simulation requests over a Unix domain socket from one warm process
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "ranlib.h"
+#include "discoal.h"
+#include "discoalFunctions.h"
+#include "discoalEngine.h"
+#include "discoalServer.h"
+#include "marginalTrees.h"
+#include "outputWriter.h"
+#include "rngStream.h"
+
+#define MAX_REQUEST_BYTES (1 << 20)
+#define MAX_REQUEST_ARGS 4096
+// getParameters reads an option's values without checking argc; blanks
+// after the last argument keep a truncated option from reading past the end
+#define ARGV_PADDING 16
+
+// set by SIGINT/SIGTERM; the accept loop and runRequest() stop on it
+static volatile sig_atomic_t stopRequested = 0;
+
+// bytes of a --binary reply
+typedef struct {
+	char *data;
+	size_t len, cap;
+} Reply;
+
+static Reply reply;
+static int replyTrees;
+static MarginalTrees marginalTrees;
+static double replyMuts[MAXMUTS];
+
+static void stopServing(int sig) {
+	(void) sig;
+	stopRequested = 1;
+}
+
+// room for len more bytes at the end of the reply
+static char *replyReserve(size_t len) {
+	char *at;
+
+	if (reply.len + len > reply.cap) {
+		reply.cap = reply.cap ? reply.cap : 65536;
+		while (reply.len + len > reply.cap)
+			reply.cap *= 2;
+		reply.data = realloc(reply.data, reply.cap);
+		if (reply.data == NULL) {
+			fprintf(stderr, "Error: Failed to allocate server reply\n");
+			exit(1);
+		}
+	}
+	at = reply.data + reply.len;
+	reply.len += len;
+	return at;
+}
+
+static void replyAppend(const void *data, size_t len) {
+	memcpy(replyReserve(len), data, len);
+}
+
+static void replyInt32(int32_t x) {
+	replyAppend(&x, sizeof(x));
+}
+
+static int sendAll(int fd, const char *data, size_t len) {
+	ssize_t n;
+
+	while (len > 0) {
+		n = send(fd, data, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 0;
+		data += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int sendText(int fd, const char *text) {
+	return sendAll(fd, text, strlen(text));
+}
+
+// one line, without its newline; NULL if the client sent nothing usable
+static char *readRequest(int fd) {
+	size_t len = 0, cap = 4096;
+	char *line = malloc(cap);
+	ssize_t n;
+
+	while (line != NULL) {
+		if (len + 1 == cap) {
+			if (cap >= MAX_REQUEST_BYTES)
+				break;
+			cap *= 2;
+			line = realloc(line, cap);
+			if (line == NULL)
+				break;
+		}
+		n = recv(fd, line + len, cap - 1 - len, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		len += n;
+		if (memchr(line + len - n, '\n', n) != NULL)
+			break;
+	}
+	if (line == NULL || len == 0) {
+		free(line);
+		return NULL;
+	}
+	line[len] = '\0';
+	line[strcspn(line, "\r\n")] = '\0';
+	return line;
+}
+
+// each tree writeTrees() formats becomes a length-prefixed string
+static void binaryTree(int sites, void *arg) {
+	const char *text;
+	size_t len;
+
+	(void) arg;
+	text = outputTake(&len);
+	if (len > 0 && text[len - 1] == '\n')
+		len--;
+	replyInt32(sites);
+	replyInt32((int32_t) len);
+	replyAppend(text, len);
+	replyTrees++;
+}
+
+static void binaryReplicate(void) {
+	int32_t n;
+	size_t countAt, i, cells;
+	char *matrix;
+	signed char *alleles;
+
+	if (treeOutputMode == 1 && condRecMode == 0) {
+		replyAppend("T", 1);
+		countAt = reply.len;
+		replyInt32(0);
+		replyTrees = 0;
+		writeTrees(&marginalTrees, binaryTree, NULL);
+		n = replyTrees;
+		memcpy(reply.data + countAt, &n, sizeof(n));
+		return;
+	}
+	n = replicateGenotypes(replyMuts, &matrix);
+	replyAppend("H", 1);
+	replyInt32(sampleSize);
+	replyInt32(n);
+	replyAppend(replyMuts, sizeof(double) * n);
+	cells = (size_t) sampleSize * n;
+	alleles = (signed char *) replyReserve(cells);
+	for (i = 0; i < cells; i++)
+		alleles[i] = matrix[i] == 'N' ? -1 : matrix[i] - '0';
+	releaseGenotypes(matrix);
+}
+
+// runs the replicates of the parsed command line, sending each as it is done
+static void runRequest(int fd, int binary, int argc, const char **argv) {
+	const char *text;
+	size_t len;
+	int i, seeded, ok;
+	int64_t seeds[2];
+
+	setall(seed1, seed2);
+	reply.len = 0;
+	if (binary) {
+		seeds[0] = seed1;
+		seeds[1] = seed2;
+		replyAppend("DISCOAL\1", 8);
+		replyAppend(seeds, sizeof(seeds));
+	}
+	else {
+		for (i = 0; i < argc; i++)
+			outputPrintf("%s ", argv[i]);
+		outputPrintf("\n%ld %ld\n", seed1, seed2);
+	}
+	seeded = -1;
+	ok = 1;
+	for (i = 0; ok && !stopRequested && i < sampleNumber; ) {
+		if (replicateStreamMode && seeded != i) {
+			seedReplicateStream(seed1, seed2, replicateStart + i);
+			seeded = i;
+		}
+		simulateReplicate(replicateStart + i);
+		if (condRecMode == 0 || condRecMet == 1) {
+			condRecMet = 0;
+			i++;
+			if (binary)
+				binaryReplicate();
+			else if (treeOutputMode == 1 && condRecMode == 0) {
+				outputWrite("\n//\n", 4);
+				writeTrees(&marginalTrees, NULL, NULL);
+			}
+			else
+				makeGametesMS(argc, argv);
+		}
+		finishReplicate();
+		if (binary) {
+			ok = sendAll(fd, reply.data, reply.len);
+			reply.len = 0;
+		}
+		else {
+			text = outputTake(&len);
+			ok = sendAll(fd, text, len);
+		}
+	}
+	// a client that went away leaves the rest of its request unsimulated
+	if (binary && ok && reply.len > 0)
+		sendAll(fd, reply.data, reply.len);
+}
+
+static void handleRequest(int fd) {
+	char *line, *word, *save;
+	const char **argv;
+	int argc = 1, binary = 0, i;
+
+	line = readRequest(fd);
+	if (line == NULL)
+		return;
+	argv = malloc(sizeof(char *) * (MAX_REQUEST_ARGS + ARGV_PADDING));
+	if (argv == NULL) {
+		fprintf(stderr, "Error: Failed to allocate request\n");
+		exit(1);
+	}
+	argv[0] = "discoal";
+	for (word = strtok_r(line, " \t", &save); word != NULL; word = strtok_r(NULL, " \t", &save)) {
+		if (strcmp(word, "--binary") == 0)
+			binary = 1;
+		else if (argc < MAX_REQUEST_ARGS)
+			argv[argc++] = word;
+	}
+	for (i = argc; i < argc + ARGV_PADDING; i++)
+		argv[i] = "";
+
+	if (!tryParameters(argc, argv))
+		sendText(fd, "error: invalid parameters\n");
+	else {
+		if (checkpointFileName != NULL || resumeFlag || asyncOutput || perfStatsFileName != NULL ||
+		    outputCompression != OUTPUT_PLAIN || blockIndexFileName != NULL || paramOutFileName != NULL)
+			sendText(fd, "error: checkpoint, output, --param-out and --perf-stats options do not apply to --serve\n");
+		else {
+			// node, segment and genotype storage stays warm between requests
+			keepBuffersMode = 1;
+			runRequest(fd, binary, argc, argv);
+		}
+		free(events);
+		free(currentSize);
+		events = NULL;
+		currentSize = NULL;
+	}
+	free(argv);
+	free(line);
+}
+
+int serveRequests(const char *socketPath) {
+	struct sockaddr_un addr;
+	struct stat st;
+	struct sigaction stop;
+	int listenFd, fd, status = 1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Error: socket path %s is too long\n", socketPath);
+		return 1;
+	}
+	strcpy(addr.sun_path, socketPath);
+	// a socket left behind by an earlier server is replaced, anything else is not
+	if (stat(socketPath, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(socketPath);
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0 || bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listenFd, 64) != 0) {
+		fprintf(stderr, "Error: cannot listen on %s: %s\n", socketPath, strerror(errno));
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	// without SA_RESTART, so that a blocked accept() returns to see the flag
+	memset(&stop, 0, sizeof(stop));
+	stop.sa_handler = stopServing;
+	sigemptyset(&stop.sa_mask);
+	sigaction(SIGINT, &stop, NULL);
+	sigaction(SIGTERM, &stop, NULL);
+
+	seedSeedSource(((uint64_t) devrand() << 32) | devrand());
+	memset(&marginalTrees, 0, sizeof(marginalTrees));
+	beginRun();
+	fprintf(stderr, "discoal: serving on %s\n", socketPath);
+	while (!stopRequested) {
+		fd = accept(listenFd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			fprintf(stderr, "Error: accept on %s failed: %s\n", socketPath, strerror(errno));
+			break;
+		}
+		handleRequest(fd);
+		close(fd);
+	}
+	if (stopRequested)
+		status = 0;
+	close(listenFd);
+	unlink(socketPath);
+	releaseTrajectory();
+	return status;
+}
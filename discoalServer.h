@@ -0,0 +1,26 @@
+#ifndef __DISCOAL_SERVER_H__
+#define __DISCOAL_SERVER_H__
+
+// discoal --serve path: a long-lived simulator on a Unix domain socket.
+// A client connects, sends one request line and reads the reply until the
+// server closes the connection. The request is a command line without the
+// program name ("20 1000 1000 -t 10 -r 10"), optionally with --binary.
+//
+// The reply is the executable's output for that command line, header
+// included, or with --binary a stream of native-endian records:
+//
+//     "DISCOAL\1"  int64 seed1  int64 seed2
+//     'H'  int32 sampleSize  int32 segsites  float64 positions[segsites]
+//          int8 haplotypes[sampleSize][segsites]   (0, 1, -1 without ancestry)
+//     'T'  int32 numTrees, then per tree int32 sites  int32 length  char newick[length]
+//
+// with one 'H' record per replicate, or one 'T' record under -T. A rejected
+// request gets a single line starting with "error:" instead.
+//
+// Requests are served one at a time. Node, segment and genotype storage is
+// kept from one request to the next (as with --keep-buffers), and seeds of
+// requests without -d are drawn from a generator seeded at startup.
+
+int serveRequests(const char *socketPath);
+
+#endif
@@ -0,0 +1,289 @@
+// libdiscoal.c
+// the simulation behind a context handle, with results handed back in
+// buffers or through callbacks instead of printed
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ranlib.h"
+#include "discoal.h"
+#include "discoalFunctions.h"
+#include "discoalEngine.h"
+#include "marginalTrees.h"
+#include "outputWriter.h"
+#include "rngStream.h"
+#include "libdiscoal.h"
+
+struct DiscoalContext {
+	int argc;
+	char **argv;               // owned copies; getParameters keeps pointers into them
+	long completed;            // replicates handed out so far
+	long seededReplicate;
+	int replicateOpen;         // allNodes still holds the last replicate handed out
+	double *positions;         // NULL once discoalTakeGenotypes has taken them
+	char *haplotypes;
+	int segsites;              // of the open replicate; -1 when it has none to take
+	MarginalTrees marginalTrees;
+	char *treeText;            // the trees of the replicate, each NUL-terminated
+	size_t treeTextLen, treeTextCap;
+	int *treeSites;
+	size_t *treeOffsets;
+	const char **trees;
+	int numTrees, treesCapacity;
+};
+
+// getParameters reads an option's values without checking argc; blanks
+// after the last argument keep a truncated option from reading past the end
+#define ARGV_PADDING 16
+
+// the engine runs on process globals, so at most one context is open; the
+// lock is held from the check until the context is set up, so that two
+// threads creating contexts cannot both start writing the globals
+static pthread_mutex_t contextLock = PTHREAD_MUTEX_INITIALIZER;
+static DiscoalContext *openContext = NULL;
+static _Thread_local const char *lastError = "";
+
+static void *allocOrDie(void *p) {
+	if (p == NULL) {
+		fprintf(stderr, "Error: Failed to allocate simulation context\n");
+		exit(1);
+	}
+	return p;
+}
+
+static void freeContext(DiscoalContext *ctx) {
+	int i;
+
+	for (i = 0; i < ctx->argc; i++)
+		free(ctx->argv[i]);
+	free(ctx->argv);
+	free(ctx->positions);
+	free(ctx->treeText);
+	free(ctx->treeSites);
+	free(ctx->treeOffsets);
+	free(ctx->trees);
+	free(ctx);
+}
+
+DiscoalContext *discoalCreateFromArgs(int argc, const char **argv) {
+	DiscoalContext *ctx;
+	int i;
+
+	pthread_mutex_lock(&contextLock);
+	if (openContext != NULL) {
+		pthread_mutex_unlock(&contextLock);
+		lastError = "another context is open";
+		return NULL;
+	}
+	ctx = allocOrDie(calloc(1, sizeof(DiscoalContext)));
+	ctx->argc = argc + 1;
+	ctx->argv = allocOrDie(calloc(ctx->argc + ARGV_PADDING, sizeof(char *)));
+	ctx->argv[0] = allocOrDie(strdup("discoal"));
+	for (i = 0; i < argc; i++)
+		ctx->argv[i + 1] = allocOrDie(strdup(argv[i]));
+	for (i = ctx->argc; i < ctx->argc + ARGV_PADDING; i++)
+		ctx->argv[i] = "";
+	ctx->positions = allocOrDie(malloc(sizeof(double) * MAXMUTS));
+	ctx->seededReplicate = -1;
+
+	if (!tryParameters(ctx->argc, (const char **) ctx->argv)) {
+		pthread_mutex_unlock(&contextLock);
+		lastError = "invalid arguments";
+		freeContext(ctx);
+		return NULL;
+	}
+	setall(seed1, seed2);
+	beginRun();
+	openContext = ctx;
+	pthread_mutex_unlock(&contextLock);
+	return ctx;
+}
+
+DiscoalContext *discoalCreate(const DiscoalParams *params) {
+	char numbers[7][32];
+	const char **args;
+	int n = 0, i;
+	DiscoalContext *ctx;
+
+	args = allocOrDie(malloc(sizeof(char *) * (params->argc + 12)));
+	snprintf(numbers[0], sizeof(numbers[0]), "%d", params->sampleSize);
+	snprintf(numbers[1], sizeof(numbers[1]), "%d", params->replicates);
+	snprintf(numbers[2], sizeof(numbers[2]), "%d", params->sites);
+	snprintf(numbers[3], sizeof(numbers[3]), "%.17g", params->theta);
+	snprintf(numbers[4], sizeof(numbers[4]), "%.17g", params->rho);
+	snprintf(numbers[5], sizeof(numbers[5]), "%ld", params->seed1);
+	snprintf(numbers[6], sizeof(numbers[6]), "%ld", params->seed2);
+	args[n++] = numbers[0];
+	args[n++] = numbers[1];
+	args[n++] = numbers[2];
+	args[n++] = "-t";
+	args[n++] = numbers[3];
+	args[n++] = "-r";
+	args[n++] = numbers[4];
+	if (params->seed1 != 0 || params->seed2 != 0) {
+		args[n++] = "-d";
+		args[n++] = numbers[5];
+		args[n++] = numbers[6];
+	}
+	if (params->trees)
+		args[n++] = "-T";
+	for (i = 0; i < params->argc; i++)
+		args[n++] = params->argv[i];
+	ctx = discoalCreateFromArgs(n, args);
+	free(args);
+	return ctx;
+}
+
+void discoalSeeds(const DiscoalContext *ctx, long *s1, long *s2) {
+	(void) ctx;
+	*s1 = seed1;
+	*s2 = seed2;
+}
+
+// writeTrees() leaves each tree in the output buffer; it is moved to treeText
+static void keepTree(int sites, void *arg) {
+	DiscoalContext *ctx = arg;
+	const char *text;
+	size_t len;
+
+	text = outputTake(&len);
+	if (len > 0 && text[len - 1] == '\n')
+		len--;
+	if (ctx->treeTextLen + len + 1 > ctx->treeTextCap) {
+		ctx->treeTextCap = ctx->treeTextCap ? ctx->treeTextCap * 2 : 65536;
+		while (ctx->treeTextLen + len + 1 > ctx->treeTextCap)
+			ctx->treeTextCap *= 2;
+		ctx->treeText = allocOrDie(realloc(ctx->treeText, ctx->treeTextCap));
+	}
+	if (ctx->numTrees == ctx->treesCapacity) {
+		ctx->treesCapacity = ctx->treesCapacity ? ctx->treesCapacity * 2 : 64;
+		ctx->treeSites = allocOrDie(realloc(ctx->treeSites, sizeof(int) * ctx->treesCapacity));
+		ctx->treeOffsets = allocOrDie(realloc(ctx->treeOffsets, sizeof(size_t) * ctx->treesCapacity));
+		ctx->trees = allocOrDie(realloc(ctx->trees, sizeof(char *) * ctx->treesCapacity));
+	}
+	memcpy(ctx->treeText + ctx->treeTextLen, text, len);
+	ctx->treeText[ctx->treeTextLen + len] = '\0';
+	ctx->treeSites[ctx->numTrees] = sites;
+	ctx->treeOffsets[ctx->numTrees] = ctx->treeTextLen;
+	ctx->treeTextLen += len + 1;
+	ctx->numTrees++;
+}
+
+static void closeReplicate(DiscoalContext *ctx) {
+	if (!ctx->replicateOpen)
+		return;
+	releaseGenotypes(ctx->haplotypes);
+	ctx->haplotypes = NULL;
+	ctx->segsites = -1;
+	finishReplicate();
+	ctx->replicateOpen = 0;
+}
+
+static void fillReplicate(DiscoalContext *ctx, DiscoalReplicate *rep) {
+	int k;
+
+	memset(rep, 0, sizeof(DiscoalReplicate));
+	ctx->segsites = -1;
+	rep->index = ctx->completed;
+	rep->sampleSize = sampleSize;
+	// as in the executable, -C replicates are always haplotypes
+	if (treeOutputMode == 1 && condRecMode == 0) {
+		ctx->numTrees = 0;
+		ctx->treeTextLen = 0;
+		writeTrees(&ctx->marginalTrees, keepTree, ctx);
+		for (k = 0; k < ctx->numTrees; k++)
+			ctx->trees[k] = ctx->treeText + ctx->treeOffsets[k];
+		rep->numTrees = ctx->numTrees;
+		rep->treeSites = ctx->treeSites;
+		rep->trees = ctx->trees;
+		return;
+	}
+	if (ctx->positions == NULL)
+		ctx->positions = allocOrDie(malloc(sizeof(double) * MAXMUTS));
+	rep->segsites = ctx->segsites = replicateGenotypes(ctx->positions, &ctx->haplotypes);
+	rep->positions = ctx->positions;
+	rep->haplotypes = ctx->haplotypes;
+}
+
+// returns 1 with the next replicate in rep, 0 once all have been handed out
+int discoalNext(DiscoalContext *ctx, DiscoalReplicate *rep) {
+	closeReplicate(ctx);
+	while (ctx->completed < sampleNumber) {
+		if (replicateStreamMode && ctx->seededReplicate != ctx->completed) {
+			seedReplicateStream(seed1, seed2, replicateStart + ctx->completed);
+			ctx->seededReplicate = ctx->completed;
+		}
+		simulateReplicate(replicateStart + ctx->completed);
+		ctx->replicateOpen = 1;
+		if (condRecMode == 0 || condRecMet == 1) {
+			condRecMet = 0;
+			fillReplicate(ctx, rep);
+			ctx->completed++;
+			return 1;
+		}
+		closeReplicate(ctx);
+	}
+	return 0;
+}
+
+int discoalTakeGenotypes(DiscoalContext *ctx, double **positions, char **haplotypes) {
+	double *trimmed;
+
+	if (!ctx->replicateOpen || ctx->segsites < 0)
+		return 0;
+	trimmed = realloc(ctx->positions, sizeof(double) * (ctx->segsites > 0 ? ctx->segsites : 1));
+	*positions = trimmed != NULL ? trimmed : ctx->positions;
+	*haplotypes = takeGenotypes(ctx->haplotypes, (size_t) sampleSize * ctx->segsites);
+	ctx->positions = NULL;
+	ctx->haplotypes = NULL;
+	ctx->segsites = -1;
+	return 1;
+}
+
+void discoalAlleleCodes(DiscoalContext *ctx, char ancestral, char derived, char missing) {
+	(void) ctx;
+	alleleCodes[0] = ancestral;
+	alleleCodes[1] = derived;
+	alleleCodes[2] = missing;
+}
+
+// returns the number of replicates delivered
+long discoalRun(DiscoalContext *ctx, const DiscoalSink *sink) {
+	DiscoalReplicate rep;
+	long delivered = 0;
+	int i, stop;
+
+	while (discoalNext(ctx, &rep)) {
+		stop = 0;
+		if (sink->sites != NULL && rep.numTrees == 0)
+			stop |= sink->sites(sink->userData, rep.index, rep.segsites, rep.positions);
+		if (sink->haplotype != NULL && rep.numTrees == 0)
+			for (i = 0; i < rep.sampleSize; i++)
+				stop |= sink->haplotype(sink->userData, rep.index, i,
+				                        rep.haplotypes + haplotypeCell(i, 0, rep.segsites), rep.segsites);
+		if (sink->tree != NULL)
+			for (i = 0; i < rep.numTrees; i++)
+				stop |= sink->tree(sink->userData, rep.index, rep.treeSites[i], rep.trees[i]);
+		delivered++;
+		if (stop)
+			break;
+	}
+	return delivered;
+}
+
+void discoalFree(DiscoalContext *ctx) {
+	if (ctx == NULL)
+		return;
+	closeReplicate(ctx);
+	marginalTreesFree(&ctx->marginalTrees);
+	endRun();
+	freeContext(ctx);
+	pthread_mutex_lock(&contextLock);
+	openContext = NULL;
+	pthread_mutex_unlock(&contextLock);
+}
+
+const char *discoalError(void) {
+	return lastError;
+}
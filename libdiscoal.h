@@ -0,0 +1,75 @@
+#ifndef __LIBDISCOAL_H__
+#define __LIBDISCOAL_H__
+
+// libdiscoal: the discoal simulator as a library (make libdiscoal.a). A
+// simulation context is opened from a DiscoalParams, or from the arguments of
+// the command line without the program name:
+//
+//     const char *args[] = {"20", "100", "10000", "-t", "10", "-ws", "0.05", "-a", "500"};
+//     DiscoalContext *ctx = discoalCreateFromArgs(9, args);
+//
+// Its replicates are pulled one at a time with discoalNext(), whose
+// DiscoalReplicate points at buffers that stay valid until the next call, or
+// pushed through the callbacks of a DiscoalSink with discoalRun(). Nothing
+// is printed, and the replicates are the ones the executable writes for the
+// same arguments and seeds.
+//
+// The library is not reentrant: the engine keeps its state in process
+// globals, so one context is open at a time, and it is used from one thread.
+// discoalCreate() may be called from any thread; it returns NULL while
+// another context is open, or when the arguments are rejected (with the
+// executable's message on stderr). discoalError() tells the calling thread
+// which.
+
+typedef struct DiscoalContext DiscoalContext;
+
+typedef struct DiscoalParams {
+    int sampleSize;
+    int replicates;
+    int sites;
+    double theta;          // 4Nu over the locus
+    double rho;            // 4Nr over the locus
+    long seed1, seed2;     // both 0 for seeds from /dev/urandom
+    int trees;             // marginal trees (-T) instead of haplotypes
+    int argc;              // any further options, e.g. {"-ws", "0.05", "-a", "500"}
+    const char **argv;
+} DiscoalParams;
+
+typedef struct DiscoalReplicate {
+    long index;                // 0 for the first replicate of the run
+    int sampleSize;
+    int segsites;
+    const double *positions;   // segsites positions in [0, 1), ascending
+    const char *haplotypes;    // sampleSize rows of segsites '0', '1' or 'N';
+                               // row i starts at haplotypes + i * segsites
+    int numTrees;              // with trees, the marginal trees left to right
+    const int *treeSites;      // sites covered by each tree
+    const char *const *trees;  // Newick text of each tree
+} DiscoalReplicate;
+
+// Callbacks for discoalRun(); any of them may be NULL. A nonzero return ends
+// the run after the current replicate.
+typedef struct DiscoalSink {
+    void *userData;
+    int (*sites)(void *userData, long replicate, int segsites, const double *positions);
+    int (*haplotype)(void *userData, long replicate, int sample, const char *alleles, int segsites);
+    int (*tree)(void *userData, long replicate, int sites, const char *newick);
+} DiscoalSink;
+
+DiscoalContext *discoalCreate(const DiscoalParams *params);
+DiscoalContext *discoalCreateFromArgs(int argc, const char **argv);
+void discoalSeeds(const DiscoalContext *ctx, long *seed1, long *seed2);
+int discoalNext(DiscoalContext *ctx, DiscoalReplicate *rep);
+// Hands the positions and haplotypes of the replicate discoalNext() returned
+// to the caller, who frees them with free(); the context allocates new ones
+// for the next replicate. Returns 0 if there are none to take (trees, or
+// already taken). *haplotypes is NULL when the replicate has no segsites.
+int discoalTakeGenotypes(DiscoalContext *ctx, double **positions, char **haplotypes);
+// Bytes written for ancestral, derived and missing ('N') alleles in place of
+// '0', '1' and 'N', from the next replicate on
+void discoalAlleleCodes(DiscoalContext *ctx, char ancestral, char derived, char missing);
+long discoalRun(DiscoalContext *ctx, const DiscoalSink *sink);
+void discoalFree(DiscoalContext *ctx);
+const char *discoalError(void);
+
+#endif
@@ -0,0 +1,167 @@
+// marginalTrees.c
+// edge differences between consecutive marginal trees of the simulated graph
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "discoal.h"
+#include "discoalFunctions.h"
+#include "marginalTrees.h"
+
+static void addEdge(MarginalTrees *mt, int left, int right, int parent, int child) {
+	MarginalTreeEdge *last = mt->numEdges > 0 ? &mt->edges[mt->numEdges - 1] : NULL;
+
+	// neighbouring ancestry segments of the same edge are joined
+	if (last != NULL && last->parent == parent && last->child == child && last->right == left) {
+		last->right = right;
+		return;
+	}
+	if (mt->numEdges == mt->edgesCapacity) {
+		mt->edgesCapacity = mt->edgesCapacity ? mt->edgesCapacity * 2 : 1024;
+		mt->edges = realloc(mt->edges, sizeof(MarginalTreeEdge) * mt->edgesCapacity);
+		if (mt->edges == NULL) {
+			fprintf(stderr, "Error: Failed to allocate marginal tree edges (%d)\n", mt->edgesCapacity);
+			exit(1);
+		}
+	}
+	mt->edges[mt->numEdges].left = left;
+	mt->edges[mt->numEdges].right = right;
+	mt->edges[mt->numEdges].parent = parent;
+	mt->edges[mt->numEdges].child = child;
+	mt->numEdges++;
+}
+
+// the sites where child has material below parent, from one pass over both
+// segment lists
+static void addEdgesBelow(MarginalTrees *mt, rootedNode *parent, rootedNode *child) {
+	AncestrySegment *p = parent->ancestryRoot, *c = child->ancestryRoot;
+	int lo, hi;
+
+	while (p != NULL && c != NULL) {
+		lo = MAX(p->start, c->start);
+		hi = MIN(p->end, c->end);
+		if (lo < hi && p->count > 0 && c->count > 0 && c->count < sampleSize)
+			addEdge(mt, lo, hi, parent->id, child->id);
+		if (p->end <= c->end) p = p->next;
+		else c = c->next;
+	}
+}
+
+// reserveSortScratch-- room to sort n edges: two key arrays, an index array
+// and a copy of the edges
+static void reserveSortScratch(MarginalTrees *mt, int n) {
+	if (n <= mt->sortCapacity)
+		return;
+	mt->sortCapacity = mt->edgesCapacity;
+	mt->sortKeys = realloc(mt->sortKeys, sizeof(uint64_t) * 2 * mt->sortCapacity);
+	mt->sortIndex = realloc(mt->sortIndex, sizeof(int) * 2 * mt->sortCapacity);
+	mt->sortEdges = realloc(mt->sortEdges, sizeof(MarginalTreeEdge) * mt->sortCapacity);
+	if (mt->sortKeys == NULL || mt->sortIndex == NULL || mt->sortEdges == NULL) {
+		fprintf(stderr, "Error: Failed to allocate marginal trees\n");
+		exit(1);
+	}
+}
+
+void marginalTreesInit(MarginalTrees *mt) {
+	int i;
+
+	mt->numNodes = totNodeNumber;
+	mt->numEdges = 0;
+	// a node's id is its index in allNodes, so the link columns give the edges
+	for (i = 0; i < totNodeNumber; i++) {
+		if (nodeLeftParent[i] != NO_NODE)
+			addEdgesBelow(mt, nodeAt(nodeLeftParent[i]), allNodes[i]);
+		if (nodeRightParent[i] != NO_NODE && nodeRightParent[i] != nodeLeftParent[i])
+			addEdgesBelow(mt, nodeAt(nodeRightParent[i]), allNodes[i]);
+	}
+	// insertion order: by left, then by parent; allNodes is in order of
+	// creation, so a lower index is a younger parent
+	reserveSortScratch(mt, mt->numEdges);
+	for (i = 0; i < mt->numEdges; i++) {
+		mt->sortKeys[i] = (uint64_t) mt->edges[i].left << 32 | (uint32_t) mt->edges[i].parent;
+		mt->sortIndex[i] = i;
+	}
+	sortKeyed(mt->sortKeys, mt->sortIndex, mt->sortKeys + mt->numEdges, mt->sortIndex + mt->numEdges, mt->numEdges);
+	for (i = 0; i < mt->numEdges; i++)
+		mt->sortEdges[i] = mt->edges[mt->sortIndex[i]];
+	memcpy(mt->edges, mt->sortEdges, sizeof(MarginalTreeEdge) * mt->numEdges);
+
+	if (mt->numNodes + 1 > mt->nodesCapacity) {
+		// doubled so that replicates of drifting size stop reallocating
+		mt->nodesCapacity = MAX(mt->numNodes + 1, 2 * mt->nodesCapacity);
+		mt->parent = realloc(mt->parent, sizeof(int) * mt->nodesCapacity);
+	}
+	if (mt->numEdges + 1 > mt->removalCapacity) {
+		mt->removalCapacity = mt->edgesCapacity + 1;
+		mt->removalOrder = realloc(mt->removalOrder, sizeof(int) * mt->removalCapacity);
+	}
+	if (mt->parent == NULL || mt->removalOrder == NULL) {
+		fprintf(stderr, "Error: Failed to allocate marginal trees\n");
+		exit(1);
+	}
+	for (i = 0; i < mt->numNodes; i++)
+		mt->parent[i] = -1;
+	// removal order: by right, then by parent, older first
+	for (i = 0; i < mt->numEdges; i++) {
+		mt->sortKeys[i] = (uint64_t) mt->edges[i].right << 32 | (uint32_t) (INT32_MAX - mt->edges[i].parent);
+		mt->removalOrder[i] = i;
+	}
+	sortKeyed(mt->sortKeys, mt->removalOrder, mt->sortKeys + mt->numEdges, mt->sortIndex, mt->numEdges);
+
+	mt->left = mt->right = 0;
+	mt->edgesOutStart = mt->edgesOutEnd = 0;
+	mt->edgesInStart = mt->edgesInEnd = 0;
+}
+
+// moves to the tree starting where the current one ends; returns 0 past the
+// last site
+int marginalTreesNext(MarginalTrees *mt) {
+	int x = mt->right, j, k;
+
+	if (x >= nSites)
+		return 0;
+	for (k = mt->edgesOutEnd; k < mt->numEdges && mt->edges[mt->removalOrder[k]].right == x; k++)
+		mt->parent[mt->edges[mt->removalOrder[k]].child] = -1;
+	for (j = mt->edgesInEnd; j < mt->numEdges && mt->edges[j].left == x; j++)
+		mt->parent[mt->edges[j].child] = mt->edges[j].parent;
+	mt->edgesOutStart = mt->edgesOutEnd;
+	mt->edgesOutEnd = k;
+	mt->edgesInStart = mt->edgesInEnd;
+	mt->edgesInEnd = j;
+
+	mt->left = x;
+	mt->right = nSites;
+	if (j < mt->numEdges)
+		mt->right = MIN(mt->right, mt->edges[j].left);
+	if (k < mt->numEdges)
+		mt->right = MIN(mt->right, mt->edges[mt->removalOrder[k]].right);
+	return 1;
+}
+
+// moves forward to the tree holding site
+void marginalTreesSeek(MarginalTrees *mt, int site) {
+	while (mt->right <= site && marginalTreesNext(mt))
+		;
+}
+
+// every sample is below the root, so it is found by climbing from sample 0
+int marginalTreeRoot(const MarginalTrees *mt) {
+	int n = 0;
+
+	while (mt->parent[n] >= 0)
+		n = mt->parent[n];
+	return n;
+}
+
+void marginalTreesFree(MarginalTrees *mt) {
+	free(mt->edges);
+	free(mt->parent);
+	free(mt->removalOrder);
+	free(mt->sortKeys);
+	free(mt->sortIndex);
+	free(mt->sortEdges);
+	mt->edges = mt->sortEdges = NULL;
+	mt->parent = mt->removalOrder = mt->sortIndex = NULL;
+	mt->sortKeys = NULL;
+	mt->numEdges = mt->edgesCapacity = mt->nodesCapacity = mt->removalCapacity = mt->sortCapacity = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef __MARGINAL_TREES_H__
+#define __MARGINAL_TREES_H__
+
+#include <stdint.h>
+
+// Left-to-right iteration over the marginal trees of the graph in allNodes.
+// The graph is flattened into edges: a child hangs below one of its parents
+// over the sites [left, right) where both carry ancestral material and the
+// child is not yet the MRCA of the sample. Stepping to the next tree removes
+// the edges that end there and inserts the ones that start, so a consumer
+// sees each change once. parent[] always holds the current tree; the edges
+// changed by the last step are removalOrder[edgesOutStart..edgesOutEnd) and
+// edges[edgesInStart..edgesInEnd), for consumers that work on differences
+// (tree sequences, incremental statistics). The struct is zeroed before its
+// first marginalTreesInit(); after that init may be called again for the
+// next replicate and reuses the buffers.
+
+typedef struct MarginalTreeEdge {
+    int left, right;    // sites [left, right)
+    int parent, child;  // allNodes indices
+} MarginalTreeEdge;
+
+typedef struct MarginalTrees {
+    int numNodes;
+    int *parent;               // parent of each node in the current tree, -1 if none
+    int left, right;           // sites covered by the current tree
+    MarginalTreeEdge *edges;   // sorted by left, then by parent age
+    int *removalOrder;         // edge indices sorted by right, then by parent age
+    int numEdges, edgesCapacity, nodesCapacity, removalCapacity;
+    uint64_t *sortKeys;        // scratch for sorting the edges
+    int *sortIndex;
+    MarginalTreeEdge *sortEdges;
+    int sortCapacity;
+    int edgesOutStart, edgesOutEnd;
+    int edgesInStart, edgesInEnd;
+} MarginalTrees;
+
+void marginalTreesInit(MarginalTrees *mt);
+int marginalTreesNext(MarginalTrees *mt);
+void marginalTreesSeek(MarginalTrees *mt, int site);
+int marginalTreeRoot(const MarginalTrees *mt);
+void marginalTreesFree(MarginalTrees *mt);
+
+#endif
@@ -0,0 +1,104 @@
+"""Merge the outputs of discoal runs split with --shard k/N or --replicates start:count.
+
+usage: python mergeShards.py shard0.out shard1.out ... > merged.out
+
+Shards may be given in any order. They are checked to come from the same
+command line and seeds and to cover every replicate exactly once. The merged
+file is written under a single header naming "--shard 0/1", and it is
+identical to the output of that serial run. Shards written with -z gzip are
+decompressed and the merged file is plain text; so are shards written with
+-z zstd if the zstandard module is installed.
+"""
+import gzip
+import io
+import sys
+
+GZIP_MAGIC = b"\x1f\x8b"
+ZSTD_MAGIC = b"\x28\xb5\x2f\xfd"
+
+# options that may differ between shards and are dropped from the header
+PER_RUN_OPTIONS = {"--checkpoint": 1, "--checkpoint-every": 1, "--resume": 0, "--perf-stats": 1, "--async-io": 0,
+                   "-z": 1, "--z-block": 1, "--z-threads": 1, "--z-index": 1, "--param-out": 1,
+                   "--keep-buffers": 0, "--replay-trajectory": 0}
+
+# options dropped only with the value that leaves the replicates as they are:
+# --traj-threads K for K above 1 draws other trajectories, so shards must
+# agree on it and the merged header keeps it
+NEUTRAL_VALUES = {"--traj-threads": "1"}
+
+
+def readShard(fileName):
+    with open(fileName, "rb") as f:
+        data = f.read()
+    if data[:2] == GZIP_MAGIC:
+        data = gzip.decompress(data)
+    elif data[:4] == ZSTD_MAGIC:
+        try:
+            import zstandard
+        except ImportError:
+            sys.exit("Error: %s is zstd compressed; zstd shards are not supported without the zstandard module "
+                     "(pip install zstandard, or decompress it with zstd -d first)" % fileName)
+        # -z zstd writes one frame per block
+        reader = zstandard.ZstdDecompressor().stream_reader(io.BytesIO(data), read_across_frames=True)
+        data = reader.read()
+    first = data.index(b"\n")
+    second = data.index(b"\n", first + 1)
+    tokens = data[:first].decode().split(" ")
+    seeds = data[first + 1:second].decode()
+    body = data[second + 1:]
+
+    kept = []
+    start = count = None
+    i = 1
+    while i < len(tokens):
+        tok = tokens[i]
+        if tok in PER_RUN_OPTIONS:
+            i += 1 + PER_RUN_OPTIONS[tok]
+            continue
+        if tok in NEUTRAL_VALUES and i + 1 < len(tokens) and tokens[i + 1] == NEUTRAL_VALUES[tok]:
+            i += 2
+            continue
+        if tok in ("--shard", "--replicates"):
+            value = tokens[i + 1]
+            totalReps = int(tokens[2])
+            if tok == "--shard":
+                k, n = (int(x) for x in value.split("/"))
+                start = k * totalReps // n
+                count = (k + 1) * totalReps // n - start
+            else:
+                start, count = (int(x) for x in value.split(":"))
+            kept += ["--shard", "0/1"]
+            i += 2
+            continue
+        kept.append(tok)
+        i += 1
+    if start is None:
+        sys.exit("Error: %s was not run with --shard or --replicates" % fileName)
+    return {"name": fileName, "argv0": tokens[0], "args": kept, "seeds": seeds,
+            "start": start, "count": count, "total": int(tokens[2]), "body": body}
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    shards = sorted((readShard(f) for f in sys.argv[1:]), key=lambda s: s["start"])
+
+    ref = shards[0]
+    nextRep = 0
+    for s in shards:
+        if s["args"] != ref["args"] or s["seeds"] != ref["seeds"]:
+            sys.exit("Error: %s was run with different parameters or seeds than %s" % (s["name"], ref["name"]))
+        if s["start"] != nextRep:
+            sys.exit("Error: replicates %d to %d are missing or duplicated (at %s)" % (nextRep, s["start"] - 1, s["name"]))
+        nextRep = s["start"] + s["count"]
+    if nextRep != ref["total"]:
+        sys.exit("Error: replicates %d to %d are missing" % (nextRep, ref["total"] - 1))
+
+    out = sys.stdout.buffer
+    out.write((" ".join([ref["argv0"]] + ref["args"]) + "\n" + ref["seeds"] + "\n").encode())
+    for s in shards:
+        out.write(s["body"])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,584 @@
+// outputWriter.c
+// buffered, optionally asynchronous and compressed, output of simulation results
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef DISCOAL_ZSTD
+#include <zstd.h>
+#endif
+#include "outputWriter.h"
+
+#define GZIP_LEVEL 6
+#define ZSTD_LEVEL 3
+
+// outputFixed() formats x * 10^digits below 2^40 itself, where the product
+// is within 2^-13 of exact; closer than FIXED_HALF_MARGIN to a rounding
+// halfway point it lets snprintf() decide
+#define FIXED_MAX_DIGITS 15
+#define FIXED_SCALED_LIMIT 1099511627776.0
+#define FIXED_HALF_MARGIN 1e-3
+
+// a compressed block moves from raw to busy (taken by a compressor thread)
+// to ready; uncompressed blocks are ready as soon as they are queued
+enum { BLOCK_RAW, BLOCK_BUSY, BLOCK_READY };
+
+typedef struct {
+	char *data;
+	size_t len, cap;
+	char *packed;
+	size_t packedLen, packedCap;
+	int state;
+	long firstReplicate, replicates;
+} OutputBuffer;
+
+static OutputBuffer syncBuffer;
+static OutputBuffer *current = &syncBuffer;
+
+// async state: submitted buffers wait in a ring until the writer takes them,
+// written buffers go back to the free list for reuse
+static int asyncMode = 0;
+static int abandoned = 0;
+static pthread_t writerThread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t notFull = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;
+static OutputBuffer **queue, **freeList;
+static int queueCap, queueHead, queueCount, freeCount;
+static int writing = 0, closing = 0, writeErrno = 0, writeErrorReported = 0;
+
+// compression state: blocks of blockReplicates replicates are compressed by
+// compressThreads threads; the index is written by the writer thread only
+static int compressMethod = OUTPUT_PLAIN;
+static int blockReplicates = 1, compressThreads = 1;
+static pthread_t *compressorThreads;
+static size_t unitStart = 0;
+static long nextReplicate = 0, outputOffset = 0;
+static FILE *indexFile = NULL;
+
+static void growBuffer(OutputBuffer *buf, size_t needed) {
+	size_t newCap = buf->cap ? buf->cap : 65536;
+	char *newData;
+
+	while (newCap < needed) newCap *= 2;
+	newData = realloc(buf->data, newCap);
+	if (newData == NULL) {
+		fprintf(stderr, "Error: Failed to allocate output buffer\n");
+		exit(1);
+	}
+	buf->data = newData;
+	buf->cap = newCap;
+}
+
+static int writeAll(int fd, const char *data, size_t len) {
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return errno;
+		}
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void *writerMain(void *arg) {
+	OutputBuffer *buf;
+	const char *data;
+	size_t len;
+	int err, failed;
+
+	(void) arg;
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		// blocks are written in submission order, so wait for the oldest
+		while ((queueCount == 0 || queue[queueHead]->state != BLOCK_READY) &&
+		       !(closing && queueCount == 0))
+			pthread_cond_wait(&notEmpty, &lock);
+		if (queueCount == 0) break;
+		buf = queue[queueHead];
+		queueHead = (queueHead + 1) % queueCap;
+		queueCount--;
+		writing = 1;
+		failed = writeErrno;
+		pthread_cond_signal(&notFull);
+		pthread_mutex_unlock(&lock);
+
+		data = compressMethod ? buf->packed : buf->data;
+		len = compressMethod ? buf->packedLen : buf->len;
+		// after a failed write later buffers are dropped, not half-written
+		err = failed ? 0 : writeAll(STDOUT_FILENO, data, len);
+		if (!failed && !err && indexFile != NULL && buf->len > 0) {
+			fprintf(indexFile, "%ld %ld %ld %zu %zu\n", buf->firstReplicate,
+				buf->replicates, outputOffset, len, buf->len);
+			if (fflush(indexFile) != 0) err = errno;
+		}
+		outputOffset += len;
+
+		pthread_mutex_lock(&lock);
+		if (err) writeErrno = err;
+		buf->len = 0;
+		buf->replicates = 0;
+		freeList[freeCount++] = buf;
+		writing = 0;
+		pthread_cond_broadcast(&idle);
+		pthread_cond_signal(&notFull);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+static size_t compressBlock(OutputBuffer *buf, void *ctx) {
+	size_t bound;
+
+	if (buf->len == 0) return 0;
+#ifdef DISCOAL_ZSTD
+	if (compressMethod == OUTPUT_ZSTD) {
+		bound = ZSTD_compressBound(buf->len);
+	}
+	else
+#endif
+	{
+		// reset first: a finished stream makes deflateBound leave out the
+		// gzip header
+		deflateReset((z_stream *) ctx);
+		bound = deflateBound((z_stream *) ctx, buf->len);
+	}
+	if (buf->packedCap < bound) {
+		free(buf->packed);
+		buf->packed = malloc(bound);
+		buf->packedCap = buf->packed ? bound : 0;
+		if (buf->packed == NULL) return (size_t) -1;
+	}
+#ifdef DISCOAL_ZSTD
+	if (compressMethod == OUTPUT_ZSTD) {
+		bound = ZSTD_compressCCtx((ZSTD_CCtx *) ctx, buf->packed, buf->packedCap,
+					  buf->data, buf->len, ZSTD_LEVEL);
+		return ZSTD_isError(bound) ? (size_t) -1 : bound;
+	}
+#endif
+	{
+		z_stream *zs = (z_stream *) ctx;
+
+		zs->next_in = (Bytef *) buf->data;
+		zs->avail_in = buf->len;
+		zs->next_out = (Bytef *) buf->packed;
+		zs->avail_out = buf->packedCap;
+		if (deflate(zs, Z_FINISH) != Z_STREAM_END) return (size_t) -1;
+		return zs->total_out;
+	}
+}
+
+// each compressor takes the oldest raw block, so blocks finish roughly in
+// the order the writer needs them
+static void *compressorMain(void *arg) {
+	OutputBuffer *buf;
+	z_stream zs;
+	void *ctx = &zs;
+	size_t packedLen;
+	int k;
+
+	(void) arg;
+	memset(&zs, 0, sizeof(zs));
+#ifdef DISCOAL_ZSTD
+	if (compressMethod == OUTPUT_ZSTD)
+		ctx = ZSTD_createCCtx();
+	else
+#endif
+	// windowBits 15 + 16 asks zlib for a gzip wrapper
+	deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		buf = NULL;
+		for (k = 0; k < queueCount; k++) {
+			if (queue[(queueHead + k) % queueCap]->state == BLOCK_RAW) {
+				buf = queue[(queueHead + k) % queueCap];
+				break;
+			}
+		}
+		if (buf == NULL) {
+			if (closing) break;
+			pthread_cond_wait(&notEmpty, &lock);
+			continue;
+		}
+		buf->state = BLOCK_BUSY;
+		pthread_mutex_unlock(&lock);
+
+		packedLen = compressBlock(buf, ctx);
+
+		pthread_mutex_lock(&lock);
+		if (packedLen == (size_t) -1) {
+			if (!writeErrno) writeErrno = ENOMEM;
+			packedLen = 0;
+		}
+		buf->packedLen = packedLen;
+		buf->state = BLOCK_READY;
+		pthread_cond_broadcast(&notEmpty);
+	}
+	pthread_mutex_unlock(&lock);
+
+#ifdef DISCOAL_ZSTD
+	if (compressMethod == OUTPUT_ZSTD)
+		ZSTD_freeCCtx((ZSTD_CCtx *) ctx);
+	else
+#endif
+	deflateEnd(&zs);
+	return NULL;
+}
+
+// prints a failed write once; writeErrno stays set so that later buffers
+// are still dropped, and the atexit outputClose() does not repeat it
+static void reportWriteError(int err) {
+	if (!writeErrorReported)
+		fprintf(stderr, "Error: writing output failed: %s\n", strerror(err));
+	writeErrorReported = 1;
+}
+
+static void checkWriteError(void) {
+	if (writeErrno) {
+		reportWriteError(writeErrno);
+		exit(1);
+	}
+}
+
+static void outputAtExit(void) {
+	outputClose();
+}
+
+// threads <= 0 uses one compressor per online CPU
+void outputSetCompression(int method, int replicatesPerBlock, int threads) {
+	compressMethod = method;
+	blockReplicates = replicatesPerBlock > 0 ? replicatesPerBlock : 1;
+	if (threads <= 0) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	compressThreads = threads > 0 ? threads : 1;
+}
+
+// index lines are "firstReplicate replicates offset compressedBytes bytes",
+// one per block. When resuming from an output offset, the entries for blocks
+// past it are dropped. Returns 1 on success, 0 after reporting an error
+int outputOpenIndex(const char *fileName, long resumeOffset) {
+	char *line = NULL;
+	size_t cap = 0;
+	long first, count, offset, keepPos = 0;
+	size_t packedLen, len;
+	int ok = 1;
+
+	outputOffset = resumeOffset;
+	nextReplicate = 0;
+	if (resumeOffset <= 0) {
+		indexFile = fopen(fileName, "w");
+		if (indexFile == NULL) {
+			perror("Failed to open block index");
+			return 0;
+		}
+		fprintf(indexFile, "# firstReplicate replicates offset compressedBytes bytes\n");
+		return 1;
+	}
+
+	indexFile = fopen(fileName, "r+");
+	if (indexFile == NULL) {
+		perror("Failed to open block index");
+		return 0;
+	}
+	offset = 0;
+	while (getline(&line, &cap, indexFile) > 0) {
+		if (line[0] != '#') {
+			if (sscanf(line, "%ld %ld %ld %zu %zu", &first, &count, &offset, &packedLen, &len) != 5)
+				break;
+			if (offset + (long) packedLen > resumeOffset) break;
+			offset += packedLen;
+			nextReplicate = first + count;
+		}
+		keepPos = ftell(indexFile);
+	}
+	free(line);
+	// the checkpoint drained the output, so a block ends exactly there
+	if (offset != resumeOffset) {
+		fprintf(stderr, "Error: block index %s does not match the output\n", fileName);
+		ok = 0;
+	}
+	else if (ftruncate(fileno(indexFile), keepPos) != 0 || fseek(indexFile, keepPos, SEEK_SET) != 0) {
+		perror("Failed to rewind block index");
+		ok = 0;
+	}
+	return ok;
+}
+
+void outputInit(int async, int queueDepth) {
+	int i;
+
+	if (!async && compressMethod == OUTPUT_PLAIN) return;
+	queueCap = queueDepth > 0 ? queueDepth : OUTPUT_DEFAULT_QUEUE_DEPTH;
+	// keep every compressor busy while the writer waits on the oldest block
+	if (compressMethod != OUTPUT_PLAIN && queueCap < 2 * compressThreads)
+		queueCap = 2 * compressThreads;
+	queue = malloc(sizeof(OutputBuffer *) * queueCap);
+	// one buffer being filled, queueCap waiting and one being written
+	freeList = malloc(sizeof(OutputBuffer *) * (queueCap + 2));
+	if (queue == NULL || freeList == NULL) {
+		fprintf(stderr, "Error: Failed to allocate output queue\n");
+		exit(1);
+	}
+	for (i = 0; i < queueCap + 1; i++) {
+		freeList[i] = calloc(1, sizeof(OutputBuffer));
+		if (freeList[i] == NULL) {
+			fprintf(stderr, "Error: Failed to allocate output queue\n");
+			exit(1);
+		}
+	}
+	freeCount = queueCap + 1;
+	queueHead = queueCount = 0;
+
+	// anything already formatted goes out before the writer starts
+	fflush(stdout);
+	current = &syncBuffer;
+	if (current->len > 0) {
+		writeAll(STDOUT_FILENO, current->data, current->len);
+		current->len = 0;
+	}
+	current = calloc(1, sizeof(OutputBuffer));
+	if (current == NULL || pthread_create(&writerThread, NULL, writerMain, NULL) != 0) {
+		fprintf(stderr, "Error: Failed to start output writer thread\n");
+		exit(1);
+	}
+	if (compressMethod != OUTPUT_PLAIN) {
+		compressorThreads = malloc(sizeof(pthread_t) * compressThreads);
+		for (i = 0; i < compressThreads; i++) {
+			if (compressorThreads == NULL ||
+			    pthread_create(&compressorThreads[i], NULL, compressorMain, NULL) != 0) {
+				fprintf(stderr, "Error: Failed to start compression threads\n");
+				exit(1);
+			}
+		}
+	}
+	asyncMode = 1;
+	// error exits still deliver what was submitted, as stdio would
+	atexit(outputAtExit);
+}
+
+void outputPrintf(const char *fmt, ...) {
+	va_list ap;
+	size_t room = current->cap - current->len;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(current->data ? current->data + current->len : NULL, room, fmt, ap);
+	va_end(ap);
+	if ((size_t) n >= room) {
+		growBuffer(current, current->len + n + 1);
+		va_start(ap, fmt);
+		vsnprintf(current->data + current->len, n + 1, fmt, ap);
+		va_end(ap);
+	}
+	current->len += n;
+}
+
+void outputWrite(const char *data, size_t len) {
+	if (current->len + len > current->cap)
+		growBuffer(current, current->len + len);
+	memcpy(current->data + current->len, data, len);
+	current->len += len;
+}
+
+void outputPutc(char c) {
+	if (current->len + 1 > current->cap)
+		growBuffer(current, current->len + 1);
+	current->data[current->len++] = c;
+}
+
+// writes the decimal digits of n backwards from end, returns the first
+static char *formatDigits(char *end, uint64_t n) {
+	do {
+		*--end = '0' + n % 10;
+		n /= 10;
+	} while (n > 0);
+	return end;
+}
+
+void outputInt(long v) {
+	char text[24], *end = text + sizeof(text), *p;
+	uint64_t n = v < 0 ? -(uint64_t) v : (uint64_t) v;
+
+	p = formatDigits(end, n);
+	if (v < 0)
+		*--p = '-';
+	outputWrite(p, end - p);
+}
+
+void outputFixed(double x, int digits) {
+	static const double scale[FIXED_MAX_DIGITS + 1] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+	                                                    1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+	char text[48], *end = text + sizeof(text), *p;
+	double scaled, whole, frac;
+	uint64_t n, unit;
+	int i;
+
+	if (digits < 0 || digits > FIXED_MAX_DIGITS || !(x >= 0.0) || signbit(x))
+		goto slow;
+	scaled = x * scale[digits];
+	if (!(scaled < FIXED_SCALED_LIMIT))
+		goto slow;
+	whole = floor(scaled);
+	frac = scaled - whole;
+	if (fabs(frac - 0.5) < FIXED_HALF_MARGIN)
+		goto slow;
+	n = (uint64_t) whole + (frac > 0.5);
+	unit = (uint64_t) scale[digits];
+
+	p = end;
+	if (digits > 0) {
+		uint64_t f = n % unit;
+		for (i = 0; i < digits; i++) {
+			*--p = '0' + f % 10;
+			f /= 10;
+		}
+		*--p = '.';
+	}
+	p = formatDigits(p, n / unit);
+	outputWrite(p, end - p);
+	return;
+
+slow:
+	outputPrintf("%.*f", digits, x);
+}
+
+// called with the lock held
+static void queueBuffer(OutputBuffer *buf) {
+	while (queueCount == queueCap)
+		pthread_cond_wait(&notFull, &lock);
+	buf->state = compressMethod ? BLOCK_RAW : BLOCK_READY;
+	buf->firstReplicate = nextReplicate;
+	nextReplicate += buf->replicates;
+	queue[(queueHead + queueCount) % queueCap] = buf;
+	queueCount++;
+	pthread_cond_broadcast(&notEmpty);
+}
+
+static void queueCurrent(void) {
+	pthread_mutex_lock(&lock);
+	queueBuffer(current);
+	while (freeCount == 0)
+		pthread_cond_wait(&notFull, &lock);
+	current = freeList[--freeCount];
+	pthread_mutex_unlock(&lock);
+	unitStart = 0;
+	checkWriteError();
+}
+
+// hands the text formatted since the last submit to the caller instead of
+// stdout, NUL-terminated; it stays valid until the next output call. Only
+// without outputInit(), where nothing else holds the buffer
+const char *outputTake(size_t *len) {
+	if (current->len + 1 > current->cap)
+		growBuffer(current, current->len + 1);
+	current->data[current->len] = '\0';
+	*len = current->len;
+	current->len = 0;
+	return current->data;
+}
+
+// marks the end of one replicate's output; a compressed block is queued once
+// it holds blockReplicates replicates that produced output
+void outputSubmit(void) {
+	if (compressMethod != OUTPUT_PLAIN) {
+		if (current->len > unitStart) current->replicates++;
+		unitStart = current->len;
+		if (current->replicates >= blockReplicates) queueCurrent();
+		return;
+	}
+	outputEndBlock();
+}
+
+// hands over everything formatted so far, whole replicate or not
+void outputEndBlock(void) {
+	if (!asyncMode) {
+		if (current->len > 0)
+			fwrite(current->data, 1, current->len, stdout);
+		current->len = 0;
+		return;
+	}
+	if (compressMethod != OUTPUT_PLAIN && current->len == 0) return;
+	queueCurrent();
+}
+
+// after this returns everything submitted so far has reached the stdout fd
+void outputDrain(void) {
+	if (!asyncMode) {
+		fflush(stdout);
+		return;
+	}
+	if (compressMethod != OUTPUT_PLAIN) outputEndBlock();
+	pthread_mutex_lock(&lock);
+	while (queueCount > 0 || writing)
+		pthread_cond_wait(&idle, &lock);
+	pthread_mutex_unlock(&lock);
+	checkWriteError();
+}
+
+// returns 0, or -1 after reporting a failed write
+int outputClose(void) {
+	int i;
+
+	if (abandoned) return 0;
+	if (!asyncMode) {
+		outputSubmit();
+		// an earlier fwrite may have failed with nothing left for fflush
+		errno = 0;
+		if (fflush(stdout) != 0 || ferror(stdout)) {
+			reportWriteError(errno ? errno : EIO);
+			return -1;
+		}
+		return 0;
+	}
+	pthread_mutex_lock(&lock);
+	queueBuffer(current);
+	current = NULL;
+	closing = 1;
+	pthread_cond_broadcast(&notEmpty);
+	pthread_mutex_unlock(&lock);
+	pthread_join(writerThread, NULL);
+	if (compressMethod != OUTPUT_PLAIN) {
+		for (i = 0; i < compressThreads; i++)
+			pthread_join(compressorThreads[i], NULL);
+		free(compressorThreads);
+	}
+	asyncMode = 0;
+	closing = 0;
+
+	for (i = 0; i < freeCount; i++) {
+		free(freeList[i]->data);
+		free(freeList[i]->packed);
+		free(freeList[i]);
+	}
+	free(queue);
+	free(freeList);
+	current = &syncBuffer;
+	if (indexFile != NULL) {
+		fclose(indexFile);
+		indexFile = NULL;
+	}
+	compressMethod = OUTPUT_PLAIN;
+	unitStart = 0;
+	if (writeErrno) {
+		reportWriteError(writeErrno);
+		return -1;
+	}
+	return 0;
+}
+
+// for exits from a signal handler, where the lock may be held
+void outputAbandon(void) {
+	abandoned = 1;
+}
@@ -0,0 +1,44 @@
+#ifndef __OUTPUT_WRITER_H__
+#define __OUTPUT_WRITER_H__
+
+#include <stddef.h>
+
+// Output stage for simulation results. Text for stdout is formatted into an
+// in-memory buffer and handed over in one piece with outputSubmit(), once per
+// replicate. By default the buffer is written to stdout right away; after
+// outputInit(1, depth) a writer thread takes submitted buffers from a bounded
+// queue so the next replicate is simulated while the last one is written.
+//
+// outputSetCompression() before outputInit() turns on compressed output: the
+// stream becomes a series of independent gzip members or zstd frames, each
+// holding whole replicates, compressed in parallel by a pool of threads and
+// written in order. An optional index lists where each block starts.
+//
+// Embedders that want the text rather than stdout take it with outputTake().
+//
+// outputInt() and outputFixed() are the formatters for the per-site and
+// per-node numbers: they write what printf's "%ld" and "%.*f" would, without
+// going through stdio's format parsing and locale handling.
+
+#define OUTPUT_DEFAULT_QUEUE_DEPTH 8
+
+#define OUTPUT_PLAIN 0
+#define OUTPUT_GZIP 1
+#define OUTPUT_ZSTD 2
+
+void outputSetCompression(int method, int blockReplicates, int threads);
+int outputOpenIndex(const char *fileName, long resumeOffset);
+void outputInit(int async, int queueDepth);
+void outputPrintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void outputWrite(const char *data, size_t len);
+void outputPutc(char c);
+void outputInt(long v);
+void outputFixed(double x, int digits);
+const char *outputTake(size_t *len);
+void outputSubmit(void);
+void outputEndBlock(void);
+void outputDrain(void);
+int outputClose(void);
+void outputAbandon(void);
+
+#endif
@@ -0,0 +1,247 @@
+// paramTable.c
+// per-replicate parameter values from a file, and a record of the values
+// each replicate was simulated with
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "discoal.h"
+#include "paramTable.h"
+
+enum { COL_THETA, COL_RHO, COL_ALPHA, COL_TAU, COL_X, COL_F0, COL_UA, COL_C,
+       COL_E1TIME, COL_E1SIZE, COL_E2TIME, COL_E2SIZE, COLUMN_KINDS };
+
+static const char *columnNames[COLUMN_KINDS] = {
+	"theta", "rho", "alpha", "tau", "x", "f0", "uA", "c",
+	"e1time", "e1size", "e2time", "e2size"
+};
+
+static int columns[COLUMN_KINDS];   // kind of each column of the file
+static int columnNumber = 0;
+static double *values = NULL;       // rows * columnNumber
+static long rowNumber = 0, rowCapacity = 0;
+static FILE *paramOutFile = NULL;
+
+static int columnKind(const char *name) {
+	int k;
+
+	for (k = 0; k < COLUMN_KINDS; k++)
+		if (strcmp(name, columnNames[k]) == 0)
+			return k;
+	return -1;
+}
+
+static int skipLine(const char *line) {
+	line += strspn(line, " \t\r\n");
+	return *line == '\0' || *line == '#';
+}
+
+// returns 0, with the message on stderr, if the file cannot be used
+int paramTableLoad(const char *fileName) {
+	FILE *f;
+	char line[4096], *word, *end, *save;
+	int lineNumber = 0, c, k;
+	double *grown;
+
+	paramTableFree();
+	f = fopen(fileName, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Error: could not open parameter table %s\n", fileName);
+		return 0;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineNumber++;
+		if (strchr(line, '\n') == NULL && !feof(f)) {
+			fprintf(stderr, "Error: %s line %d is too long\n", fileName, lineNumber);
+			goto fail;
+		}
+		if (skipLine(line))
+			continue;
+		// the first line names the columns
+		if (columnNumber == 0) {
+			for (word = strtok_r(line, " \t\r\n", &save); word != NULL; word = strtok_r(NULL, " \t\r\n", &save)) {
+				k = columnKind(word);
+				if (k < 0) {
+					fprintf(stderr, "Error: %s: unknown column %s\n", fileName, word);
+					goto fail;
+				}
+				for (c = 0; c < columnNumber; c++)
+					if (columns[c] == k) {
+						fprintf(stderr, "Error: %s: column %s appears twice\n", fileName, word);
+						goto fail;
+					}
+				columns[columnNumber++] = k;
+			}
+			continue;
+		}
+		if (rowNumber == rowCapacity) {
+			rowCapacity = rowCapacity ? rowCapacity * 2 : 1024;
+			grown = realloc(values, sizeof(double) * rowCapacity * columnNumber);
+			if (grown == NULL) {
+				fprintf(stderr, "Error: Failed to allocate parameter table\n");
+				goto fail;
+			}
+			values = grown;
+		}
+		c = 0;
+		for (word = strtok_r(line, " \t\r\n", &save); word != NULL; word = strtok_r(NULL, " \t\r\n", &save)) {
+			if (c == columnNumber)
+				break;
+			values[rowNumber * columnNumber + c] = strtod(word, &end);
+			if (*end != '\0' || end == word)
+				break;
+			c++;
+		}
+		if (c != columnNumber || word != NULL) {
+			fprintf(stderr, "Error: %s line %d: expected %d numbers\n", fileName, lineNumber, columnNumber);
+			goto fail;
+		}
+		rowNumber++;
+	}
+	fclose(f);
+	if (columnNumber == 0) {
+		fprintf(stderr, "Error: parameter table %s has no header\n", fileName);
+		paramTableFree();
+		return 0;
+	}
+	return 1;
+
+fail:
+	fclose(f);
+	paramTableFree();
+	return 0;
+}
+
+long paramTableRows(void) {
+	return rowNumber;
+}
+
+int paramTableHasColumn(const char *name) {
+	int c;
+
+	for (c = 0; c < columnNumber; c++)
+		if (strcmp(columnNames[columns[c]], name) == 0)
+			return 1;
+	return 0;
+}
+
+// the row becomes point priors, which initialize() draws as usual
+void paramTableApply(long row) {
+	const double *v = values + row * columnNumber;
+	int c;
+
+	for (c = 0; c < columnNumber; c++) {
+		switch (columns[c]) {
+			case COL_THETA:
+			priorTheta = 1;
+			pThetaLow = pThetaUp = v[c];
+			break;
+			case COL_RHO:
+			priorRho = 1;
+			pRhoLow = pRhoUp = v[c];
+			break;
+			case COL_ALPHA:
+			priorAlpha = 1;
+			pAlphaLow = pAlphaUp = v[c];
+			break;
+			case COL_TAU:
+			priorTau = 1;
+			pTauLow = pTauUp = v[c] * 2.0;
+			break;
+			case COL_X:
+			priorX = 1;
+			pXLow = pXUp = v[c];
+			break;
+			case COL_F0:
+			priorF0 = 1;
+			pF0Low = pF0Up = v[c];
+			break;
+			case COL_UA:
+			priorUA = 1;
+			pUALow = pUAUp = v[c];
+			break;
+			case COL_C:
+			priorC = 1;
+			pCLow = pCUp = v[c];
+			break;
+			case COL_E1TIME:
+			pE1TLow = pE1THigh = v[c] * 2.0;
+			break;
+			case COL_E1SIZE:
+			pE1SLow = pE1SHigh = v[c];
+			break;
+			case COL_E2TIME:
+			pE2TLow = pE2THigh = v[c] * 2.0;
+			break;
+			case COL_E2SIZE:
+			pE2SLow = pE2SHigh = v[c];
+			break;
+		}
+	}
+}
+
+void paramTableFree(void) {
+	free(values);
+	values = NULL;
+	rowNumber = rowCapacity = 0;
+	columnNumber = 0;
+}
+
+int paramOutOpen(const char *fileName) {
+	paramOutFile = fopen(fileName, "w");
+	if (paramOutFile == NULL) {
+		fprintf(stderr, "Error: could not open parameter output file %s\n", fileName);
+		return 0;
+	}
+	fprintf(paramOutFile, "replicate\ttheta\trho\talpha\ttau\tx\tf0\tuA\tc");
+	if (priorE1)
+		fprintf(paramOutFile, "\te1time\te1size");
+	if (priorE2)
+		fprintf(paramOutFile, "\te2time\te2size");
+	fprintf(paramOutFile, "\n");
+	return 1;
+}
+
+// the shortest of %.15g, %.16g and %.17g that reads back as the same value
+static void writeValue(double x) {
+	char text[32];
+	int digits;
+
+	for (digits = 15; digits < 17; digits++) {
+		snprintf(text, sizeof(text), "%.*g", digits, x);
+		if (strtod(text, NULL) == x)
+			break;
+	}
+	fprintf(paramOutFile, "\t%.*g", digits, x);
+}
+
+void paramOutWrite(long replicate) {
+	if (paramOutFile == NULL)
+		return;
+	fprintf(paramOutFile, "%ld", replicate);
+	writeValue(theta);
+	writeValue(rho);
+	writeValue(alpha);
+	writeValue(tau * 0.5);
+	writeValue(sweepSite);
+	writeValue(f0);
+	writeValue(uA);
+	writeValue(partialSweepFinalFreq);
+	if (priorE1) {
+		writeValue(pE1T * 0.5);
+		writeValue(pE1S);
+	}
+	if (priorE2) {
+		writeValue(pE2T * 0.5);
+		writeValue(pE2S);
+	}
+	fprintf(paramOutFile, "\n");
+}
+
+void paramOutClose(void) {
+	if (paramOutFile == NULL)
+		return;
+	if (fclose(paramOutFile) != 0)
+		fprintf(stderr, "Error: could not write parameter output file\n");
+	paramOutFile = NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef __PARAM_TABLE_H__
+#define __PARAM_TABLE_H__
+
+// Parameters drawn outside discoal. A --param-table file has a header naming
+// its columns, from
+//
+//     theta rho alpha tau x f0 uA c e1time e1size e2time e2size
+//
+// in the units of the matching command line options, and then one row per
+// replicate: row r holds the values replicate r is simulated with. Each value
+// is passed through the prior it replaces (-Pt, -Pr, ... -Pe1, -Pe2) as the
+// bounds of a point prior, so columns the table leaves out keep their fixed
+// value or their prior. Blank lines and lines starting with '#' are skipped.
+//
+// --param-out writes the values each replicate was simulated with, one row
+// per replicate in output order, whether they came from a table, a prior or
+// the command line.
+
+int paramTableLoad(const char *fileName);
+long paramTableRows(void);
+int paramTableHasColumn(const char *name);
+void paramTableApply(long row);
+void paramTableFree(void);
+
+int paramOutOpen(const char *fileName);
+void paramOutWrite(long replicate);
+void paramOutClose(void);
+
+#endif
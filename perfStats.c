@@ -0,0 +1,98 @@
+// perfStats.c
+// per-replicate performance counters; see perfStats.h
+
+#include "perfStats.h"
+
+#ifdef DISCOAL_PERF_STATS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+PerfStats perfStats;
+static FILE *perfFile = NULL;
+
+static const char *phaseNames[PERF_PHASE_COUNT] = { "neutral", "sweep" };
+static const char *timeNames[PERF_TIME_COUNT] = {
+	"trajectory", "neutral", "sweep", "mutation", "output"
+};
+
+int perfStatsOpen(const char *filename) {
+	perfFile = fopen(filename, "w");
+	if (perfFile == NULL) {
+		fprintf(stderr, "Error: could not open perf stats file %s\n", filename);
+		return 0;
+	}
+	return 1;
+}
+
+void perfStatsReset(void) {
+	// segments can outlive a simulation only through leaks, so live counts carry over
+	long liveAncestry = perfStats.liveAncestrySegments;
+	long liveActive = perfStats.liveActiveSegments;
+
+	memset(&perfStats, 0, sizeof(perfStats));
+	perfStats.liveAncestrySegments = perfStats.peakAncestrySegments = liveAncestry;
+	perfStats.liveActiveSegments = perfStats.peakActiveSegments = liveActive;
+}
+
+void perfStatsWriteReplicate(int replicate) {
+	int p, t;
+	PerfPhaseCounters *c;
+
+	if (perfFile == NULL) return;
+
+	fprintf(perfFile, "{\"replicate\": %d, \"events\": {", replicate);
+	for (p = 0; p < PERF_PHASE_COUNT; p++) {
+		c = &perfStats.phase[p];
+		fprintf(perfFile, "%s\"%s\": {\"coalescence\": %ld, \"recombination\": %ld, "
+			"\"recombinationRejected\": %ld, \"geneConversion\": %ld, \"migration\": %ld, "
+			"\"recurrentMutation\": %ld, \"leftRecombination\": %ld, \"recurrentSweep\": %ld}",
+			p ? ", " : "", phaseNames[p], c->coalescence, c->recombination,
+			c->recombinationRejected, c->geneConversion, c->migration,
+			c->recurrentMutation, c->leftRecombination, c->recurrentSweep);
+	}
+	fprintf(perfFile, "}, \"trajectoryStepsGenerated\": %ld, \"trajectoryStepsConsumed\": %ld, "
+		"\"proposalsRejected\": %ld, \"peakAlleleNumber\": %ld, \"peakTotNodeNumber\": %ld, "
+		"\"peakAncestrySegments\": %ld, \"peakActiveSegments\": %ld, \"timeSec\": {",
+		perfStats.trajectoryStepsGenerated, perfStats.trajectoryStepsConsumed,
+		perfStats.proposalsRejected, perfStats.peakAlleleNumber, perfStats.peakTotNodeNumber,
+		perfStats.peakAncestrySegments, perfStats.peakActiveSegments);
+	for (t = 0; t < PERF_TIME_COUNT; t++) {
+		fprintf(perfFile, "%s\"%s\": %.9f", t ? ", " : "", timeNames[t], perfStats.timeNs[t] * 1e-9);
+	}
+	fprintf(perfFile, "}}\n");
+}
+
+void perfStatsSetPhase(int phase) {
+	double now = perfNowNs();
+
+	if (perfStats.phaseOpen)
+		perfStats.timeNs[PERF_TIME_NEUTRAL + perfStats.currentPhase] += now - perfStats.phaseStartNs;
+	perfStats.currentPhase = phase;
+	perfStats.phaseStartNs = now;
+	perfStats.phaseOpen = 1;
+}
+
+void perfStatsEndPhase(void) {
+	if (perfStats.phaseOpen) {
+		perfStats.timeNs[PERF_TIME_NEUTRAL + perfStats.currentPhase] += perfNowNs() - perfStats.phaseStartNs;
+		perfStats.phaseOpen = 0;
+	}
+}
+
+void perfStatsAddTime(int family, double ns) {
+	perfStats.timeNs[family] += ns;
+	// take the timed region out of the phase it ran inside
+	if (perfStats.phaseOpen)
+		perfStats.phaseStartNs += ns;
+}
+
+void perfStatsClose(void) {
+	if (perfFile != NULL) {
+		fclose(perfFile);
+		perfFile = NULL;
+	}
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef __PERF_STATS_H__
+#define __PERF_STATS_H__
+
+// Hot-path instrumentation. Build with -DDISCOAL_PERF_STATS (make discoal_perf)
+// to enable the counters; otherwise every PERF_* macro expands to nothing.
+// Counters are kept per simulation and, for events, per simulation phase.
+// With --perf-stats file one JSON line per simulation is written to file.
+//
+// Wall time is charged to the phase that is currently set; a region timed
+// with PERF_TIMER_START/STOP is charged to its own family instead, so a
+// trajectory proposed from inside the recurrent-sweep phase is not counted
+// twice.
+
+enum {
+	PERF_PHASE_NEUTRAL = 0,
+	PERF_PHASE_SWEEP,
+	PERF_PHASE_COUNT
+};
+
+enum {
+	PERF_TIME_TRAJECTORY = 0,
+	PERF_TIME_NEUTRAL,   // PERF_TIME_NEUTRAL + phase must name the phase's family
+	PERF_TIME_SWEEP,
+	PERF_TIME_MUTATION,
+	PERF_TIME_OUTPUT,
+	PERF_TIME_COUNT
+};
+
+typedef struct {
+	long coalescence;
+	long recombination;
+	long recombinationRejected;   // draws rejected with the 666 sentinel
+	long geneConversion;
+	long migration;
+	long recurrentMutation;
+	long leftRecombination;
+	long recurrentSweep;
+} PerfPhaseCounters;
+
+typedef struct {
+	PerfPhaseCounters phase[PERF_PHASE_COUNT];
+	int currentPhase;
+	int phaseOpen;
+	double phaseStartNs;
+	long trajectoryStepsGenerated;
+	long trajectoryStepsConsumed;
+	long proposalsRejected;
+	long peakAlleleNumber;
+	long peakTotNodeNumber;
+	long liveAncestrySegments, peakAncestrySegments;
+	long liveActiveSegments, peakActiveSegments;
+	double timeNs[PERF_TIME_COUNT];
+} PerfStats;
+
+#ifdef DISCOAL_PERF_STATS
+
+#include <time.h>
+
+extern PerfStats perfStats;
+
+int perfStatsOpen(const char *filename);
+void perfStatsReset(void);
+void perfStatsWriteReplicate(int replicate);
+void perfStatsClose(void);
+void perfStatsSetPhase(int phase);
+void perfStatsEndPhase(void);
+void perfStatsAddTime(int family, double ns);
+
+static inline double perfNowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define PERF_EVENT(field) (perfStats.phase[perfStats.currentPhase].field++)
+#define PERF_ADD(field, n) (perfStats.field += (n))
+#define PERF_PEAK(field, value) do { if ((long) (value) > perfStats.field) perfStats.field = (value); } while (0)
+#define PERF_SET_PHASE(p) perfStatsSetPhase(p)
+#define PERF_END_PHASE() perfStatsEndPhase()
+#define PERF_SEGMENT_ALLOC(kind) do { perfStats.live##kind##Segments++; \
+	PERF_PEAK(peak##kind##Segments, perfStats.live##kind##Segments); } while (0)
+#define PERF_SEGMENT_FREE(kind) (perfStats.live##kind##Segments--)
+#define PERF_TIMER_START(name) double perfTimer_##name = perfNowNs()
+#define PERF_TIMER_STOP(name, family) perfStatsAddTime(family, perfNowNs() - perfTimer_##name)
+
+#else
+
+#define PERF_EVENT(field) ((void) 0)
+#define PERF_ADD(field, n) ((void) 0)
+#define PERF_PEAK(field, value) ((void) 0)
+#define PERF_SET_PHASE(p) ((void) 0)
+#define PERF_END_PHASE() ((void) 0)
+#define PERF_SEGMENT_ALLOC(kind) ((void) 0)
+#define PERF_SEGMENT_FREE(kind) ((void) 0)
+#define PERF_TIMER_START(name) ((void) 0)
+#define PERF_TIMER_STOP(name, family) ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,319 @@
+// pydiscoal.c
+// CPython bindings to libdiscoal: each replicate's positions and haplotypes
+// are the library's own buffers, taken over by small Python objects and
+// shared through the buffer protocol, so neither the binding nor
+// numpy.asarray() copies them
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdiscoal.h"
+
+/* Array: one C array with a shape and a struct-module format */
+
+typedef struct {
+	PyObject_HEAD
+	void *data;
+	int ndim;
+	Py_ssize_t shape[2], strides[2];
+	Py_ssize_t itemsize;
+	char *format;
+} ArrayObject;
+
+static PyTypeObject ArrayType;
+
+static int arrayGetBuffer(ArrayObject *self, Py_buffer *view, int flags) {
+	view->buf = self->data;
+	view->obj = (PyObject *) self;
+	Py_INCREF(self);
+	view->len = self->itemsize * self->shape[0] * (self->ndim == 2 ? self->shape[1] : 1);
+	view->readonly = 0;
+	view->itemsize = self->itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? self->format : NULL;
+	view->ndim = self->ndim;
+	view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) ? self->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+static void arrayDealloc(ArrayObject *self) {
+	free(self->data);
+	Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *arrayShape(ArrayObject *self, void *closure) {
+	if (self->ndim == 1)
+		return Py_BuildValue("(n)", self->shape[0]);
+	return Py_BuildValue("(nn)", self->shape[0], self->shape[1]);
+}
+
+static PyBufferProcs arrayBufferProcs = {
+	(getbufferproc) arrayGetBuffer,
+	NULL,
+};
+
+static PyGetSetDef arrayGetSet[] = {
+	{"shape", (getter) arrayShape, NULL, "dimensions of the array", NULL},
+	{NULL},
+};
+
+static PyTypeObject ArrayType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "pydiscoal.Array",
+	.tp_basicsize = sizeof(ArrayObject),
+	.tp_dealloc = (destructor) arrayDealloc,
+	.tp_as_buffer = &arrayBufferProcs,
+	.tp_getset = arrayGetSet,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "Simulation output shared through the buffer protocol; wrap with numpy.asarray() or memoryview().",
+};
+
+// takes ownership of data, which came from malloc
+static PyObject *newArray(void *data, const char *format, Py_ssize_t itemsize, Py_ssize_t rows, Py_ssize_t columns, int ndim) {
+	ArrayObject *a = PyObject_New(ArrayObject, &ArrayType);
+
+	if (a == NULL) {
+		free(data);
+		return NULL;
+	}
+	a->data = data;
+	a->ndim = ndim;
+	a->itemsize = itemsize;
+	a->format = (char *) format;
+	a->shape[0] = rows;
+	a->shape[1] = columns;
+	a->strides[0] = ndim == 2 ? itemsize * columns : itemsize;
+	a->strides[1] = itemsize;
+	return (PyObject *) a;
+}
+
+/* Simulator: a libdiscoal context iterated from Python */
+
+typedef struct {
+	PyObject_HEAD
+	DiscoalContext *ctx;
+	int busy;
+} SimulatorObject;
+
+static void simulatorClose(SimulatorObject *self) {
+	if (self->ctx != NULL) {
+		discoalFree(self->ctx);
+		self->ctx = NULL;
+	}
+}
+
+static int simulatorInit(SimulatorObject *self, PyObject *args, PyObject *kwds) {
+	static char *kwlist[] = {"args", NULL};
+	PyObject *arguments, *list = NULL, *item;
+	const char **argv = NULL;
+	Py_ssize_t argc, i;
+	int status = -1;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &arguments))
+		return -1;
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError, "simulator is running in another thread");
+		return -1;
+	}
+	simulatorClose(self);
+	// a command line as one string, or its words
+	if (PyUnicode_Check(arguments))
+		list = PyUnicode_Split(arguments, NULL, -1);
+	else
+		list = PySequence_List(arguments);
+	if (list == NULL)
+		return -1;
+	argc = PyList_GET_SIZE(list);
+	if (argc < 3) {
+		PyErr_SetString(PyExc_ValueError, "expected sampleSize numReplicates nSites followed by options");
+		goto done;
+	}
+	argv = PyMem_Malloc(sizeof(char *) * argc);
+	if (argv == NULL) {
+		PyErr_NoMemory();
+		goto done;
+	}
+	for (i = 0; i < argc; i++) {
+		item = PyList_GET_ITEM(list, i);
+		if (PyLong_Check(item) || PyFloat_Check(item)) {
+			item = PyObject_Str(item);
+			// the list keeps the string alive
+			if (item == NULL || PyList_SetItem(list, i, item) < 0)
+				goto done;
+		}
+		argv[i] = PyUnicode_AsUTF8(item);
+		if (argv[i] == NULL)
+			goto done;
+	}
+	self->ctx = discoalCreateFromArgs((int) argc, argv);
+	if (self->ctx == NULL) {
+		if (strcmp(discoalError(), "invalid arguments") == 0)
+			PyErr_SetString(PyExc_ValueError, "invalid discoal arguments (see stderr)");
+		else
+			PyErr_SetString(PyExc_RuntimeError, "another discoal simulation is open in this process; close it or use a separate process");
+		goto done;
+	}
+	// cells are int8 0 and 1, and -1 where a sample has no ancestry
+	discoalAlleleCodes(self->ctx, 0, 1, -1);
+	status = 0;
+done:
+	PyMem_Free(argv);
+	Py_XDECREF(list);
+	return status;
+}
+
+static void simulatorDealloc(SimulatorObject *self) {
+	simulatorClose(self);
+	Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *treesToList(const DiscoalReplicate *rep) {
+	PyObject *trees = PyList_New(rep->numTrees), *tree;
+	int k;
+
+	if (trees == NULL)
+		return NULL;
+	for (k = 0; k < rep->numTrees; k++) {
+		tree = Py_BuildValue("(is)", rep->treeSites[k], rep->trees[k]);
+		if (tree == NULL) {
+			Py_DECREF(trees);
+			return NULL;
+		}
+		PyList_SET_ITEM(trees, k, tree);
+	}
+	return trees;
+}
+
+// the simulation runs without the GIL; its buffers then pass to the arrays
+static PyObject *simulatorNext(SimulatorObject *self) {
+	DiscoalReplicate rep;
+	double *positions;
+	char *haplotypes;
+	int more;
+	PyObject *pos, *hap;
+
+	if (self->ctx == NULL) {
+		PyErr_SetString(PyExc_ValueError, "simulator is closed");
+		return NULL;
+	}
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError, "simulator is already running in another thread");
+		return NULL;
+	}
+	self->busy = 1;
+	Py_BEGIN_ALLOW_THREADS
+	more = discoalNext(self->ctx, &rep);
+	Py_END_ALLOW_THREADS
+	self->busy = 0;
+
+	if (!more)
+		return NULL;  // StopIteration
+	if (rep.numTrees > 0)
+		return treesToList(&rep);
+	discoalTakeGenotypes(self->ctx, &positions, &haplotypes);
+	// a replicate without segregating sites has no matrix; export an empty one
+	if (haplotypes == NULL && (haplotypes = malloc(1)) == NULL) {
+		free(positions);
+		return PyErr_NoMemory();
+	}
+	pos = newArray(positions, "d", sizeof(double), rep.segsites, 0, 1);
+	hap = newArray(haplotypes, "b", 1, rep.sampleSize, rep.segsites, 2);
+	if (pos == NULL || hap == NULL) {
+		Py_XDECREF(pos);
+		Py_XDECREF(hap);
+		return NULL;
+	}
+	return Py_BuildValue("(NN)", pos, hap);
+}
+
+static PyObject *simulatorCloseMethod(SimulatorObject *self, PyObject *unused) {
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError, "simulator is running in another thread");
+		return NULL;
+	}
+	simulatorClose(self);
+	Py_RETURN_NONE;
+}
+
+static PyObject *simulatorEnter(SimulatorObject *self, PyObject *unused) {
+	Py_INCREF(self);
+	return (PyObject *) self;
+}
+
+static PyObject *simulatorExit(SimulatorObject *self, PyObject *args) {
+	return simulatorCloseMethod(self, NULL);
+}
+
+static PyObject *simulatorSeeds(SimulatorObject *self, void *closure) {
+	long s1, s2;
+
+	if (self->ctx == NULL) {
+		PyErr_SetString(PyExc_ValueError, "simulator is closed");
+		return NULL;
+	}
+	discoalSeeds(self->ctx, &s1, &s2);
+	return Py_BuildValue("(ll)", s1, s2);
+}
+
+static PyMethodDef simulatorMethods[] = {
+	{"close", (PyCFunction) simulatorCloseMethod, METH_NOARGS, "Free the simulation so another one can be opened."},
+	{"__enter__", (PyCFunction) simulatorEnter, METH_NOARGS, NULL},
+	{"__exit__", (PyCFunction) simulatorExit, METH_VARARGS, NULL},
+	{NULL},
+};
+
+static PyGetSetDef simulatorGetSet[] = {
+	{"seeds", (getter) simulatorSeeds, NULL, "the two seeds of the run, as -d takes them", NULL},
+	{NULL},
+};
+
+static PyTypeObject SimulatorType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "pydiscoal.Simulator",
+	.tp_basicsize = sizeof(SimulatorObject),
+	.tp_dealloc = (destructor) simulatorDealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "Simulator(args)\n\n"
+	          "Replicates of the discoal command line args (a string, or a list of words,\n"
+	          "without the program name). Iterating yields (positions, haplotypes) per\n"
+	          "replicate: float64 positions of shape (segsites,) and an int8 matrix of shape\n"
+	          "(sampleSize, segsites) holding 0, 1, or -1 where a sample has no ancestry.\n"
+	          "With -T each replicate is a list of (sites, newick) tuples instead.\n\n"
+	          "One simulator is open per process at a time. Options the executable rejects\n"
+	          "raise ValueError, with its message on stderr.",
+	.tp_iter = PyObject_SelfIter,
+	.tp_iternext = (iternextfunc) simulatorNext,
+	.tp_methods = simulatorMethods,
+	.tp_getset = simulatorGetSet,
+	.tp_init = (initproc) simulatorInit,
+	.tp_new = PyType_GenericNew,
+};
+
+static struct PyModuleDef pydiscoalModule = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "pydiscoal",
+	.m_doc = "The discoal coalescent simulator with results returned as arrays.",
+	.m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_pydiscoal(void) {
+	PyObject *m;
+
+	if (PyType_Ready(&ArrayType) < 0 || PyType_Ready(&SimulatorType) < 0)
+		return NULL;
+	m = PyModule_Create(&pydiscoalModule);
+	if (m == NULL)
+		return NULL;
+	Py_INCREF(&SimulatorType);
+	if (PyModule_AddObject(m, "Simulator", (PyObject *) &SimulatorType) < 0) {
+		Py_DECREF(&SimulatorType);
+		Py_DECREF(m);
+		return NULL;
+	}
+	Py_INCREF(&ArrayType);
+	PyModule_AddObject(m, "Array", (PyObject *) &ArrayType);
+	return m;
+}
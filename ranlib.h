@@ -1,5 +1,7 @@
 /* Prototypes for all user accessible RANLIB routines */
 
+#include "xoshiro.h"
+
 extern void advnst(long k);
 extern double genbet(double aa,double bb);
 extern double genchi(double df);
@@ -32,3 +34,9 @@ extern double sexpo(void);
 extern double sgamma(double a);
 extern double snorm(void);
 
+/* --rng xoshiro state, and bulk draws for either backend */
+extern void getxs(uint64_t *state);
+extern void setxs(const uint64_t *state);
+extern void fillunf(double *x,long n);
+extern void fillexp(double *x,long n,double av);
+extern void fillpoi(long *k,long n,double mu);
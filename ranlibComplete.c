@@ -1,4 +1,5 @@
 #include "ranlib.h"
+#include "rngSamplers.h"
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
@@ -6,6 +7,7 @@
 #define min(a,b) ((a) <= (b) ? (a) : (b))
 #define max(a,b) ((a) >= (b) ? (a) : (b))
 void ftnstop(char*);
+extern uint64_t Xxs[];
 double genbet(double aa,double bb)
 /*
 **********************************************************************
@@ -999,6 +1001,10 @@ static long ignpoi,j,k,kflag,l,m;
 static double b1,b2,c,c0,c1,c2,c3,d,del,difmuk,e,fk,fx,fy,g,omega,p,p0,px,py,q,s,
     t,u,v,x,xx,pp[35];
 
+/*
+     UNDER --rng xoshiro FROM rngSamplers.h
+*/
+    if(rngBackend == RNG_XOSHIRO) return samplerPoisson(Xxs,mu);
     if(mu == muprev) goto S10;
     if(mu < 10.0) goto S120;
 /*
@@ -1408,6 +1414,7 @@ double ranf(void)
 */
 {
 static double ranf;
+    if(rngBackend == RNG_XOSHIRO) return xoshiroUnit(Xxs);
 /*
      4.656613057E-10 is 1/M1  M1 is set in a data statement in IGNLGI
       and is currently 2147483563. If M1 changes, change this also.
@@ -1515,6 +1522,10 @@ static double q[8] = {
 static long i;
 static double sexpo,a,u,ustar,umin;
 static double *q1 = q;
+/*
+     UNDER --rng xoshiro FROM THE ZIGGURAT IN rngSamplers.h
+*/
+    if(rngBackend == RNG_XOSHIRO) return samplerExp(Xxs);
     a = 0.0;
     u = ranf();
     goto S30;
@@ -2096,6 +2107,10 @@ extern long Xm1,Xm2,Xa1,Xa2,Xcg1[],Xcg2[];
 extern long Xqanti[];
 static long ignlgi,curntg,k,s1,s2,z;
 static long qqssd,qrgnin;
+/*
+     UNDER --rng xoshiro THE SAME RANGE, FROM THE TOP 31 BITS
+*/
+    if(rngBackend == RNG_XOSHIRO) return 1 + (long)((xoshiroNext(Xxs) >> 33) % 2147483562UL);
 /*
      IF THE RANDOM NUMBER PACKAGE HAS NOT BEEN INITIALIZED YET, DO SO.
      IT CAN BE INITIALIZED IN ONE OF TWO WAYS : 1) THE FIRST CALL TO
@@ -2255,6 +2270,7 @@ extern long Xm1,Xm2,Xa1vw,Xa2vw,Xig1[],Xig2[];
 static long T1;
 static long g,ocgn;
 static long qrgnin;
+    if(rngBackend == RNG_XOSHIRO) xoshiroSeed(Xxs,iseed1,iseed2,0);
     T1 = 1;
 /*
      TELL IGNLGI, THE ACTUAL NUMBER GENERATOR, THAT THIS ROUTINE
@@ -2362,3 +2378,65 @@ S10:
 long Xm1,Xm2,Xa1,Xa2,Xcg1[32],Xcg2[32],Xa1w,Xa2w,Xig1[32],Xig2[32],Xlg1[32],
     Xlg2[32],Xa1vw,Xa2vw;
 long Xqanti[32];
+
+/*
+     xoshiro256++ backend (see xoshiro.h), selected by rngBackend
+*/
+int rngBackend = RNG_RANLIB;
+uint64_t Xxs[4];
+
+void getxs(uint64_t *state)
+{
+    int i;
+    for(i=0; i<4; i++) state[i] = Xxs[i];
+}
+
+void setxs(const uint64_t *state)
+{
+    int i;
+    for(i=0; i<4; i++) Xxs[i] = state[i];
+}
+
+/*
+     Bulk draws. Each gives the same values as n calls of ranf(),
+     genexp(av) and ignpoi(mu); under xoshiro the loops keep the
+     generator state in registers.
+*/
+void fillunf(double *x,long n)
+{
+    uint64_t s[4];
+    long i;
+    if(rngBackend != RNG_XOSHIRO) {
+        for(i=0; i<n; i++) x[i] = ranf();
+        return;
+    }
+    getxs(s);
+    for(i=0; i<n; i++) x[i] = xoshiroUnit(s);
+    setxs(s);
+}
+
+void fillexp(double *x,long n,double av)
+{
+    uint64_t s[4];
+    long i;
+    if(rngBackend != RNG_XOSHIRO) {
+        for(i=0; i<n; i++) x[i] = genexp(av);
+        return;
+    }
+    getxs(s);
+    for(i=0; i<n; i++) x[i] = samplerExp(s)*av;
+    setxs(s);
+}
+
+void fillpoi(long *k,long n,double mu)
+{
+    uint64_t s[4];
+    long i;
+    if(rngBackend != RNG_XOSHIRO) {
+        for(i=0; i<n; i++) k[i] = ignpoi(mu);
+        return;
+    }
+    getxs(s);
+    for(i=0; i<n; i++) k[i] = samplerPoisson(s,mu);
+    setxs(s);
+}
@@ -0,0 +1,90 @@
+// rngSamplers.c
+// ziggurat tables and the slow paths of the exponential and Poisson samplers
+
+#include <math.h>
+#include "rngSamplers.h"
+
+// layer i accepts j < samplerExpK[i] outright, returning j * samplerExpW[i];
+// all zero until the first draw that reaches samplerExpTail() fills them
+uint64_t samplerExpK[256];
+double samplerExpW[256];
+static double samplerExpF[256];
+static int samplerTablesReady = 0;
+
+#define ZIG_EXP_R 7.697117470131487
+#define ZIG_EXP_V 3.949659822581572e-3
+#define ZIG_SCALE 72057594037927936.0   // 2^56, the range of j
+
+static void samplerTablesInit(void) {
+	double de = ZIG_EXP_R, te = ZIG_EXP_R;
+	double q = ZIG_EXP_V / exp(-de);
+	int i;
+
+	samplerExpK[0] = (uint64_t)((de / q) * ZIG_SCALE);
+	samplerExpK[1] = 0;
+	samplerExpW[0] = q / ZIG_SCALE;
+	samplerExpW[255] = de / ZIG_SCALE;
+	samplerExpF[0] = 1.0;
+	samplerExpF[255] = exp(-de);
+	for (i = 254; i >= 1; i--) {
+		de = -log(ZIG_EXP_V / de + exp(-de));
+		samplerExpK[i + 1] = (uint64_t)((de / te) * ZIG_SCALE);
+		te = de;
+		samplerExpF[i] = exp(-de);
+		samplerExpW[i] = de / ZIG_SCALE;
+	}
+	samplerTablesReady = 1;
+}
+
+// the draw x fell outside the rectangle of its layer: the base layer's
+// tail, or the wedge between the rectangle and the curve
+double samplerExpTail(uint64_t s[4], uint64_t x) {
+	uint64_t j;
+	int i;
+	double y;
+
+	if (!samplerTablesReady) {
+		samplerTablesInit();
+		j = x >> 8;
+		i = x & 255;
+		if (j < samplerExpK[i])
+			return j * samplerExpW[i];
+	}
+	for (;;) {
+		j = x >> 8;
+		i = x & 255;
+		if (i == 0)
+			return ZIG_EXP_R - log(xoshiroUnit(s));
+		y = j * samplerExpW[i];
+		if (samplerExpF[i] + xoshiroUnit(s) * (samplerExpF[i - 1] - samplerExpF[i]) < exp(-y))
+			return y;
+		x = xoshiroNext(s);
+		if ((x >> 8) < samplerExpK[x & 255])
+			return (x >> 8) * samplerExpW[x & 255];
+	}
+}
+
+// PTRS, Hoermann (1993), "The transformed rejection method for generating
+// Poisson random variables", for mu >= 10
+long samplerPoissonLarge(uint64_t s[4], double mu) {
+	double slam = sqrt(mu), loglam = log(mu);
+	double b = 0.931 + 2.53 * slam;
+	double a = -0.059 + 0.02483 * b;
+	double invalpha = 1.1239 + 1.1328 / (b - 3.4);
+	double vr = 0.9277 - 3.6224 / (b - 2);
+	double u, v, us;
+	long k;
+
+	for (;;) {
+		u = xoshiroUnit(s) - 0.5;
+		v = xoshiroUnit(s);
+		us = 0.5 - fabs(u);
+		k = (long)floor((2 * a / us + b) * u + mu + 0.43);
+		if (us >= 0.07 && v <= vr)
+			return k;
+		if (k < 0 || (us < 0.013 && v > us))
+			continue;
+		if (log(v) + log(invalpha) - log(a / (us * us) + b) <= -mu + k * loglam - lgamma(k + 1))
+			return k;
+	}
+}
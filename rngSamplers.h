@@ -0,0 +1,56 @@
+#ifndef __RNG_SAMPLERS_H__
+#define __RNG_SAMPLERS_H__
+
+// Exponential and Poisson deviates drawn straight from a xoshiro256++ state
+// (xoshiro.h). Under --rng xoshiro, sexpo() and ignpoi() hand their draws to
+// these, so the waiting times of the event loops and the mutation counts of
+// dropMutations() skip ranlib's table-driven code and its static state.
+//
+// samplerExp() is the 256-layer ziggurat of Marsaglia and Tsang (2000): one
+// 64-bit draw, a table lookup and a multiply in about 98% of calls. samplerPoisson()
+// inverts the cdf by sequential search for mu < 10, the usual case for a
+// single branch, and above that uses Hoermann's transformed rejection with
+// squeeze (PTRS, 1993), whose cost does not grow with mu.
+
+#include <stdint.h>
+#include <math.h>
+#include "xoshiro.h"
+
+double samplerExpTail(uint64_t s[4], uint64_t x);
+long samplerPoissonLarge(uint64_t s[4], double mu);
+
+extern uint64_t samplerExpK[256];
+extern double samplerExpW[256];
+
+#define SAMPLER_POISSON_SEARCH_MAX 10.0
+
+static inline double samplerExp(uint64_t s[4]) {
+	uint64_t x = xoshiroNext(s);
+	uint64_t j = x >> 8;
+	int i = x & 255;
+
+	if (j < samplerExpK[i])
+		return j * samplerExpW[i];
+	return samplerExpTail(s, x);
+}
+
+static inline long samplerPoisson(uint64_t s[4], double mu) {
+	double u, p;
+	long k = 0;
+
+	if (mu >= SAMPLER_POISSON_SEARCH_MAX)
+		return samplerPoissonLarge(s, mu);
+	p = exp(-mu);
+	u = xoshiroUnit(s);
+	while (u > p) {
+		u -= p;
+		k++;
+		p *= mu / k;
+		// rounding can leave u above the remaining mass
+		if (p == 0.0)
+			break;
+	}
+	return k;
+}
+
+#endif
@@ -0,0 +1,63 @@
+// rngStream.c
+// jumping the ranlib generator ahead to per-replicate substreams, and
+// explicit-state copies of it
+
+#include "rngStream.h"
+#include "ranlib.h"
+
+extern long Xm1, Xm2, Xa1, Xa2;
+
+// a^e mod m by repeated squaring; mltmod keeps the products from overflowing
+long rngPowMod(long a, long e, long m) {
+	long result = 1;
+
+	while (e > 0) {
+		if (e & 1) result = mltmod(a, result, m);
+		a = mltmod(a, a, m);
+		e >>= 1;
+	}
+	return result;
+}
+
+// both components are multiplicative, so advancing n draws multiplies the
+// seed by a^n. requires setall() to have been called
+void seedReplicateStream(long seed1, long seed2, long replicate) {
+	uint64_t xs[4];
+	long jump1 = rngPowMod(Xa1, 1L << REPLICATE_STREAM_LOG2, Xm1);
+	long jump2 = rngPowMod(Xa2, 1L << REPLICATE_STREAM_LOG2, Xm2);
+
+	if (rngBackend == RNG_XOSHIRO) {
+		xoshiroSeed(xs, seed1, seed2, replicate);
+		setxs(xs);
+		return;
+	}
+	setsd(mltmod(rngPowMod(jump1, replicate, Xm1), seed1, Xm1),
+	      mltmod(rngPowMod(jump2, replicate, Xm2), seed2, Xm2));
+}
+
+// the next rngStreamRanf(rs) equals the next ranf()
+void rngStreamCapture(RngStream *rs) {
+	if (rngBackend == RNG_XOSHIRO) getxs(rs->xs);
+	getsd(&rs->s1, &rs->s2);
+}
+
+// any seeds, reduced to the valid range of each component
+void rngStreamSeed(RngStream *rs, long seed1, long seed2) {
+	if (rngBackend == RNG_XOSHIRO) xoshiroSeed(rs->xs, seed1, seed2, 0);
+	rs->s1 = 1 + (seed1 % (Xm1 - 1) + (Xm1 - 1)) % (Xm1 - 1);
+	rs->s2 = 1 + (seed2 % (Xm2 - 1) + (Xm2 - 1)) % (Xm2 - 1);
+}
+
+// advances rs by n * 2^log2Steps draws; under xoshiro by n * 2^128
+void rngStreamJump(RngStream *rs, long log2Steps, long n) {
+	long jump1 = rngPowMod(rngPowMod(Xa1, 1L << log2Steps, Xm1), n, Xm1);
+	long jump2 = rngPowMod(rngPowMod(Xa2, 1L << log2Steps, Xm2), n, Xm2);
+	long i;
+
+	if (rngBackend == RNG_XOSHIRO)
+		for (i = 0; i < n; i++)
+			xoshiroJump(rs->xs);
+
+	rs->s1 = mltmod(jump1, rs->s1, Xm1);
+	rs->s2 = mltmod(jump2, rs->s2, Xm2);
+}
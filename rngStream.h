@@ -0,0 +1,54 @@
+#ifndef __RNG_STREAM_H__
+#define __RNG_STREAM_H__
+
+// Positioning of the ranlib generator on per-replicate substreams.
+// Replicate r of a run seeded with (seed1, seed2) starts 2^REPLICATE_STREAM_LOG2 * r
+// draws into that run's stream, so any range of replicates can be simulated
+// on its own and still match the same replicates of a full run. Under
+// --rng xoshiro, replicate r instead gets its own seeding of xoshiro256++.
+
+#include "xoshiro.h"
+
+#define REPLICATE_STREAM_LOG2 36
+#define MAX_REPLICATE_STREAMS (1L << (61 - REPLICATE_STREAM_LOG2))
+
+long rngPowMod(long a, long e, long m);
+void seedReplicateStream(long seed1, long seed2, long replicate);
+
+// An explicit-state copy of the ranlib generator. It gives the same draws
+// as ranf() from the same state, but without ranlib's globals, so it can
+// replay part of the main stream or run in another thread. Under
+// --rng xoshiro it is a copy of that generator's state instead.
+typedef struct {
+	long s1, s2;
+	uint64_t xs[4];
+} RngStream;
+
+void rngStreamCapture(RngStream *rs);
+void rngStreamSeed(RngStream *rs, long seed1, long seed2);
+void rngStreamJump(RngStream *rs, long log2Steps, long n);
+
+// one step of ignlgi() followed by the scaling in ranf()
+static inline double rngStreamRanf(RngStream *rs) {
+	long k, z;
+
+	if (rngBackend == RNG_XOSHIRO) return xoshiroUnit(rs->xs);
+	k = rs->s1 / 53668L;
+	rs->s1 = 40014L * (rs->s1 - k * 53668L) - k * 12211L;
+	if (rs->s1 < 0) rs->s1 += 2147483563L;
+	k = rs->s2 / 52774L;
+	rs->s2 = 40692L * (rs->s2 - k * 52774L) - k * 3791L;
+	if (rs->s2 < 0) rs->s2 += 2147483399L;
+	z = rs->s1 - rs->s2;
+	if (z < 1) z += 2147483562L;
+	return z * 4.656613057E-10;
+}
+
+double ranf(void);
+
+// a draw from rs, or from the ranlib generator when rs is NULL
+static inline double rngUniform(RngStream *rs) {
+	return rs ? rngStreamRanf(rs) : ranf();
+}
+
+#endif
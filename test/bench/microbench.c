@@ -0,0 +1,446 @@
+// microbench.c
+//
+// Microbenchmarks for the discoal hot paths. Each benchmark is run with an
+// automatically scaled iteration count and reports ns/op together with the
+// number of heap allocations and bytes allocated per op. Results are written
+// to stdout as a single JSON document so that runs can be diffed or plotted.
+//
+// Allocation counting relies on the GNU linker's --wrap option (see the
+// `bench` target in the Makefile).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../../discoal.h"
+#include "../../discoalFunctions.h"
+#include "../../ancestrySegment.h"
+#include "../../activeSegment.h"
+#include "../../ranlib.h"
+#include "../../outputWriter.h"
+
+#define BENCH_MIN_TIME_NS 200000000.0   /* run each benchmark for at least 0.2s */
+#define BENCH_MAX_ITERATIONS 100000000L
+
+/******************************************************************************/
+/* allocation accounting                                                      */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static int benchCounting = 0;
+static long benchAllocs = 0;
+static long benchBytes = 0;
+
+void *__wrap_malloc(size_t size){
+	if(benchCounting){
+		benchAllocs++;
+		benchBytes += size;
+	}
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size){
+	if(benchCounting){
+		benchAllocs++;
+		benchBytes += nmemb * size;
+	}
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size){
+	if(benchCounting){
+		benchAllocs++;
+		benchBytes += size;
+	}
+	return __real_realloc(ptr, size);
+}
+
+/******************************************************************************/
+/* timing harness                                                             */
+
+static double benchElapsed;
+static struct timespec benchStartTime;
+static FILE *jsonOut;
+static int benchResultCount = 0;
+
+static double nowNs(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* benchStart/benchStop bracket the measured part of an iteration so that
+   per-iteration setup can be excluded from both timing and allocation counts */
+static void benchStart(void){
+	benchCounting = 1;
+	clock_gettime(CLOCK_MONOTONIC, &benchStartTime);
+}
+
+static void benchStop(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	benchCounting = 0;
+	benchElapsed += (ts.tv_sec - benchStartTime.tv_sec) * 1e9 + (ts.tv_nsec - benchStartTime.tv_nsec);
+}
+
+typedef void (*benchFn)(long n, void *ctx);
+
+static void runBench(const char *name, const char *params, benchFn fn, void *ctx){
+	long n = 1;
+	double wall;
+
+	for(;;){
+		benchElapsed = 0.0;
+		benchAllocs = 0;
+		benchBytes = 0;
+		wall = nowNs();
+		fn(n, ctx);
+		wall = nowNs() - wall;
+		if(benchElapsed >= BENCH_MIN_TIME_NS || wall >= 10 * BENCH_MIN_TIME_NS || n >= BENCH_MAX_ITERATIONS)
+			break;
+		//grow towards the target time, at most 100x per round
+		if(benchElapsed <= 0.0){
+			n *= 100;
+		}
+		else{
+			double scale = 1.2 * BENCH_MIN_TIME_NS / benchElapsed;
+			if(scale > 100.0) scale = 100.0;
+			if(scale < 2.0) scale = 2.0;
+			n = (long) (n * scale);
+		}
+		if(n > BENCH_MAX_ITERATIONS) n = BENCH_MAX_ITERATIONS;
+	}
+
+	fprintf(jsonOut, "%s\n    {\"name\": \"%s\", \"params\": {%s}, \"iterations\": %ld, "
+		"\"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}",
+		benchResultCount ? "," : "", name, params, n,
+		benchElapsed / n, (double) benchAllocs / n, (double) benchBytes / n);
+	fflush(jsonOut);
+	benchResultCount++;
+	fprintf(stderr, "%-40s %-32s %12.1f ns/op %10.2f allocs/op\n", name, params,
+		benchElapsed / n, (double) benchAllocs / n);
+}
+
+/******************************************************************************/
+/* fixtures                                                                   */
+
+/* builds a segment list of nFrag fragments spread over [0, nSites). each
+   fragment covers half of its slot, shifted right by offset */
+static AncestrySegment *makeFragmentedAncestry(int nFrag, int sites, int offset, uint16_t count){
+	AncestrySegment *head = NULL, *tail = NULL, *seg;
+	int i, step, start, end;
+
+	step = sites / nFrag;
+	for(i = 0; i < nFrag; i++){
+		start = i * step + offset;
+		end = start + step / 2;
+		if(end > sites) end = sites;
+		if(start >= end) continue;
+		seg = newSegment(start, end, NULL, NULL);
+		seg->count = count;
+		if(tail) tail->next = seg;
+		else head = seg;
+		tail = seg;
+	}
+	return head;
+}
+
+typedef struct {
+	int fragments;
+	int sites;
+	AncestrySegment *a, *b;
+} segmentCtx;
+
+static void benchMerge(long n, void *p){
+	segmentCtx *ctx = p;
+	AncestrySegment *res;
+	long i;
+	for(i = 0; i < n; i++){
+		benchStart();
+		res = mergeAncestryTrees(ctx->a, ctx->b);
+		freeSegmentTree(res);
+		benchStop();
+	}
+}
+
+static void benchSplit(long n, void *p){
+	segmentCtx *ctx = p;
+	AncestrySegment *l, *r;
+	long i;
+	int bp = ctx->sites / 2 + 1;
+	for(i = 0; i < n; i++){
+		benchStart();
+		l = splitLeft(ctx->a, bp);
+		r = splitRight(ctx->a, bp);
+		freeSegmentTree(l);
+		freeSegmentTree(r);
+		benchStop();
+	}
+}
+
+static void benchGeneConversion(long n, void *p){
+	segmentCtx *ctx = p;
+	gcSplitResult res;
+	long i;
+	int start = ctx->sites / 3;
+	for(i = 0; i < n; i++){
+		benchStart();
+		res = splitSegmentTreeForGeneConversion(ctx->a, start, start + ctx->sites / 10);
+		freeSegmentTree(res.converted);
+		freeSegmentTree(res.unconverted);
+		benchStop();
+	}
+}
+
+/* active material starts with nFrag active fragments, the ancestry fixes
+   every other one of them */
+static void benchUpdateActiveMaterial(long n, void *p){
+	segmentCtx *ctx = p;
+	ActiveMaterial am;
+	ActiveSegment *seg, *tail;
+	int step = ctx->sites / ctx->fragments;
+	long i;
+	int f;
+
+	for(i = 0; i < n; i++){
+		am.segments = NULL;
+		am.avlTree = NULL;
+		am.totalActive = 0;
+		tail = NULL;
+		for(f = 0; f < ctx->fragments; f++){
+			seg = newActiveSegment(f * step, f * step + step / 2);
+			am.totalActive += step / 2;
+			if(tail) tail->next = seg;
+			else am.segments = seg;
+			tail = seg;
+		}
+		benchStart();
+		updateActiveMaterialFromAncestry(&am, ctx->b, 2, ctx->sites);
+		benchStop();
+		freeActiveMaterial(&am);
+	}
+}
+
+typedef struct {
+	int n;
+	int popns;
+} pickCtx;
+
+static void benchPickNodePopn(long n, void *p){
+	pickCtx *ctx = p;
+	long i;
+	int k;
+	rootedNode *pool;
+
+	alleleNumber = 0;
+	initializeNodeArrays();
+	ensureNodesCapacity(ctx->n);
+	pool = calloc(ctx->n, sizeof(rootedNode));
+	for(k = 0; k < ctx->n; k++){
+		pool[k].population = k % ctx->popns;
+		nodes[k] = &pool[k];
+	}
+	alleleNumber = ctx->n;
+
+	benchStart();
+	for(i = 0; i < n; i++){
+		pickNodePopn((int) (i % ctx->popns));
+	}
+	benchStop();
+
+	alleleNumber = 0;
+	free(pool);
+	cleanupNodeArrays();
+}
+
+typedef struct {
+	int n;
+	int sites;
+	double theta, rho;
+} gameteCtx;
+
+/* simulates one neutral replicate with mutations so makeGametesMS has
+   something realistic to format */
+static void simulateNeutralReplicate(gameteCtx *ctx){
+	double sizes[MAXPOPS];
+
+	sampleSize = ctx->n;
+	sampleSizes[0] = ctx->n;
+	npops = 1;
+	nSites = ctx->sites;
+	theta = ctx->theta;
+	rho = ctx->rho;
+	my_gamma = 0.0;
+	sizes[0] = 1.0;
+	initialize();
+	neutralPhaseGeneralPopNumber(breakPoints, 0.0, MAXTIME, sizes);
+	dropMutations();
+}
+
+static void benchMakeGametesMS(long n, void *p){
+	gameteCtx *ctx = p;
+	const char *argv[] = { "discoal" };
+	long i;
+
+	simulateNeutralReplicate(ctx);
+	benchStart();
+	for(i = 0; i < n; i++){
+		makeGametesMS(1, argv);
+		outputSubmit();
+	}
+	fflush(stdout);
+	benchStop();
+	freeTree(nodes[0]);
+	cleanupBreakPoints();
+	cleanupNodeArrays();
+	freeActiveMaterial(&activeMaterialSegments);
+}
+
+/* a whole replicate the way main runs it; with --keep-buffers the steady
+   state should not touch the allocator */
+static void runNeutralReplicate(gameteCtx *ctx){
+	const char *argv[] = { "discoal" };
+
+	simulateNeutralReplicate(ctx);
+	makeGametesMS(1, argv);
+	outputSubmit();
+	freeTree(nodes[0]);
+	if(!keepBuffersMode)
+		releaseReplicateBuffers();
+}
+
+static void benchNeutralReplicate(long n, void *p){
+	gameteCtx *ctx = p;
+	long i;
+
+	leafBitsetMode = 1;
+	setall(1, 2);
+	for(i = 0; i < 20; i++)
+		runNeutralReplicate(ctx);
+	benchStart();
+	for(i = 0; i < n; i++)
+		runNeutralReplicate(ctx);
+	fflush(stdout);
+	benchStop();
+	releaseReplicateBuffers();
+	leafBitsetMode = 0;
+}
+
+typedef struct {
+	int N;
+	double alpha;
+	char mode;
+} trajCtx;
+
+static void benchProposeTrajectory(long n, void *p){
+	trajCtx *ctx = p;
+	double sizes[MAXPOPS], finalFreq;
+	double x0;
+	long i;
+
+	EFFECTIVE_POPN_SIZE = ctx->N;
+	deltaTMod = 40;
+	sizes[0] = 1.0;
+	x0 = 1.0 - (1.0 / (2.0 * ctx->N));
+	for(i = 0; i < n; i++){
+		benchStart();
+		proposeTrajectory(0, NULL, sizes, ctx->mode, x0, &finalFreq, ctx->alpha, 0.0, 0.0);
+		benchStop();
+		cleanupRejectedTrajectory(trajectoryFilename);
+	}
+}
+
+/******************************************************************************/
+
+int main(int argc, const char *argv[]){
+	int fragmentCounts[] = { 1, 10, 100, 1000 };
+	int sampleCounts[] = { 10, 100, 1000 };
+	char params[128];
+	segmentCtx sctx;
+	pickCtx pctx;
+	gameteCtx gctx;
+	trajCtx tctx;
+	size_t f, s;
+	int nullFd;
+
+	//keep the real stdout for results; simulation output goes to /dev/null
+	jsonOut = fdopen(dup(fileno(stdout)), "w");
+	nullFd = open("/dev/null", O_WRONLY);
+	if(jsonOut == NULL || nullFd < 0){
+		fprintf(stderr, "Error: could not set up benchmark output\n");
+		exit(1);
+	}
+	dup2(nullFd, fileno(stdout));
+	close(nullFd);
+
+	setall(12345, 67890);
+	events = calloc(1, sizeof(struct event));
+	events[0].type = 'n';
+	events[0].popnSize = 1.0;
+	eventNumber = 1;
+	eventsCapacity = 1;
+
+	fprintf(jsonOut, "{\n  \"benchmarks\": [");
+
+	sctx.sites = 100000;
+	for(f = 0; f < sizeof(fragmentCounts) / sizeof(fragmentCounts[0]); f++){
+		sctx.fragments = fragmentCounts[f];
+		sctx.a = makeFragmentedAncestry(sctx.fragments, sctx.sites, 0, 1);
+		sctx.b = makeFragmentedAncestry(sctx.fragments, sctx.sites, sctx.sites / sctx.fragments / 4, 1);
+		snprintf(params, sizeof(params), "\"fragments\": %d", sctx.fragments);
+		runBench("mergeAncestryTrees", params, benchMerge, &sctx);
+		runBench("splitLeft+splitRight", params, benchSplit, &sctx);
+		runBench("splitSegmentTreeForGeneConversion", params, benchGeneConversion, &sctx);
+		freeSegmentTree(sctx.b);
+		//fixed everywhere it is present
+		sctx.b = makeFragmentedAncestry(sctx.fragments, sctx.sites, 0, 2);
+		runBench("updateActiveMaterialFromAncestry", params, benchUpdateActiveMaterial, &sctx);
+		freeSegmentTree(sctx.a);
+		freeSegmentTree(sctx.b);
+	}
+
+	for(s = 0; s < sizeof(sampleCounts) / sizeof(sampleCounts[0]); s++){
+		pctx.n = sampleCounts[s];
+		pctx.popns = 2;
+		snprintf(params, sizeof(params), "\"n\": %d, \"popns\": %d", pctx.n, pctx.popns);
+		runBench("pickNodePopn", params, benchPickNodePopn, &pctx);
+	}
+
+	for(s = 0; s < sizeof(sampleCounts) / sizeof(sampleCounts[0]); s++){
+		gctx.n = sampleCounts[s];
+		gctx.sites = 10000;
+		gctx.theta = 50.0;
+		gctx.rho = 50.0;
+		snprintf(params, sizeof(params), "\"n\": %d, \"theta\": %g, \"rho\": %g",
+			gctx.n, gctx.theta, gctx.rho);
+		runBench("makeGametesMS", params, benchMakeGametesMS, &gctx);
+	}
+
+	gctx.n = 50;
+	for(keepBuffersMode = 0; keepBuffersMode <= 1; keepBuffersMode++){
+		snprintf(params, sizeof(params), "\"n\": %d, \"theta\": %g, \"rho\": %g, \"keepBuffers\": %d",
+			gctx.n, gctx.theta, gctx.rho, keepBuffersMode);
+		runBench("neutralReplicate", params, benchNeutralReplicate, &gctx);
+	}
+	keepBuffersMode = 0;
+
+	tctx.mode = 's';
+	tctx.alpha = 1000.0;
+	tctx.N = 10000;
+	snprintf(params, sizeof(params), "\"N\": %d, \"alpha\": %g", tctx.N, tctx.alpha);
+	runBench("proposeTrajectory", params, benchProposeTrajectory, &tctx);
+	tctx.N = 100000;
+	snprintf(params, sizeof(params), "\"N\": %d, \"alpha\": %g", tctx.N, tctx.alpha);
+	runBench("proposeTrajectory", params, benchProposeTrajectory, &tctx);
+
+	fprintf(jsonOut, "\n  ]\n}\n");
+	fclose(jsonOut);
+	free(events);
+	(void) argc;
+	(void) argv;
+	return 0;
+}
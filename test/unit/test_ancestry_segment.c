@@ -168,6 +168,25 @@ void test_mergeAncestryTrees_non_overlapping(void) {
     freeSegmentTree(tree2);
 }
 
+// Merged counts run up to the largest sample the count type allows
+void test_mergeAncestryTrees_counts_reach_type_limit(void) {
+    AncestrySegment* tree1 = newSegment(0, 20, NULL, NULL);
+    AncestrySegment* tree2 = newSegment(10, 30, NULL, NULL);
+    AncestrySegment* merged;
+
+    tree1->count = ANCESTRY_COUNT_MAX - 1;
+    merged = mergeAncestryTrees(tree1, tree2);
+
+    TEST_ASSERT_TRUE(getAncestryCount(merged, 5) == ANCESTRY_COUNT_MAX - 1);
+    TEST_ASSERT_TRUE(getAncestryCount(merged, 15) == ANCESTRY_COUNT_MAX);
+    TEST_ASSERT_EQUAL(1, getAncestryCount(merged, 25));
+    TEST_ASSERT_TRUE((AncestryCount) ANCESTRY_COUNT_MAX == ANCESTRY_COUNT_MAX);
+
+    freeSegmentTree(merged);
+    freeSegmentTree(tree1);
+    freeSegmentTree(tree2);
+}
+
 // Test splitting operations
 void test_splitLeft_basic(void) {
     testSegment = newSegment(10, 50, NULL, NULL);
@@ -212,6 +231,24 @@ void test_split_edge_cases(void) {
     TEST_ASSERT_NULL(rightOut);  // Nothing to the right of 60 when segment is [10,50)
 }
 
+// Released segments are handed out again, fully reinitialised
+void test_released_segments_are_reused(void) {
+    AncestrySegment *first = newSegment(0, 100, NULL, NULL);
+    AncestrySegment *reused;
+
+    first->count = 7;
+    freeSegmentTree(first);
+    reused = newSegment(10, 20, NULL, NULL);
+    TEST_ASSERT_TRUE(reused == first);
+    TEST_ASSERT_EQUAL(10, reused->start);
+    TEST_ASSERT_EQUAL(20, reused->end);
+    TEST_ASSERT_EQUAL(1, reused->count);
+    TEST_ASSERT_EQUAL(1, reused->refCount);
+    TEST_ASSERT_NULL(reused->next);
+    freeSegmentTree(reused);
+    trimAncestrySegmentPool();
+}
+
 #ifndef TEST_RUNNER_MODE
 int main(void) {
     UNITY_BEGIN();
@@ -226,9 +263,11 @@ int main(void) {
     RUN_TEST(test_copySegmentTree_creates_independent_copy);
     RUN_TEST(test_null_safety);
     RUN_TEST(test_mergeAncestryTrees_non_overlapping);
+    RUN_TEST(test_mergeAncestryTrees_counts_reach_type_limit);
     RUN_TEST(test_splitLeft_basic);
     RUN_TEST(test_splitRight_basic);
     RUN_TEST(test_split_edge_cases);
+    RUN_TEST(test_released_segments_are_reused);
     
     return UNITY_END();
 }
@@ -0,0 +1,96 @@
+#include "unity.h"
+#include "../../checkpoint.h"
+#include "../../ranlib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Test fixtures
+char testCheckpointFilename[256];
+
+#ifndef TEST_RUNNER_MODE
+void setUp(void) {
+    snprintf(testCheckpointFilename, sizeof(testCheckpointFilename),
+             "/tmp/test_checkpoint_%d.ckpt", getpid());
+    setall(12345, 67890);
+}
+
+void tearDown(void) {
+    unlink(testCheckpointFilename);
+}
+#endif
+
+void test_checkpointArgsKey_strips_checkpoint_flags(void) {
+    const char *argv[] = {"./discoal", "10", "5", "1000", "--checkpoint", "run.ckpt",
+                          "-t", "10", "--resume", "--checkpoint-every", "50", "-d", "1", "2"};
+    char *key = checkpointArgsKey(14, argv);
+
+    TEST_ASSERT_EQUAL_STRING("10 5 1000 -t 10 -d 1 2", key);
+    free(key);
+}
+
+void test_checkpoint_roundtrip(void) {
+    Checkpoint ck, loaded;
+
+    ck.argsKey = "10 5 1000 -t 10";
+    ck.seed1 = 11;
+    ck.seed2 = 22;
+    ck.rngState1 = 33;
+    ck.rngState2 = 44;
+    ck.completed = 1000;
+    ck.simulated = 1200;
+    ck.outputOffset = 987654;
+    TEST_ASSERT_EQUAL(1, writeCheckpoint(testCheckpointFilename, &ck));
+
+    TEST_ASSERT_EQUAL(1, readCheckpoint(testCheckpointFilename, &loaded));
+    TEST_ASSERT_EQUAL_STRING(ck.argsKey, loaded.argsKey);
+    TEST_ASSERT_EQUAL(11, loaded.seed1);
+    TEST_ASSERT_EQUAL(22, loaded.seed2);
+    TEST_ASSERT_EQUAL(33, loaded.rngState1);
+    TEST_ASSERT_EQUAL(44, loaded.rngState2);
+    TEST_ASSERT_EQUAL(1000, loaded.completed);
+    TEST_ASSERT_EQUAL(1200, loaded.simulated);
+    TEST_ASSERT_EQUAL(987654, loaded.outputOffset);
+    freeCheckpoint(&loaded);
+}
+
+void test_readCheckpoint_missing_and_malformed(void) {
+    Checkpoint loaded;
+    FILE *f;
+
+    TEST_ASSERT_EQUAL(0, readCheckpoint(testCheckpointFilename, &loaded));
+
+    f = fopen(testCheckpointFilename, "w");
+    fprintf(f, "discoal-checkpoint 1\ncompleted 5\n");
+    fclose(f);
+    TEST_ASSERT_EQUAL(-1, readCheckpoint(testCheckpointFilename, &loaded));
+    freeCheckpoint(&loaded);
+}
+
+void test_checkpoint_rng_state_resumes_stream(void) {
+    Checkpoint ck;
+    double expected[10];
+    int i;
+
+    for (i = 0; i < 100; i++) ranf();
+    checkpointCaptureRng(&ck);
+    for (i = 0; i < 10; i++) expected[i] = ranf();
+
+    setall(1, 2);
+    checkpointRestoreRng(&ck);
+    for (i = 0; i < 10; i++) TEST_ASSERT_TRUE(expected[i] == ranf());
+}
+
+#ifndef TEST_RUNNER_MODE
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_checkpointArgsKey_strips_checkpoint_flags);
+    RUN_TEST(test_checkpoint_roundtrip);
+    RUN_TEST(test_readCheckpoint_missing_and_malformed);
+    RUN_TEST(test_checkpoint_rng_state_resumes_stream);
+
+    return UNITY_END();
+}
+#endif
@@ -3,8 +3,12 @@
 #include "../../discoalFunctions.h"
 #include "../../ancestrySegment.h"
 #include "../../ranlib.h"
+#include "../../outputWriter.h"
+#include "../../marginalTrees.h"
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 // Test fixtures
 rootedNode *testNode1, *testNode2, *testNode3;
@@ -54,19 +58,17 @@ void tearDown(void) {
     // Clean up test nodes
     if (testNode1) {
         cleanupMuts(testNode1);
-        free(testNode1);
     }
     if (testNode2) {
         cleanupMuts(testNode2);
-        free(testNode2);
     }
     if (testNode3) {
         cleanupMuts(testNode3);
-        free(testNode3);
     }
     
     // Clean up node arrays
     cleanupNodeArrays();
+    freeNodeStore();
     cleanupBreakPoints();
     freeActiveMaterial(&activeMaterialSegments);
     
@@ -108,18 +110,18 @@ void test_coalesceAtTimePopn_basic(void) {
     // Check parent properties
     rootedNode *parent = nodes[0];
     TEST_ASSERT_NOT_NULL(parent);
-    TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, parent->time);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, nodeTime[parent->id]);
     TEST_ASSERT_EQUAL(0, parent->population);
     
     // Check children are linked correctly
-    TEST_ASSERT_NOT_NULL(parent->leftChild);
-    TEST_ASSERT_NOT_NULL(parent->rightChild);
-    TEST_ASSERT_EQUAL(parent, parent->leftChild->leftParent);
-    TEST_ASSERT_EQUAL(parent, parent->rightChild->leftParent);
+    TEST_ASSERT_NOT_NULL(leftChildOf(parent));
+    TEST_ASSERT_NOT_NULL(rightChildOf(parent));
+    TEST_ASSERT_EQUAL(parent, leftParentOf(leftChildOf(parent)));
+    TEST_ASSERT_EQUAL(parent, leftParentOf(rightChildOf(parent)));
     
     // Check branch lengths
-    TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, parent->leftChild->branchLength);
-    TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, parent->rightChild->branchLength);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, nodeBranchLength[nodeLeftChild[parent->id]]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, nodeBranchLength[nodeRightChild[parent->id]]);
 }
 
 // Test coalescence ancestry merging
@@ -189,8 +191,8 @@ void test_recombineAtTimePopn_basic(void) {
         TEST_ASSERT_NOT_NULL(parent2);
         
         // Both should be at time 1.0
-        TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, parent1->time);
-        TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, parent2->time);
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, nodeTime[parent1->id]);
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, nodeTime[parent2->id]);
     } else {
         // Recombination didn't happen, which is okay - it's random
         TEST_ASSERT_EQUAL(1, alleleNumber);
@@ -213,7 +215,7 @@ void test_recombineAtTimePopn_ancestry_split(void) {
         
         // Find the parents
         for (int i = 0; i < alleleNumber; i++) {
-            if (nodes[i]->leftChild == testNode1) {
+            if (leftChildOf(nodes[i]) == testNode1) {
                 if (leftParent == NULL) leftParent = nodes[i];
                 else rightParent = nodes[i];
             }
@@ -257,8 +259,8 @@ void test_geneConversionAtTimePopn_basic(void) {
         rootedNode *parent2 = nodes[1];
         TEST_ASSERT_NOT_NULL(parent1);
         TEST_ASSERT_NOT_NULL(parent2);
-        TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, parent1->time);
-        TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, parent2->time);
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, nodeTime[parent1->id]);
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, nodeTime[parent2->id]);
     }
 }
 
@@ -301,10 +303,10 @@ void test_updateActiveMaterial_basic(void) {
     testNode1 = createTestNodeWithAncestry(0.0, 0, 20, 40);
     testNode2 = createTestNodeWithAncestry(0.0, 0, 60, 80);
     
-    parent->leftChild = testNode1;
-    parent->rightChild = testNode2;
-    testNode1->leftParent = parent;
-    testNode2->leftParent = parent;
+    nodeLeftChild[parent->id] = testNode1->id;
+    nodeRightChild[parent->id] = testNode2->id;
+    nodeLeftParent[testNode1->id] = parent->id;
+    nodeLeftParent[testNode2->id] = parent->id;
     
     // Merge ancestry for parent
     parent->ancestryRoot = mergeAncestryTrees(testNode1->ancestryRoot, testNode2->ancestryRoot);
@@ -370,6 +372,136 @@ void test_nodePopnSize_count(void) {
     TEST_ASSERT_EQUAL(0, nodePopnSize(2));
 }
 
+// Simulates a small recombining genealogy from a fixed seed and returns the
+// ms-style genotype block printed for it
+static void simulateTestTree(void) {
+    double t = 0.0;
+    int i;
+
+    setall(21, 22);
+    for (i = 0; i < sampleSize; i++)
+        TEST_ASSERT_EQUAL(i, createTestNodeWithAncestry(0.0, 0, 0, nSites)->id);
+    while (alleleNumber > 1) {
+        t += 0.1;
+        if (ranf() < 0.3) {
+            int bp = recombineAtTimePopn(t, 0);
+            if (bp != 666) addBreakPoint(bp);
+        }
+        else {
+            coalesceAtTimePopn(t, 0);
+        }
+    }
+}
+
+static void resetTestTree(void) {
+    freeTree(NULL);
+    alleleNumber = totNodeNumber = breakNumber = 0;
+    popnSizes[0] = 0;
+    freeActiveMaterial(&activeMaterialSegments);
+    initializeActiveMaterial(&activeMaterialSegments, nSites);
+}
+
+static char *simulatedGenotypes(int bitsets) {
+    char fileName[64];
+    char *data = calloc(1, 1 << 16);
+    int savedStdout, fd;
+    FILE *f;
+
+    simulateTestTree();
+    theta = 30;
+    leafBitsetMode = bitsets;
+    dropMutations();
+
+    snprintf(fileName, sizeof(fileName), "/tmp/test_genotypes_%d.txt", getpid());
+    fflush(stdout);
+    savedStdout = dup(STDOUT_FILENO);
+    fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    makeGametesMS(0, NULL);
+    outputSubmit();
+    fflush(stdout);
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+
+    f = fopen(fileName, "r");
+    fread(data, 1, (1 << 16) - 1, f);
+    fclose(f);
+    unlink(fileName);
+
+    leafBitsetMode = 0;
+    resetTestTree();
+    return data;
+}
+
+// Carriers found from leaf bitsets match mutations pushed down to the leaves
+void test_leaf_bitsets_match_pushed_down_genotypes(void) {
+    char *pushed = simulatedGenotypes(0);
+    char *bitsets = simulatedGenotypes(1);
+
+    TEST_ASSERT_NOT_NULL(strstr(pushed, "positions: "));
+    TEST_ASSERT_EQUAL_STRING(pushed, bitsets);
+    free(pushed);
+    free(bitsets);
+}
+
+// Mutations placed from the polymorphic segments never land where the branch
+// is fixed or not ancestral
+void test_segment_mutations_land_on_polymorphic_sites(void) {
+    int i, j, placed = 0;
+
+    simulateTestTree();
+    theta = 200;
+    segmentMutationMode = 1;
+    leafBitsetMode = 1;
+    dropMutations();
+    for (i = 0; i < totNodeNumber; i++) {
+        for (j = 0; j < allNodes[i]->mutationNumber; j++) {
+            TEST_ASSERT_EQUAL(1, isAncestralHere(allNodes[i], allNodes[i]->muts[j]));
+            placed++;
+        }
+    }
+    TEST_ASSERT_TRUE(placed > 0);
+    segmentMutationMode = 0;
+    leafBitsetMode = 0;
+    resetTestTree();
+}
+
+// The tree iterator links each lineage to the parent that carries it at every
+// site, with the same root as the node-by-node search
+void test_marginal_trees_follow_ancestry(void) {
+    MarginalTrees mt;
+    rootedNode *node, *parent;
+    int i, bp, trees = 0;
+    float site;
+
+    simulateTestTree();
+    memset(&mt, 0, sizeof(mt));
+    marginalTreesInit(&mt);
+    while (marginalTreesNext(&mt)) {
+        trees++;
+        for (bp = mt.left; bp < mt.right; bp++) {
+            site = (bp + 0.5) / nSites;
+            TEST_ASSERT_EQUAL(findRootAtSite(site), marginalTreeRoot(&mt));
+            for (i = 0; i < totNodeNumber; i++) {
+                node = allNodes[i];
+                if (!hasMaterialHere(node, site) || nAncestorsHere(node, site) == sampleSize) {
+                    TEST_ASSERT_EQUAL(-1, mt.parent[i]);
+                    continue;
+                }
+                TEST_ASSERT_TRUE(mt.parent[i] >= 0);
+                parent = allNodes[mt.parent[i]];
+                TEST_ASSERT_TRUE(parent == leftParentOf(node) || parent == rightParentOf(node));
+                TEST_ASSERT_TRUE(hasMaterialHere(parent, site));
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL(nSites, mt.right);
+    TEST_ASSERT_TRUE(trees > 1);
+    marginalTreesFree(&mt);
+    resetTestTree();
+}
+
 #ifndef TEST_RUNNER_MODE
 int main(void) {
     UNITY_BEGIN();
@@ -385,6 +517,9 @@ int main(void) {
     RUN_TEST(test_siteBetweenChunks_basic);
     RUN_TEST(test_pickNodePopn_basic);
     RUN_TEST(test_nodePopnSize_count);
+    RUN_TEST(test_leaf_bitsets_match_pushed_down_genotypes);
+    RUN_TEST(test_segment_mutations_land_on_polymorphic_sites);
+    RUN_TEST(test_marginal_trees_follow_ancestry);
     
     return UNITY_END();
 }
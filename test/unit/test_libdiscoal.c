@@ -0,0 +1,362 @@
+#include "unity.h"
+#include "../../libdiscoal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifndef TEST_RUNNER_MODE
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+#endif
+
+static DiscoalParams testParams(int trees) {
+    DiscoalParams params;
+
+    memset(&params, 0, sizeof(params));
+    params.sampleSize = 10;
+    params.replicates = 3;
+    params.sites = 1000;
+    params.theta = 10.0;
+    params.rho = 10.0;
+    params.seed1 = 1234;
+    params.seed2 = 5678;
+    params.trees = trees;
+    return params;
+}
+
+typedef struct {
+    long replicates, haplotypes;
+    double positionSum;
+} SinkTotals;
+
+static int countSites(void *userData, long replicate, int segsites, const double *positions) {
+    SinkTotals *totals = userData;
+    int i;
+
+    totals->replicates++;
+    for (i = 0; i < segsites; i++) totals->positionSum += positions[i];
+    return 0;
+}
+
+static int countHaplotype(void *userData, long replicate, int sample, const char *alleles, int segsites) {
+    ((SinkTotals *) userData)->haplotypes++;
+    return 0;
+}
+
+void test_libdiscoal_pulls_each_replicate(void) {
+    DiscoalParams params = testParams(0);
+    DiscoalContext *ctx = discoalCreate(&params);
+    DiscoalReplicate rep;
+    long s1, s2;
+    int r, i, j;
+
+    TEST_ASSERT_NOT_NULL(ctx);
+    discoalSeeds(ctx, &s1, &s2);
+    TEST_ASSERT_EQUAL(1234, s1);
+    TEST_ASSERT_EQUAL(5678, s2);
+    for (r = 0; r < 3; r++) {
+        TEST_ASSERT_EQUAL(1, discoalNext(ctx, &rep));
+        TEST_ASSERT_EQUAL(r, rep.index);
+        TEST_ASSERT_EQUAL(10, rep.sampleSize);
+        TEST_ASSERT_EQUAL(0, rep.numTrees);
+        TEST_ASSERT_TRUE(rep.segsites > 0);
+        for (j = 0; j < rep.segsites; j++) {
+            TEST_ASSERT_TRUE(rep.positions[j] >= 0.0 && rep.positions[j] < 1.0);
+            if (j > 0) TEST_ASSERT_TRUE(rep.positions[j - 1] <= rep.positions[j]);
+        }
+        for (i = 0; i < rep.sampleSize * rep.segsites; i++)
+            TEST_ASSERT_TRUE(rep.haplotypes[i] == '0' || rep.haplotypes[i] == '1');
+    }
+    TEST_ASSERT_EQUAL(0, discoalNext(ctx, &rep));
+    discoalFree(ctx);
+}
+
+void test_libdiscoal_sink_sees_the_same_replicates(void) {
+    DiscoalParams params = testParams(0);
+    DiscoalContext *ctx = discoalCreate(&params);
+    DiscoalReplicate rep;
+    DiscoalSink sink;
+    SinkTotals totals;
+    double positionSum = 0.0;
+    int j;
+
+    while (discoalNext(ctx, &rep))
+        for (j = 0; j < rep.segsites; j++) positionSum += rep.positions[j];
+    discoalFree(ctx);
+
+    // a second context with the same seeds repeats the run
+    memset(&totals, 0, sizeof(totals));
+    memset(&sink, 0, sizeof(sink));
+    sink.userData = &totals;
+    sink.sites = countSites;
+    sink.haplotype = countHaplotype;
+    ctx = discoalCreate(&params);
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL(3, discoalRun(ctx, &sink));
+    discoalFree(ctx);
+    TEST_ASSERT_EQUAL(3, totals.replicates);
+    TEST_ASSERT_EQUAL(30, totals.haplotypes);
+    TEST_ASSERT_TRUE(positionSum == totals.positionSum);
+}
+
+void test_libdiscoal_trees_cover_the_locus(void) {
+    DiscoalParams params = testParams(1);
+    DiscoalContext *ctx = discoalCreate(&params);
+    DiscoalReplicate rep;
+    int k, sites, count;
+
+    count = 0;
+    while (discoalNext(ctx, &rep)) {
+        TEST_ASSERT_TRUE(rep.numTrees > 0);
+        TEST_ASSERT_EQUAL(0, rep.segsites);
+        sites = 0;
+        for (k = 0; k < rep.numTrees; k++) {
+            size_t len = strlen(rep.trees[k]);
+            TEST_ASSERT_EQUAL('(', rep.trees[k][0]);
+            TEST_ASSERT_EQUAL(';', rep.trees[k][len - 1]);
+            sites += rep.treeSites[k];
+        }
+        TEST_ASSERT_EQUAL(1000, sites);
+        count++;
+    }
+    TEST_ASSERT_EQUAL(3, count);
+    discoalFree(ctx);
+}
+
+void test_libdiscoal_takes_genotypes_with_allele_codes(void) {
+    DiscoalParams params = testParams(0);
+    DiscoalContext *ctx = discoalCreate(&params);
+    DiscoalReplicate rep;
+    double *positions, *expectedPositions;
+    char *haplotypes, *expected;
+    size_t cells, i;
+    int segsites;
+
+    TEST_ASSERT_TRUE(discoalNext(ctx, &rep));
+    segsites = rep.segsites;
+    cells = (size_t) rep.sampleSize * segsites;
+    TEST_ASSERT_TRUE(cells > 0);
+    expectedPositions = malloc(sizeof(double) * segsites);
+    expected = malloc(cells);
+    memcpy(expectedPositions, rep.positions, sizeof(double) * segsites);
+    memcpy(expected, rep.haplotypes, cells);
+    discoalFree(ctx);
+
+    ctx = discoalCreate(&params);
+    discoalAlleleCodes(ctx, 0, 1, -1);
+    TEST_ASSERT_TRUE(discoalNext(ctx, &rep));
+    TEST_ASSERT_EQUAL(1, discoalTakeGenotypes(ctx, &positions, &haplotypes));
+    TEST_ASSERT_EQUAL(0, discoalTakeGenotypes(ctx, &positions, &haplotypes));
+    // the next replicate must not write over what was taken
+    TEST_ASSERT_TRUE(discoalNext(ctx, &rep));
+    discoalFree(ctx);
+    TEST_ASSERT_EQUAL_MEMORY(expectedPositions, positions, sizeof(double) * segsites);
+    for (i = 0; i < cells; i++)
+        TEST_ASSERT_EQUAL(expected[i] == 'N' ? -1 : expected[i] - '0', haplotypes[i]);
+    free(positions);
+    free(haplotypes);
+    free(expectedPositions);
+    free(expected);
+}
+
+// every replicate's segsites, positions and haplotypes, back to back
+typedef struct {
+    char *data;
+    size_t len, cap;
+    long segsites;
+} Genotypes;
+
+static void appendBytes(Genotypes *g, const void *bytes, size_t len) {
+    if (g->len + len > g->cap) {
+        g->cap = (g->len + len) * 2;
+        g->data = realloc(g->data, g->cap);
+        TEST_ASSERT_NOT_NULL(g->data);
+    }
+    memcpy(g->data + g->len, bytes, len);
+    g->len += len;
+}
+
+static Genotypes runGenotypes(const char *line, int pushDown) {
+    const char *args[32];
+    char copy[256], *word;
+    int argc = 0;
+    Genotypes g = {NULL, 0, 0, 0};
+    DiscoalContext *ctx;
+    DiscoalReplicate rep;
+
+    strcpy(copy, line);
+    for (word = strtok(copy, " "); word != NULL; word = strtok(NULL, " "))
+        args[argc++] = word;
+    if (pushDown)
+        args[argc++] = "--push-down";
+    ctx = discoalCreateFromArgs(argc, args);
+    TEST_ASSERT_NOT_NULL_MESSAGE(ctx, line);
+    while (discoalNext(ctx, &rep)) {
+        appendBytes(&g, &rep.segsites, sizeof(rep.segsites));
+        appendBytes(&g, rep.positions, sizeof(double) * rep.segsites);
+        appendBytes(&g, rep.haplotypes, (size_t) rep.sampleSize * rep.segsites);
+        g.segsites += rep.segsites;
+    }
+    discoalFree(ctx);
+    return g;
+}
+
+// the marginal-tree sweep that finds genotypes by default must agree with
+// pushing every mutation down to the leaves, as --push-down does
+void test_libdiscoal_genotypes_match_push_down(void) {
+    const char *cases[] = {
+        "20 5 10000 -t 20 -r 20 -d 1 2",
+        "20 5 10000 -t 20 -r 20 -ws 0.01 -a 500 -N 10000 -d 3 4",
+        "20 4 10000 -t 20 -r 20 -ws 0.01 -a 500 -N 10000 -c 0.5 -d 5 6",
+        "10 5 1000 -t 5 -r 5 -g 5 100 -d 7 8",
+        "10 5 1000 -t 5 -r 5 -gr 2 50 -d 9 10",
+        "8 5 1000 -t 5 -r 5 -A 2 0 0.2 -d 11 12",
+        "10 5 1000 -t 5 -r 5 -p 2 5 5 -ed 0.5 1 0 -d 13 14",
+        "12 4 10000 -t 20 -r 20 -g 5 100 -A 3 0 0.05 -ws 0.01 -a 500 -N 10000 -d 15 16",
+    };
+    Genotypes sweep, pushed;
+    int i;
+
+    for (i = 0; i < (int) (sizeof(cases) / sizeof(cases[0])); i++) {
+        sweep = runGenotypes(cases[i], 0);
+        pushed = runGenotypes(cases[i], 1);
+        TEST_ASSERT_TRUE_MESSAGE(sweep.segsites > 0, cases[i]);
+        TEST_ASSERT_EQUAL_MESSAGE(pushed.len, sweep.len, cases[i]);
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(pushed.data, sweep.data, sweep.len, cases[i]);
+        free(sweep.data);
+        free(pushed.data);
+    }
+}
+
+void test_libdiscoal_one_context_at_a_time(void) {
+    const char *args[] = {"5", "1", "100", "-t", "2", "-d", "1", "2"};
+    DiscoalContext *ctx = discoalCreateFromArgs(8, args);
+
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_NULL(discoalCreateFromArgs(8, args));
+    discoalFree(ctx);
+    ctx = discoalCreateFromArgs(8, args);
+    TEST_ASSERT_NOT_NULL(ctx);
+    discoalFree(ctx);
+}
+
+static void *createContext(void *arg) {
+    const char *args[] = {"5", "1", "100", "-t", "2", "-d", "1", "2"};
+
+    (void) arg;
+    return discoalCreateFromArgs(8, args);
+}
+
+void test_libdiscoal_racing_creates_open_one_context(void) {
+    pthread_t threads[4];
+    void *ctx[4];
+    int i, opened = 0;
+
+    for (i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, createContext, NULL);
+    for (i = 0; i < 4; i++) {
+        pthread_join(threads[i], &ctx[i]);
+        opened += ctx[i] != NULL;
+    }
+    TEST_ASSERT_EQUAL(1, opened);
+    for (i = 0; i < 4; i++)
+        discoalFree(ctx[i]);
+}
+
+void test_libdiscoal_rejected_arguments_are_recoverable(void) {
+    const char *bad[] = {"5", "1", "100", "-t", "2", "--no-such-option"};
+    const char *good[] = {"5", "1", "100", "-t", "2", "-d", "1", "2"};
+    DiscoalContext *ctx;
+
+    TEST_ASSERT_NULL(discoalCreateFromArgs(6, bad));
+    TEST_ASSERT_EQUAL_STRING("invalid arguments", discoalError());
+    ctx = discoalCreateFromArgs(8, good);
+    TEST_ASSERT_NOT_NULL(ctx);
+    discoalFree(ctx);
+}
+
+#ifdef __GLIBC__
+// malloc, calloc, realloc and free are replaced for the whole binary; they
+// forward to glibc and count calls while countingAllocations is set
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static int countingAllocations;
+static long allocationCalls;
+
+void *malloc(size_t size) {
+    if (countingAllocations) allocationCalls++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    if (countingAllocations) allocationCalls++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (countingAllocations) allocationCalls++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (countingAllocations && ptr != NULL) allocationCalls++;
+    __libc_free(ptr);
+}
+
+// runs 200 replicates to reach the high-water marks, then counts the
+// allocator calls made by the next 100
+static long steadyStateAllocations(const char *option) {
+    const char *args[] = {"20", "300", "10000", "-t", "20", "-r", "20", "-d", "1", "2",
+                          "--keep-buffers", option};
+    DiscoalContext *ctx = discoalCreateFromArgs(option != NULL ? 12 : 11, args);
+    DiscoalReplicate rep;
+    long calls;
+    int i = 0;
+
+    TEST_ASSERT_NOT_NULL(ctx);
+    allocationCalls = 0;
+    while (discoalNext(ctx, &rep)) {
+        if (++i == 200) countingAllocations = 1;
+    }
+    countingAllocations = 0;
+    calls = allocationCalls;
+    TEST_ASSERT_EQUAL(300, i);
+    discoalFree(ctx);
+    return calls;
+}
+
+void test_libdiscoal_kept_buffers_stop_allocating(void) {
+    TEST_ASSERT_EQUAL(0, steadyStateAllocations(NULL));
+    TEST_ASSERT_EQUAL(0, steadyStateAllocations("-T"));
+    TEST_ASSERT_EQUAL(0, steadyStateAllocations("--push-down"));
+}
+#else
+void test_libdiscoal_kept_buffers_stop_allocating(void) {
+    TEST_IGNORE_MESSAGE("allocation counting needs glibc");
+}
+#endif
+
+#ifndef TEST_RUNNER_MODE
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_libdiscoal_pulls_each_replicate);
+    RUN_TEST(test_libdiscoal_sink_sees_the_same_replicates);
+    RUN_TEST(test_libdiscoal_trees_cover_the_locus);
+    RUN_TEST(test_libdiscoal_takes_genotypes_with_allele_codes);
+    RUN_TEST(test_libdiscoal_genotypes_match_push_down);
+    RUN_TEST(test_libdiscoal_one_context_at_a_time);
+    RUN_TEST(test_libdiscoal_racing_creates_open_one_context);
+    RUN_TEST(test_libdiscoal_rejected_arguments_are_recoverable);
+    RUN_TEST(test_libdiscoal_kept_buffers_stop_allocating);
+
+    return UNITY_END();
+}
+#endif
@@ -2,6 +2,7 @@
 #include "../../discoal.h"
 #include "../../discoalFunctions.h"
 #include <stdlib.h>
+#include <limits.h>
 
 #ifndef TEST_RUNNER_MODE
 void setUp(void) {
@@ -12,25 +13,21 @@ void setUp(void) {
 
 void tearDown(void) {
     // Minimal cleanup
+    exactPositionMode = 0;
 }
 #endif
 
 void test_basicNodeCreation(void) {
     // Test basic node allocation and initialization
-    rootedNode* node = (rootedNode*)malloc(sizeof(rootedNode));
+    rootedNode* node = newRootedNode(1.0, 1);
     TEST_ASSERT_NOT_NULL(node);
     
-    // Initialize basic fields that actually exist in the struct
-    node->time = 1.0;
-    node->population = 1;
-    node->mutationNumber = 0;
-    
     // Test that we can access the basic fields
-    TEST_ASSERT_EQUAL_FLOAT(1.0, node->time);
+    TEST_ASSERT_EQUAL_FLOAT(1.0, nodeTime[node->id]);
     TEST_ASSERT_EQUAL(1, node->population);
     TEST_ASSERT_EQUAL(0, node->mutationNumber);
     
-    free(node);
+    freeNodeStore();
 }
 
 void test_mutationArrayAccess(void) {
@@ -75,6 +72,39 @@ void test_simpleManualMutation(void) {
     free(node);
 }
 
+void test_exactPositions_tell_sites_apart(void) {
+    int bp[] = { 0, 1, 16777217, 123456789, 249999998, 249999999 };
+    int i, collapsed = 0;
+
+    nSites = 250000000;
+    exactPositionMode = 1;
+    for (i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL(bp[i], siteAt(siteStart(bp[i])));
+        TEST_ASSERT_EQUAL(bp[i], siteAt(siteStart(bp[i]) + 0.5 / nSites));
+    }
+    // in float arithmetic neighbouring sites this far along share a position
+    exactPositionMode = 0;
+    for (i = 0; i < 6; i++)
+        if (siteAt(siteStart(bp[i]) + 0.5 / nSites) != bp[i])
+            collapsed++;
+    TEST_ASSERT_TRUE(collapsed > 0);
+}
+
+// make WIDE_COUNTS=1: a 100000-sample replicate with more segregating sites
+// than INT_MAX / 99999 has its last row past the int range
+void test_haplotype_rows_past_int_range(void) {
+#if ANCESTRY_COUNT_BITS == 32
+    int samples = 100000, segsites = INT_MAX / (100000 - 1) + 1;
+
+    TEST_ASSERT_TRUE(samples <= ANCESTRY_COUNT_MAX);
+    TEST_ASSERT_TRUE(segsites < MAXMUTS);
+    TEST_ASSERT_TRUE(haplotypeCell(samples - 1, 0, segsites) > (size_t) INT_MAX);
+    TEST_ASSERT_TRUE(haplotypeCell(samples - 1, segsites - 1, segsites) == (size_t) samples * segsites - 1);
+#else
+    TEST_IGNORE_MESSAGE("needs make WIDE_COUNTS=1");
+#endif
+}
+
 #ifndef TEST_RUNNER_MODE
 int main(void) {
     UNITY_BEGIN();
@@ -82,6 +112,8 @@ int main(void) {
     RUN_TEST(test_basicNodeCreation);
     RUN_TEST(test_mutationArrayAccess);
     RUN_TEST(test_simpleManualMutation);
+    RUN_TEST(test_exactPositions_tell_sites_apart);
+    RUN_TEST(test_haplotype_rows_past_int_range);
     
     return UNITY_END();
 }
@@ -10,68 +10,42 @@ rootedNode* testNode;
 #ifndef TEST_RUNNER_MODE
 void setUp(void) {
     // Initialize test node (legacy test)
-    testNode = (rootedNode*)malloc(sizeof(rootedNode));
-    testNode->leftParent = NULL;
-    testNode->rightParent = NULL;
-    testNode->leftChild = NULL;
-    testNode->rightChild = NULL;
-    testNode->time = 0.0;
-    testNode->branchLength = 0.0;
-    testNode->blProb = 0.0;
-    testNode->nancSites = 0;
-    testNode->lLim = 0;
-    testNode->rLim = 0;
-    testNode->id = 0;
-    testNode->mutationNumber = 0;
-    testNode->population = 0;
+    testNode = newRootedNode(0.0, 0);
     testNode->sweepPopn = 0;
-    testNode->ndes[0] = 0;
-    testNode->ndes[1] = 0;
-    testNode->leafs = NULL;
-    testNode->times[0] = 0.0;
-    testNode->times[1] = 0.0;
 }
 
 void tearDown(void) {
     // Clean up test node
-    free(testNode);
+    freeNodeStore();
 }
 #endif
 
 void test_node_initialization(void) {
     TEST_ASSERT_NOT_NULL(testNode);
-    TEST_ASSERT_NULL(testNode->leftParent);
-    TEST_ASSERT_NULL(testNode->rightParent);
-    TEST_ASSERT_NULL(testNode->leftChild);
-    TEST_ASSERT_NULL(testNode->rightChild);
-    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, testNode->time);
-    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, testNode->branchLength);
-    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, testNode->blProb);
-    TEST_ASSERT_EQUAL(0, testNode->nancSites);
+    TEST_ASSERT_TRUE(nodeAt(testNode->id) == testNode);
+    TEST_ASSERT_NULL(leftParentOf(testNode));
+    TEST_ASSERT_NULL(rightParentOf(testNode));
+    TEST_ASSERT_NULL(leftChildOf(testNode));
+    TEST_ASSERT_NULL(rightChildOf(testNode));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, nodeTime[testNode->id]);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, nodeBranchLength[testNode->id]);
+    TEST_ASSERT_EQUAL(0, nodeNancSites[testNode->id]);
     TEST_ASSERT_EQUAL(0, testNode->lLim);
     TEST_ASSERT_EQUAL(0, testNode->rLim);
-    TEST_ASSERT_EQUAL(0, testNode->id);
     TEST_ASSERT_EQUAL(0, testNode->mutationNumber);
     TEST_ASSERT_EQUAL(0, testNode->population);
     TEST_ASSERT_EQUAL(0, testNode->sweepPopn);
-    TEST_ASSERT_EQUAL(0, testNode->ndes[0]);
-    TEST_ASSERT_EQUAL(0, testNode->ndes[1]);
-    TEST_ASSERT_NULL(testNode->leafs);
-    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, testNode->times[0]);
-    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, testNode->times[1]);
 }
 
 void test_node_set_properties(void) {
     // Set properties
-    testNode->time = 1.5;
-    testNode->branchLength = 2.0;
-    testNode->id = 1;
+    nodeTime[testNode->id] = 1.5;
+    nodeBranchLength[testNode->id] = 2.0;
     testNode->population = 2;
     
     // Verify properties
-    TEST_ASSERT_FLOAT_WITHIN(0.0001, 1.5, testNode->time);
-    TEST_ASSERT_FLOAT_WITHIN(0.0001, 2.0, testNode->branchLength);
-    TEST_ASSERT_EQUAL(1, testNode->id);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 1.5, nodeTime[testNode->id]);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 2.0, nodeBranchLength[testNode->id]);
     TEST_ASSERT_EQUAL(2, testNode->population);
 }
 
@@ -80,16 +54,45 @@ void test_newRootedNode_creation(void) {
     int popn = 7;
     rootedNode* node = newRootedNode(cTime, popn);
     TEST_ASSERT_NOT_NULL(node);
-    TEST_ASSERT_NULL(node->leftParent);
-    TEST_ASSERT_NULL(node->rightParent);
-    TEST_ASSERT_NULL(node->leftChild);
-    TEST_ASSERT_NULL(node->rightChild);
-    TEST_ASSERT_FLOAT_WITHIN(0.0001, cTime, node->time);
-    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, node->branchLength);
+    TEST_ASSERT_NULL(leftParentOf(node));
+    TEST_ASSERT_NULL(rightParentOf(node));
+    TEST_ASSERT_NULL(leftChildOf(node));
+    TEST_ASSERT_NULL(rightChildOf(node));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, cTime, nodeTime[node->id]);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, nodeBranchLength[node->id]);
     TEST_ASSERT_EQUAL(0, node->mutationNumber);
     TEST_ASSERT_EQUAL(popn, node->population);
     TEST_ASSERT_EQUAL(-1, node->sweepPopn);
-    free(node);
+    TEST_ASSERT_NULL(node->muts);
+    freeNodeStore();
+}
+
+// Nodes come from blocks that freeTree() hands out again; a recycled slot
+// must come back fully initialized
+void test_node_store_recycles_blocks(void) {
+    rootedNode *first, *node;
+    int i;
+
+    freeNodeStore();  // start from an empty store, without the fixture's node
+    first = newRootedNode(1.0, 0);
+    for (i = 0; i < NODE_BLOCK_SIZE; i++)
+        node = newRootedNode(1.0, 0);
+    TEST_ASSERT_EQUAL(2, nodeBlockCount);
+    nodeNancSites[first->id] = 5;
+    nodeLeftChild[first->id] = node->id;
+    addMutation(first, 0.5);
+
+    cleanupMuts(first);
+    resetNodeStore();
+    node = newRootedNode(2.0, 1);
+    TEST_ASSERT_TRUE(node == first);
+    TEST_ASSERT_EQUAL(0, node->id);
+    TEST_ASSERT_EQUAL(0, nodeNancSites[node->id]);
+    TEST_ASSERT_NULL(leftChildOf(node));
+    TEST_ASSERT_EQUAL(0, node->mutationNumber);
+    TEST_ASSERT_NULL(node->muts);
+    TEST_ASSERT_EQUAL(2, nodeBlockCount);
+    freeNodeStore();
 }
 
 #ifndef TEST_RUNNER_MODE
@@ -99,6 +102,7 @@ int main(void) {
     RUN_TEST(test_node_initialization);
     RUN_TEST(test_node_set_properties);
     RUN_TEST(test_newRootedNode_creation);
+    RUN_TEST(test_node_store_recycles_blocks);
     
     return UNITY_END();
 }
@@ -18,14 +18,14 @@ void test_newRootedNode(void) {
     // Test basic node creation
     rootedNode* node = newRootedNode(1.0, 1);
     TEST_ASSERT_NOT_NULL(node);
-    TEST_ASSERT_EQUAL(1.0, node->time);
+    TEST_ASSERT_EQUAL(1.0, nodeTime[node->id]);
     TEST_ASSERT_EQUAL(1, node->population);
-    TEST_ASSERT_NULL(node->leftParent);
-    TEST_ASSERT_NULL(node->rightParent);
-    TEST_ASSERT_NULL(node->leftChild);
-    TEST_ASSERT_NULL(node->rightChild);
+    TEST_ASSERT_NULL(leftParentOf(node));
+    TEST_ASSERT_NULL(rightParentOf(node));
+    TEST_ASSERT_NULL(leftChildOf(node));
+    TEST_ASSERT_NULL(rightChildOf(node));
     TEST_ASSERT_EQUAL(0, node->mutationNumber);
-    TEST_ASSERT_EQUAL(0, node->nancSites);
+    TEST_ASSERT_EQUAL(0, nodeNancSites[node->id]);
 }
 
 void test_addRemoveNode(void) {
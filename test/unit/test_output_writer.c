@@ -0,0 +1,251 @@
+#include "unity.h"
+#include "../../outputWriter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+#include <limits.h>
+
+// Test fixtures
+char testOutputFilename[256];
+int savedStdout = -1;
+
+// point stdout at the test file; Unity itself prints to stdout so it is put
+// back before any assertion
+static void redirectStdout(void) {
+    int fd;
+
+    fflush(stdout);
+    savedStdout = dup(STDOUT_FILENO);
+    fd = open(testOutputFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+}
+
+static void restoreStdout(void) {
+    fflush(stdout);
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+    savedStdout = -1;
+}
+
+static char *readOutputFile(void) {
+    FILE *f = fopen(testOutputFilename, "r");
+    char *data = calloc(1, 1 << 20);
+
+    fread(data, 1, (1 << 20) - 1, f);
+    fclose(f);
+    return data;
+}
+
+#ifndef TEST_RUNNER_MODE
+void setUp(void) {
+    snprintf(testOutputFilename, sizeof(testOutputFilename),
+             "/tmp/test_output_%d.txt", getpid());
+}
+
+void tearDown(void) {
+    unlink(testOutputFilename);
+}
+#endif
+
+void test_output_sync_formats_in_order(void) {
+    char *data;
+
+    redirectStdout();
+    outputPrintf("segsites: %d", 3);
+    outputPutc('\n');
+    outputWrite("0101\n", 5);
+    outputSubmit();
+    outputPrintf("%6.6lf ", 0.25);
+    outputClose();
+    restoreStdout();
+
+    data = readOutputFile();
+    TEST_ASSERT_EQUAL_STRING("segsites: 3\n0101\n0.250000 ", data);
+    free(data);
+}
+
+void test_output_grows_past_initial_buffer(void) {
+    char *data;
+    int i;
+
+    redirectStdout();
+    for (i = 0; i < 20000; i++) outputPrintf("%04d,", i % 10000);
+    outputClose();
+    restoreStdout();
+
+    data = readOutputFile();
+    TEST_ASSERT_EQUAL(100000, strlen(data));
+    TEST_ASSERT_EQUAL(0, strncmp(data + 99995, "9999,", 5));
+    free(data);
+}
+
+void test_output_fixed_matches_printf(void) {
+    static const double special[] = { 0.0, -0.0, 0.5, 1.5, 2.5, 0.125, 0.0000005, 0.0000015,
+                                      0.9999995, 0.99999949999, 123456.0000005, 1e13, 1e300,
+                                      -2.25, 1.0 / 3.0, 2.0 / 3.0 };
+    static const long ints[] = { 0, 7, -7, 1234567890L, LONG_MAX, LONG_MIN };
+    char *data, *expected = malloc(1 << 20);
+    int i, digits, len = 0;
+    double x;
+
+    redirectStdout();
+    for (digits = 0; digits <= 10; digits++)
+        for (i = 0; i < 16; i++) {
+            len += sprintf(expected + len, "%.*f ", digits, special[i]);
+            outputFixed(special[i], digits);
+            outputPutc(' ');
+        }
+    // positions, branch lengths and values on the decimal grid
+    srand(12345);
+    for (i = 0; i < 12000; i++) {
+        x = (double) rand() / RAND_MAX;
+        if (i % 3 == 1) x *= 1000.0;
+        if (i % 3 == 2) x = (rand() % 2000000) / 2e6;
+        digits = 6 + i % 5;
+        len += sprintf(expected + len, "%.*f ", digits, x);
+        outputFixed(x, digits);
+        outputPutc(' ');
+    }
+    for (i = 0; i < 6; i++) {
+        len += sprintf(expected + len, "%ld ", ints[i]);
+        outputInt(ints[i]);
+        outputPutc(' ');
+    }
+    outputClose();
+    restoreStdout();
+
+    data = readOutputFile();
+    TEST_ASSERT_EQUAL_STRING(expected, data);
+    free(data);
+    free(expected);
+}
+
+void test_output_async_matches_sync(void) {
+    char *data, expected[4096];
+    int i, len = 0;
+
+    for (i = 0; i < 200; i++) len += sprintf(expected + len, "%d\n", i);
+
+    redirectStdout();
+    outputInit(1, 2);
+    for (i = 0; i < 200; i++) {
+        outputPrintf("%d\n", i);
+        outputSubmit();
+    }
+    outputDrain();
+    TEST_ASSERT_EQUAL(0, outputClose());
+    restoreStdout();
+
+    data = readOutputFile();
+    TEST_ASSERT_EQUAL_STRING(expected, data);
+    free(data);
+}
+
+void test_output_gzip_blocks_and_index(void) {
+    char indexName[300], expected[4096], data[8192], line[256];
+    gzFile gz;
+    FILE *idx;
+    long first, count, offset, nextOffset = 0, replicates = 0;
+    size_t packed, len;
+    int i, n, blocks = 0, explen = 0;
+
+    snprintf(indexName, sizeof(indexName), "%s.idx", testOutputFilename);
+    explen = sprintf(expected, "header\n");
+    for (i = 0; i < 10; i++) explen += sprintf(expected + explen, "replicate %d\n", i);
+
+    redirectStdout();
+    outputSetCompression(OUTPUT_GZIP, 3, 2);
+    TEST_ASSERT_EQUAL(1, outputOpenIndex(indexName, 0));
+    outputInit(0, 0);
+    outputPrintf("header\n");
+    outputEndBlock();
+    for (i = 0; i < 10; i++) {
+        outputPrintf("replicate %d\n", i);
+        outputSubmit();
+        // an empty submit, as for a rejected -C replicate, is not counted
+        outputSubmit();
+    }
+    TEST_ASSERT_EQUAL(0, outputClose());
+    restoreStdout();
+
+    // concatenated gzip members read back as one stream
+    gz = gzopen(testOutputFilename, "rb");
+    n = gzread(gz, data, sizeof(data) - 1);
+    gzclose(gz);
+    TEST_ASSERT_EQUAL(explen, n);
+    data[n] = '\0';
+    TEST_ASSERT_EQUAL_STRING(expected, data);
+
+    // header block plus blocks of 3, 3, 3 and 1 replicates, back to back
+    idx = fopen(indexName, "r");
+    while (fgets(line, sizeof(line), idx) != NULL) {
+        if (line[0] == '#') continue;
+        TEST_ASSERT_EQUAL(5, sscanf(line, "%ld %ld %ld %zu %zu", &first, &count, &offset, &packed, &len));
+        TEST_ASSERT_EQUAL(replicates, first);
+        TEST_ASSERT_EQUAL(nextOffset, offset);
+        replicates += count;
+        nextOffset += packed;
+        blocks++;
+    }
+    fclose(idx);
+    unlink(indexName);
+    TEST_ASSERT_EQUAL(5, blocks);
+    TEST_ASSERT_EQUAL(10, replicates);
+}
+
+// a write that failed before the close is reported even when the final
+// fflush succeeds, and only once however often outputClose() runs
+void test_output_failed_write_is_reported_once(void) {
+    static char block[1 << 16];
+    char *errors, *first;
+    int fd, savedStderr, closed, closedAgain;
+
+    memset(block, '0', sizeof(block));
+    fflush(stderr);
+    savedStderr = dup(STDERR_FILENO);
+    redirectStdout();
+    // stderr goes to the output file, stdout to /dev/full for the write
+    dup2(STDOUT_FILENO, STDERR_FILENO);
+    fd = open("/dev/full", O_WRONLY);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    outputWrite(block, sizeof(block));
+    outputSubmit();
+    fd = open("/dev/null", O_WRONLY);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    closed = outputClose();
+    closedAgain = outputClose();
+    clearerr(stdout);
+    fflush(stderr);
+    dup2(savedStderr, STDERR_FILENO);
+    close(savedStderr);
+    restoreStdout();
+
+    TEST_ASSERT_EQUAL(-1, closed);
+    TEST_ASSERT_EQUAL(-1, closedAgain);
+    errors = readOutputFile();
+    first = strstr(errors, "Error: writing output failed");
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_NULL(strstr(first + 1, "Error: writing output failed"));
+    free(errors);
+}
+
+#ifndef TEST_RUNNER_MODE
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_output_sync_formats_in_order);
+    RUN_TEST(test_output_grows_past_initial_buffer);
+    RUN_TEST(test_output_fixed_matches_printf);
+    RUN_TEST(test_output_async_matches_sync);
+    RUN_TEST(test_output_gzip_blocks_and_index);
+    RUN_TEST(test_output_failed_write_is_reported_once);
+
+    return UNITY_END();
+}
+#endif
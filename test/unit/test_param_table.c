@@ -0,0 +1,85 @@
+#include "unity.h"
+#include "../../discoal.h"
+#include "../../paramTable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Test fixtures
+char testParamTableFilename[256];
+
+#ifndef TEST_RUNNER_MODE
+void setUp(void) {
+    snprintf(testParamTableFilename, sizeof(testParamTableFilename),
+             "/tmp/test_param_table_%d.txt", getpid());
+}
+
+void tearDown(void) {
+    paramTableFree();
+    unlink(testParamTableFilename);
+}
+#endif
+
+static void writeTable(const char *text) {
+    FILE *f = fopen(testParamTableFilename, "w");
+
+    TEST_ASSERT_NOT_NULL(f);
+    fputs(text, f);
+    fclose(f);
+}
+
+void test_paramTable_reads_named_columns(void) {
+    writeTable("# two draws\ntheta\ttau   e1time\n10 0.05 0.2\n\n20 0.1 0.4\n");
+
+    TEST_ASSERT_EQUAL(1, paramTableLoad(testParamTableFilename));
+    TEST_ASSERT_EQUAL(2, paramTableRows());
+    TEST_ASSERT_TRUE(paramTableHasColumn("theta"));
+    TEST_ASSERT_TRUE(paramTableHasColumn("e1time"));
+    TEST_ASSERT_FALSE(paramTableHasColumn("rho"));
+}
+
+void test_paramTable_rows_become_point_priors(void) {
+    writeTable("theta rho tau e1time\n10 2 0.05 0.2\n20 4 0.1 0.4\n");
+    priorTheta = priorRho = priorTau = 0;
+
+    TEST_ASSERT_EQUAL(1, paramTableLoad(testParamTableFilename));
+    paramTableApply(1);
+    TEST_ASSERT_EQUAL(1, priorTheta);
+    TEST_ASSERT_EQUAL(1, priorRho);
+    TEST_ASSERT_EQUAL(1, priorTau);
+    TEST_ASSERT_TRUE(pThetaLow == 20.0 && pThetaUp == 20.0);
+    TEST_ASSERT_TRUE(pRhoLow == 4.0 && pRhoUp == 4.0);
+    // times are in the command line's units, stored doubled like -ws and -Pe1
+    TEST_ASSERT_TRUE(pTauLow == 0.2 && pTauUp == 0.2);
+    TEST_ASSERT_TRUE(pE1TLow == 0.8 && pE1THigh == 0.8);
+}
+
+void test_paramTable_rejects_malformed_files(void) {
+    writeTable("theta omega\n1 2\n");
+    TEST_ASSERT_EQUAL(0, paramTableLoad(testParamTableFilename));
+    writeTable("theta theta\n1 2\n");
+    TEST_ASSERT_EQUAL(0, paramTableLoad(testParamTableFilename));
+    writeTable("theta rho\n1 2\n3\n");
+    TEST_ASSERT_EQUAL(0, paramTableLoad(testParamTableFilename));
+    writeTable("theta rho\n1 2 3\n");
+    TEST_ASSERT_EQUAL(0, paramTableLoad(testParamTableFilename));
+    writeTable("theta rho\n1 x\n");
+    TEST_ASSERT_EQUAL(0, paramTableLoad(testParamTableFilename));
+    writeTable("# only a comment\n");
+    TEST_ASSERT_EQUAL(0, paramTableLoad(testParamTableFilename));
+    TEST_ASSERT_EQUAL(0, paramTableRows());
+    TEST_ASSERT_EQUAL(0, paramTableLoad("/nonexistent/table.txt"));
+}
+
+#ifndef TEST_RUNNER_MODE
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_paramTable_reads_named_columns);
+    RUN_TEST(test_paramTable_rows_become_point_priors);
+    RUN_TEST(test_paramTable_rejects_malformed_files);
+
+    return UNITY_END();
+}
+#endif
@@ -0,0 +1,93 @@
+#include "unity.h"
+#include "../../ranlib.h"
+#include "../../rngSamplers.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef TEST_RUNNER_MODE
+void setUp(void) {
+    rngBackend = RNG_XOSHIRO;
+    setall(12345, 67890);
+}
+
+void tearDown(void) {
+    rngBackend = RNG_RANLIB;
+}
+#endif
+
+void test_samplerExp_moments(void) {
+    uint64_t s[4];
+    double x, sum = 0.0, sumSq = 0.0;
+    long i, n = 1000000;
+
+    xoshiroSeed(s, 1, 2, 0);
+    for (i = 0; i < n; i++) {
+        x = samplerExp(s);
+        TEST_ASSERT_TRUE(x >= 0.0);
+        sum += x;
+        sumSq += x * x;
+    }
+    // mean and variance 1; five standard errors
+    TEST_ASSERT_FLOAT_WITHIN(0.005, 1.0, sum / n);
+    TEST_ASSERT_FLOAT_WITHIN(0.03, 1.0, sumSq / n - (sum / n) * (sum / n));
+}
+
+void test_samplerPoisson_moments_small_and_large_means(void) {
+    const double mus[] = { 0.01, 2.5, 9.9, 10.0, 40.0, 5000.0 };
+    uint64_t s[4];
+    double k, sum, sumSq;
+    long i, n = 400000;
+    int m;
+
+    xoshiroSeed(s, 3, 4, 0);
+    for (m = 0; m < 6; m++) {
+        sum = sumSq = 0.0;
+        for (i = 0; i < n; i++) {
+            k = samplerPoisson(s, mus[m]);
+            TEST_ASSERT_TRUE(k >= 0);
+            sum += k;
+            sumSq += k * k;
+        }
+        // mean and variance mu
+        TEST_ASSERT_FLOAT_WITHIN(5 * sqrt(mus[m] / n), mus[m], sum / n);
+        TEST_ASSERT_FLOAT_WITHIN(5 * sqrt((mus[m] + 2 * mus[m] * mus[m]) / n), mus[m], sumSq / n - (sum / n) * (sum / n));
+    }
+}
+
+void test_ranlib_entry_points_use_samplers_under_xoshiro(void) {
+    uint64_t saved[4], s[4];
+    long counts[4];
+    double waits[4];
+    int i;
+
+    getxs(saved);
+    for (i = 0; i < 4; i++) waits[i] = genexp(2.0);
+    for (i = 0; i < 4; i++) counts[i] = ignpoi(0.5 + 10 * i);
+    setxs(saved);
+    getxs(s);
+    for (i = 0; i < 4; i++) TEST_ASSERT_TRUE(waits[i] == 2.0 * samplerExp(s));
+    for (i = 0; i < 4; i++) TEST_ASSERT_EQUAL(counts[i], samplerPoisson(s, 0.5 + 10 * i));
+
+    // the bulk fills give the same draws
+    setxs(saved);
+    fillexp(waits, 4, 2.0);
+    getxs(s);
+    setxs(saved);
+    for (i = 0; i < 4; i++) TEST_ASSERT_TRUE(waits[i] == genexp(2.0));
+    fillpoi(counts, 4, 20.0);
+    setxs(s);
+    for (i = 0; i < 4; i++) TEST_ASSERT_EQUAL(counts[i], ignpoi(20.0));
+}
+
+#ifndef TEST_RUNNER_MODE
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_samplerExp_moments);
+    RUN_TEST(test_samplerPoisson_moments_small_and_large_means);
+    RUN_TEST(test_ranlib_entry_points_use_samplers_under_xoshiro);
+
+    return UNITY_END();
+}
+#endif
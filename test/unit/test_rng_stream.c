@@ -0,0 +1,108 @@
+#include "unity.h"
+#include "../../rngStream.h"
+#include "../../ranlib.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+extern long Xm1, Xm2, Xa1, Xa2, Xa1w, Xa2w;
+
+#ifndef TEST_RUNNER_MODE
+void setUp(void) {
+    setall(12345, 67890);
+}
+
+void tearDown(void) {
+    rngBackend = RNG_RANLIB;
+}
+#endif
+
+void test_rngPowMod_matches_ranlib_constants(void) {
+    // ranlib precomputes a^(2^30) mod m for its own generator splitting
+    TEST_ASSERT_EQUAL(Xa1w, rngPowMod(Xa1, 1L << 30, Xm1));
+    TEST_ASSERT_EQUAL(Xa2w, rngPowMod(Xa2, 1L << 30, Xm2));
+    TEST_ASSERT_EQUAL(1, rngPowMod(Xa1, 0, Xm1));
+}
+
+void test_seedReplicateStream_zero_is_base_stream(void) {
+    long s1, s2;
+
+    seedReplicateStream(12345, 67890, 0);
+    getsd(&s1, &s2);
+    TEST_ASSERT_EQUAL(12345, s1);
+    TEST_ASSERT_EQUAL(67890, s2);
+}
+
+void test_seedReplicateStream_jumps_compose(void) {
+    long a1, a2, b1, b2;
+    double expected[5];
+    int i;
+
+    // replicate 3 of a run is replicate 1 of the run starting at replicate 2
+    seedReplicateStream(12345, 67890, 2);
+    getsd(&a1, &a2);
+    seedReplicateStream(a1, a2, 1);
+    getsd(&b1, &b2);
+    for (i = 0; i < 5; i++) expected[i] = ranf();
+
+    seedReplicateStream(12345, 67890, 3);
+    getsd(&a1, &a2);
+    TEST_ASSERT_EQUAL(b1, a1);
+    TEST_ASSERT_EQUAL(b2, a2);
+    for (i = 0; i < 5; i++) TEST_ASSERT_TRUE(expected[i] == ranf());
+}
+
+void test_xoshiro_backend_drives_ranf_and_streams(void) {
+    RngStream rs;
+    uint64_t saved[4];
+    double bulk[5];
+    int i;
+
+    rngBackend = RNG_XOSHIRO;
+    setall(12345, 67890);
+    rngStreamCapture(&rs);
+    getxs(saved);
+    for (i = 0; i < 5; i++) {
+        bulk[i] = ranf();
+        TEST_ASSERT_TRUE(bulk[i] > 0.0 && bulk[i] < 1.0);
+        TEST_ASSERT_TRUE(bulk[i] == rngStreamRanf(&rs));
+    }
+    // the bulk fill draws the same values as ranf()
+    setxs(saved);
+    fillunf(bulk, 5);
+    rngStreamCapture(&rs);
+    setxs(saved);
+    for (i = 0; i < 5; i++) TEST_ASSERT_TRUE(bulk[i] == ranf());
+    TEST_ASSERT_TRUE(ranf() == rngStreamRanf(&rs));
+
+    // and differ from the ranlib stream of the same seeds
+    rngBackend = RNG_RANLIB;
+    setall(12345, 67890);
+    TEST_ASSERT_FALSE(bulk[0] == ranf());
+}
+
+void test_xoshiro_replicate_streams(void) {
+    double first[3];
+    int i;
+
+    rngBackend = RNG_XOSHIRO;
+    setall(12345, 67890);
+    for (i = 0; i < 3; i++) first[i] = ranf();
+    seedReplicateStream(12345, 67890, 0);
+    for (i = 0; i < 3; i++) TEST_ASSERT_TRUE(first[i] == ranf());
+    seedReplicateStream(12345, 67890, 1);
+    TEST_ASSERT_FALSE(first[0] == ranf());
+}
+
+#ifndef TEST_RUNNER_MODE
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_rngPowMod_matches_ranlib_constants);
+    RUN_TEST(test_seedReplicateStream_zero_is_base_stream);
+    RUN_TEST(test_seedReplicateStream_jumps_compose);
+    RUN_TEST(test_xoshiro_backend_drives_ranf_and_streams);
+    RUN_TEST(test_xoshiro_replicate_streams);
+
+    return UNITY_END();
+}
+#endif
@@ -3,6 +3,7 @@
 #include "../../discoal.h"
 #include "../../discoalFunctions.h"
 #include "../../ranlib.h"
+#include "../../paramTable.h"
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -19,6 +20,7 @@ extern ActiveMaterial testActiveMaterial;
 void test_node_initialization(void);
 void test_node_set_properties(void);
 void test_newRootedNode_creation(void);
+void test_node_store_recycles_blocks(void);
 
 // From test_event.c
 void test_event_initialization(void);
@@ -34,6 +36,8 @@ void test_nodePopnSize(void);
 void test_basicNodeCreation(void);
 void test_mutationArrayAccess(void);
 void test_simpleManualMutation(void);
+void test_exactPositions_tell_sites_apart(void);
+void test_haplotype_rows_past_int_range(void);
 
 // From test_ancestry_segment.c
 void test_newSegment_creates_valid_segment(void);
@@ -46,9 +50,11 @@ void test_getAncestryCount_multiple_segments(void);
 void test_copySegmentTree_creates_independent_copy(void);
 void test_null_safety(void);
 void test_mergeAncestryTrees_non_overlapping(void);
+void test_mergeAncestryTrees_counts_reach_type_limit(void);
 void test_splitLeft_basic(void);
 void test_splitRight_basic(void);
 void test_split_edge_cases(void);
+void test_released_segments_are_reused(void);
 
 // From test_active_segment.c
 void test_initializeActiveMaterial_all_sites_active(void);
@@ -77,6 +83,9 @@ void test_mmapAcceptedTrajectory_read_only(void);
 void test_trajectory_filename_generation(void);
 void test_multiple_trajectory_cleanup(void);
 void test_trajectory_file_persistence(void);
+void test_replayed_trajectory_matches_stored(void);
+void test_speculative_proposals_are_deterministic(void);
+void test_adaptive_steps_respect_tolerance(void);
 
 // From test_coalescence_recombination.c
 void test_coalesceAtTimePopn_basic(void);
@@ -90,6 +99,9 @@ void test_updateActiveMaterial_basic(void);
 void test_siteBetweenChunks_basic(void);
 void test_pickNodePopn_basic(void);
 void test_nodePopnSize_count(void);
+void test_leaf_bitsets_match_pushed_down_genotypes(void);
+void test_segment_mutations_land_on_polymorphic_sites(void);
+void test_marginal_trees_follow_ancestry(void);
 
 // From test_memory_management.c
 void test_initializeBreakPoints_basic(void);
@@ -110,32 +122,56 @@ void test_reinitialize_breakPoints(void);
 void test_cleanup_null_safety(void);
 void test_integrated_memory_usage(void);
 
+// From test_checkpoint.c
+void test_checkpointArgsKey_strips_checkpoint_flags(void);
+void test_checkpoint_roundtrip(void);
+void test_readCheckpoint_missing_and_malformed(void);
+void test_checkpoint_rng_state_resumes_stream(void);
+
+// From test_rng_stream.c
+void test_rngPowMod_matches_ranlib_constants(void);
+void test_seedReplicateStream_zero_is_base_stream(void);
+void test_seedReplicateStream_jumps_compose(void);
+void test_xoshiro_backend_drives_ranf_and_streams(void);
+void test_xoshiro_replicate_streams(void);
+
+// From test_rng_samplers.c
+void test_samplerExp_moments(void);
+void test_samplerPoisson_moments_small_and_large_means(void);
+void test_ranlib_entry_points_use_samplers_under_xoshiro(void);
+
+// From test_param_table.c
+void test_paramTable_reads_named_columns(void);
+void test_paramTable_rows_become_point_priors(void);
+void test_paramTable_rejects_malformed_files(void);
+
+// From test_output_writer.c
+void test_output_sync_formats_in_order(void);
+void test_output_grows_past_initial_buffer(void);
+void test_output_fixed_matches_printf(void);
+void test_output_async_matches_sync(void);
+void test_output_gzip_blocks_and_index(void);
+void test_output_failed_write_is_reported_once(void);
+
+// From test_libdiscoal.c
+void test_libdiscoal_pulls_each_replicate(void);
+void test_libdiscoal_sink_sees_the_same_replicates(void);
+void test_libdiscoal_trees_cover_the_locus(void);
+void test_libdiscoal_takes_genotypes_with_allele_codes(void);
+void test_libdiscoal_genotypes_match_push_down(void);
+void test_libdiscoal_one_context_at_a_time(void);
+void test_libdiscoal_racing_creates_open_one_context(void);
+void test_libdiscoal_rejected_arguments_are_recoverable(void);
+void test_libdiscoal_kept_buffers_stop_allocating(void);
+
 // Per-suite setup/teardown functions
 void setUp_node(void) {
-    testNode = (rootedNode*)malloc(sizeof(rootedNode));
-    testNode->leftParent = NULL;
-    testNode->rightParent = NULL;
-    testNode->leftChild = NULL;
-    testNode->rightChild = NULL;
-    testNode->time = 0.0;
-    testNode->branchLength = 0.0;
-    testNode->blProb = 0.0;
-    testNode->nancSites = 0;
-    testNode->lLim = 0;
-    testNode->rLim = 0;
-    testNode->id = 0;
-    testNode->mutationNumber = 0;
-    testNode->population = 0;
+    testNode = newRootedNode(0.0, 0);
     testNode->sweepPopn = 0;
-    testNode->ndes[0] = 0;
-    testNode->ndes[1] = 0;
-    testNode->leafs = NULL;
-    testNode->times[0] = 0.0;
-    testNode->times[1] = 0.0;
 }
 
 void tearDown_node(void) {
-    free(testNode);
+    freeNodeStore();
 }
 
 void setUp_event(void) {
@@ -169,7 +205,7 @@ void setUp_mutations(void) {
 }
 
 void tearDown_mutations(void) {
-    // Nothing specific to tear down
+    exactPositionMode = 0;
 }
 
 void setUp_ancestry_segment(void) {
@@ -279,19 +315,17 @@ void tearDown_coalescence_recombination(void) {
     // Clean up test nodes
     if (testNode1) {
         cleanupMuts(testNode1);
-        free(testNode1);
     }
     if (testNode2) {
         cleanupMuts(testNode2);
-        free(testNode2);
     }
     if (testNode3) {
         cleanupMuts(testNode3);
-        free(testNode3);
     }
     
     // Clean up node arrays
     cleanupNodeArrays();
+    freeNodeStore();
     cleanupBreakPoints();
     freeActiveMaterial(&activeMaterialSegments);
     
@@ -345,6 +379,67 @@ void tearDown_memory_management(void) {
     allNodesCapacity = originalAllNodesCapacity;
 }
 
+// External for checkpoint tests
+extern char testCheckpointFilename[256];
+
+void setUp_checkpoint(void) {
+    snprintf(testCheckpointFilename, sizeof(testCheckpointFilename),
+             "/tmp/test_checkpoint_%d.ckpt", getpid());
+    setall(12345, 67890);
+}
+
+void tearDown_checkpoint(void) {
+    unlink(testCheckpointFilename);
+}
+
+void setUp_rng_stream(void) {
+    setall(12345, 67890);
+}
+
+void tearDown_rng_stream(void) {
+    rngBackend = RNG_RANLIB;
+}
+
+void setUp_rng_samplers(void) {
+    rngBackend = RNG_XOSHIRO;
+    setall(12345, 67890);
+}
+
+void tearDown_rng_samplers(void) {
+    rngBackend = RNG_RANLIB;
+}
+
+// External for parameter table tests
+extern char testParamTableFilename[256];
+
+void setUp_param_table(void) {
+    snprintf(testParamTableFilename, sizeof(testParamTableFilename),
+             "/tmp/test_param_table_%d.txt", getpid());
+}
+
+void tearDown_param_table(void) {
+    paramTableFree();
+    unlink(testParamTableFilename);
+}
+
+// External for output writer tests
+extern char testOutputFilename[256];
+
+void setUp_output_writer(void) {
+    snprintf(testOutputFilename, sizeof(testOutputFilename),
+             "/tmp/test_output_%d.txt", getpid());
+}
+
+void tearDown_output_writer(void) {
+    unlink(testOutputFilename);
+}
+
+void setUp_libdiscoal(void) {
+}
+
+void tearDown_libdiscoal(void) {
+}
+
 // Global setUp and tearDown that dispatch to appropriate suite functions
 void (*current_setUp)(void) = NULL;
 void (*current_tearDown)(void) = NULL;
@@ -370,6 +465,7 @@ int main(void) {
     RUN_TEST(test_node_initialization);
     RUN_TEST(test_node_set_properties);
     RUN_TEST(test_newRootedNode_creation);
+    RUN_TEST(test_node_store_recycles_blocks);
     
     printf("\n========== Running Event Tests ==========\n");
     current_setUp = setUp_event;
@@ -391,6 +487,8 @@ int main(void) {
     RUN_TEST(test_basicNodeCreation);
     RUN_TEST(test_mutationArrayAccess);
     RUN_TEST(test_simpleManualMutation);
+    RUN_TEST(test_exactPositions_tell_sites_apart);
+    RUN_TEST(test_haplotype_rows_past_int_range);
     
     printf("\n========== Running Ancestry Segment Tests ==========\n");
     current_setUp = setUp_ancestry_segment;
@@ -405,9 +503,11 @@ int main(void) {
     RUN_TEST(test_copySegmentTree_creates_independent_copy);
     RUN_TEST(test_null_safety);
     RUN_TEST(test_mergeAncestryTrees_non_overlapping);
+    RUN_TEST(test_mergeAncestryTrees_counts_reach_type_limit);
     RUN_TEST(test_splitLeft_basic);
     RUN_TEST(test_splitRight_basic);
     RUN_TEST(test_split_edge_cases);
+    RUN_TEST(test_released_segments_are_reused);
     
     printf("\n========== Running Active Segment Tests ==========\n");
     current_setUp = setUp_active_segment;
@@ -440,6 +540,9 @@ int main(void) {
     RUN_TEST(test_trajectory_filename_generation);
     RUN_TEST(test_multiple_trajectory_cleanup);
     RUN_TEST(test_trajectory_file_persistence);
+    RUN_TEST(test_replayed_trajectory_matches_stored);
+    RUN_TEST(test_speculative_proposals_are_deterministic);
+    RUN_TEST(test_adaptive_steps_respect_tolerance);
     
     printf("\n========== Running Coalescence/Recombination Tests ==========\n");
     current_setUp = setUp_coalescence_recombination;
@@ -455,6 +558,9 @@ int main(void) {
     RUN_TEST(test_siteBetweenChunks_basic);
     RUN_TEST(test_pickNodePopn_basic);
     RUN_TEST(test_nodePopnSize_count);
+    RUN_TEST(test_leaf_bitsets_match_pushed_down_genotypes);
+    RUN_TEST(test_segment_mutations_land_on_polymorphic_sites);
+    RUN_TEST(test_marginal_trees_follow_ancestry);
     
     printf("\n========== Running Memory Management Tests ==========\n");
     current_setUp = setUp_memory_management;
@@ -477,5 +583,59 @@ int main(void) {
     RUN_TEST(test_cleanup_null_safety);
     RUN_TEST(test_integrated_memory_usage);
     
+    printf("\n========== Running Checkpoint Tests ==========\n");
+    current_setUp = setUp_checkpoint;
+    current_tearDown = tearDown_checkpoint;
+    RUN_TEST(test_checkpointArgsKey_strips_checkpoint_flags);
+    RUN_TEST(test_checkpoint_roundtrip);
+    RUN_TEST(test_readCheckpoint_missing_and_malformed);
+    RUN_TEST(test_checkpoint_rng_state_resumes_stream);
+    
+    printf("\n========== Running RNG Stream Tests ==========\n");
+    current_setUp = setUp_rng_stream;
+    current_tearDown = tearDown_rng_stream;
+    RUN_TEST(test_rngPowMod_matches_ranlib_constants);
+    RUN_TEST(test_seedReplicateStream_zero_is_base_stream);
+    RUN_TEST(test_seedReplicateStream_jumps_compose);
+    RUN_TEST(test_xoshiro_backend_drives_ranf_and_streams);
+    RUN_TEST(test_xoshiro_replicate_streams);
+    
+    printf("\n========== Running RNG Sampler Tests ==========\n");
+    current_setUp = setUp_rng_samplers;
+    current_tearDown = tearDown_rng_samplers;
+    RUN_TEST(test_samplerExp_moments);
+    RUN_TEST(test_samplerPoisson_moments_small_and_large_means);
+    RUN_TEST(test_ranlib_entry_points_use_samplers_under_xoshiro);
+    
+    printf("\n========== Running Parameter Table Tests ==========\n");
+    current_setUp = setUp_param_table;
+    current_tearDown = tearDown_param_table;
+    RUN_TEST(test_paramTable_reads_named_columns);
+    RUN_TEST(test_paramTable_rows_become_point_priors);
+    RUN_TEST(test_paramTable_rejects_malformed_files);
+    
+    printf("\n========== Running Output Writer Tests ==========\n");
+    current_setUp = setUp_output_writer;
+    current_tearDown = tearDown_output_writer;
+    RUN_TEST(test_output_sync_formats_in_order);
+    RUN_TEST(test_output_grows_past_initial_buffer);
+    RUN_TEST(test_output_fixed_matches_printf);
+    RUN_TEST(test_output_async_matches_sync);
+    RUN_TEST(test_output_gzip_blocks_and_index);
+    RUN_TEST(test_output_failed_write_is_reported_once);
+    
+    printf("\n========== Running libdiscoal Tests ==========\n");
+    current_setUp = setUp_libdiscoal;
+    current_tearDown = tearDown_libdiscoal;
+    RUN_TEST(test_libdiscoal_pulls_each_replicate);
+    RUN_TEST(test_libdiscoal_sink_sees_the_same_replicates);
+    RUN_TEST(test_libdiscoal_trees_cover_the_locus);
+    RUN_TEST(test_libdiscoal_takes_genotypes_with_allele_codes);
+    RUN_TEST(test_libdiscoal_genotypes_match_push_down);
+    RUN_TEST(test_libdiscoal_one_context_at_a_time);
+    RUN_TEST(test_libdiscoal_racing_creates_open_one_context);
+    RUN_TEST(test_libdiscoal_rejected_arguments_are_recoverable);
+    RUN_TEST(test_libdiscoal_kept_buffers_stop_allocating);
+    
     return UNITY_END();
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include "unity.h"
 #include "../../discoal.h"
 #include "../../discoalFunctions.h"
+#include "../../ranlib.h"
+#include "../../rngStream.h"
 #include <stdlib.h>
+#include <math.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -257,6 +260,136 @@ void test_trajectory_file_persistence(void) {
     TEST_ASSERT_EQUAL(0, stat(testTrajFilename, &st));
 }
 
+// a sweep at time 0 followed by a halving of the population during the sweep
+static struct event sweepEvents[2];
+
+static void setUpSweepEvents(void) {
+    EFFECTIVE_POPN_SIZE = 10000;
+    deltaTMod = 40;
+    memset(sweepEvents, 0, sizeof(sweepEvents));
+    sweepEvents[0].type = 's';
+    sweepEvents[0].time = 0.0;
+    sweepEvents[1].type = 'n';
+    sweepEvents[1].time = 0.001;
+    sweepEvents[1].popnSize = 0.5;
+    events = sweepEvents;
+    eventNumber = 2;
+}
+
+// A replayed trajectory must match the stored one step for step, even with
+// draws from the main stream in between
+void test_replayed_trajectory_matches_stored(void) {
+    struct event *savedEvents = events;
+    int savedEventNumber = eventNumber;
+    double sizeRatio[1] = {1.0};
+    double finalFreq, storedAccept, replayAccept;
+    long steps, k;
+
+    setUpSweepEvents();
+
+    setall(3, 4);
+    trajectoryReplayMode = 0;
+    storedAccept = proposeTrajectory(0, NULL, sizeRatio, 's', 1.0 - 1.0 / 20000.0, &finalFreq, 500, 0, 0.0);
+    steps = totalTrajectorySteps;
+    TEST_ASSERT_TRUE(steps > 0);
+    mmapAcceptedTrajectory(trajectoryFilename, steps);
+    unlink(trajectoryFilename);
+
+    setall(3, 4);
+    trajectoryReplayMode = 1;
+    replayAccept = proposeTrajectory(0, NULL, sizeRatio, 's', 1.0 - 1.0 / 20000.0, &finalFreq, 500, 0, 0.0);
+    TEST_ASSERT_EQUAL(steps, totalTrajectorySteps);
+    TEST_ASSERT_TRUE(storedAccept == replayAccept);
+
+    for (k = 0; k < steps; k++) {
+        ranf();
+        TEST_ASSERT_EQUAL(1, trajectoryStepperNext(&replayStepper));
+        TEST_ASSERT_TRUE(replayStepper.x == currentTrajectory[k]);
+    }
+    TEST_ASSERT_EQUAL(0, trajectoryStepperNext(&replayStepper));
+
+    trajectoryReplayMode = 0;
+    events = savedEvents;
+    eventNumber = savedEventNumber;
+}
+
+// Speculative proposals pick the same trajectory whatever the thread timing,
+// and leave the main stream in the same place, stored or replayed
+void test_speculative_proposals_are_deterministic(void) {
+    struct event *savedEvents = events;
+    int savedEventNumber = eventNumber;
+    double sizeRatio[1] = {1.0};
+    long steps, k, stored1, stored2, replay1, replay2;
+
+    setUpSweepEvents();
+    trajectoryThreads = 4;
+
+    setall(5, 6);
+    trajectoryReplayMode = 0;
+    proposeTrajectorySpeculative(0, sizeRatio, 's', 1.0 - 1.0 / 20000.0, 500, 0, 0.0);
+    steps = totalTrajectorySteps;
+    TEST_ASSERT_TRUE(steps > 0);
+    getsd(&stored1, &stored2);
+    mmapAcceptedTrajectory(trajectoryFilename, steps);
+    unlink(trajectoryFilename);
+
+    setall(5, 6);
+    trajectoryReplayMode = 1;
+    proposeTrajectorySpeculative(0, sizeRatio, 's', 1.0 - 1.0 / 20000.0, 500, 0, 0.0);
+    TEST_ASSERT_EQUAL(steps, totalTrajectorySteps);
+    getsd(&replay1, &replay2);
+    TEST_ASSERT_EQUAL(stored1, replay1);
+    TEST_ASSERT_EQUAL(stored2, replay2);
+    for (k = 0; k < steps; k++) {
+        TEST_ASSERT_EQUAL(1, trajectoryStepperNext(&replayStepper));
+        TEST_ASSERT_TRUE(replayStepper.x == currentTrajectory[k]);
+    }
+
+    trajectoryThreads = 0;
+    trajectoryReplayMode = 0;
+    events = savedEvents;
+    eventNumber = savedEventNumber;
+}
+
+// Adaptive steps cover the same time as the base steps they stand for, keep
+// each move within the tolerance bound and take far fewer steps
+void test_adaptive_steps_respect_tolerance(void) {
+    struct event *savedEvents = events;
+    int savedEventNumber = eventNumber;
+    double sizeRatio[1] = {1.0};
+    trajectoryStepper ts;
+    long fixedSteps = 0, adaptiveSteps = 0, baseSteps = 0;
+    double lastX, bound;
+
+    setUpSweepEvents();
+
+    setall(7, 8);
+    adaptiveStepTolerance = 0.0;
+    trajectoryStepperInit(&ts, 0, sizeRatio, 's', 1.0 - 1.0 / 20000.0, 500, 0, 0.0);
+    while (trajectoryStepperNext(&ts)) fixedSteps++;
+
+    setall(7, 8);
+    adaptiveStepTolerance = 0.05;
+    trajectoryStepperInit(&ts, 0, sizeRatio, 's', 1.0 - 1.0 / 20000.0, 500, 0, 0.0);
+    lastX = ts.x;
+    while (trajectoryStepperNext(&ts)) {
+        TEST_ASSERT_TRUE(ts.substeps >= 1 && ts.substeps <= ADAPTIVE_MAX_SUBSTEPS);
+        if (ts.substeps > 1) {
+            bound = 2 * adaptiveStepTolerance * MIN(lastX, 1.0 - lastX);
+            TEST_ASSERT_TRUE(fabs(ts.x - lastX) <= bound * (1 + 1e-5));
+        }
+        baseSteps += ts.substeps;
+        adaptiveSteps++;
+        lastX = ts.x;
+    }
+    TEST_ASSERT_TRUE(fabs(baseSteps * ts.tIncOrig - ts.ttau) <= 1e-9 * ts.ttau);
+    TEST_ASSERT_TRUE(adaptiveSteps * 2 < fixedSteps);
+
+    adaptiveStepTolerance = 0.0;
+    events = savedEvents;
+    eventNumber = savedEventNumber;
+}
+
 #ifndef TEST_RUNNER_MODE
 int main(void) {
     UNITY_BEGIN();
@@ -273,6 +406,9 @@ int main(void) {
     RUN_TEST(test_trajectory_filename_generation);
     RUN_TEST(test_multiple_trajectory_cleanup);
     RUN_TEST(test_trajectory_file_persistence);
+    RUN_TEST(test_replayed_trajectory_matches_stored);
+    RUN_TEST(test_speculative_proposals_are_deterministic);
+    RUN_TEST(test_adaptive_steps_respect_tolerance);
     
     return UNITY_END();
 }
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""
+Check mergeShards.py against the serial run it reassembles.
+
+Build discoal first (make discoal), then run from this directory:
+
+    python3 test_mergeShards.py
+
+Each case is run as --shard 0/1 and as shards that add per-run options of
+their own; the merge must be the serial output byte for byte (apart from the
+program name in the header).
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DISCOAL = os.path.join(HERE, "..", "discoal")
+MERGE = os.path.join(HERE, "..", "mergeShards.py")
+
+# command line, shard count, and options each shard adds ({k} is its index)
+cases = [
+    ("12 9 1000 -t 10 -r 10 -d 1 2", 3, "--param-out {dir}/params{k}.txt"),
+    ("12 6 1000 -t 10 -r 10 -d 3 4", 2, "--keep-buffers --async-io"),
+    ("12 4 10000 -t 10 -r 10 -ws 0.05 -a 500 -d 5 6", 2, "--traj-threads 1 --replay-trajectory"),
+    ("12 4 10000 -t 10 -r 10 -ws 0.05 -a 500 -d 5 6 --traj-threads 2", 2, "--param-out {dir}/params{k}.txt"),
+]
+
+
+def run(args, out):
+    with open(out, "w") as f:
+        subprocess.run([DISCOAL] + args.split(), stdout=f, check=True)
+
+
+def check_case(args, shards, extra, tmp):
+    serial = os.path.join(tmp, "serial.out")
+    run(args + " --shard 0/1", serial)
+    names = []
+    for k in range(shards):
+        name = os.path.join(tmp, "shard%d.out" % k)
+        run("%s --shard %d/%d %s" % (args, k, shards, extra.format(dir=tmp, k=k)), name)
+        names.append(name)
+    merged = subprocess.run([sys.executable, MERGE] + names[::-1], capture_output=True, text=True)
+    if merged.returncode != 0:
+        return "merge failed: " + merged.stderr.strip()
+    with open(serial) as f:
+        expected = f.read()
+    if merged.stdout.split(" ", 1)[1] != expected.split(" ", 1)[1]:
+        return "merged output differs from the serial run"
+    return None
+
+
+def check_refused(tmp, shardArgs):
+    names = []
+    for k, args in enumerate(shardArgs):
+        name = os.path.join(tmp, "shard%d.out" % k)
+        run("%s --shard %d/2" % (args, k), name)
+        names.append(name)
+    merged = subprocess.run([sys.executable, MERGE] + names, capture_output=True, text=True)
+    return None if merged.returncode != 0 else "the shards were merged"
+
+
+def main():
+    failures = 0
+    for args, shards, extra in cases:
+        with tempfile.TemporaryDirectory() as tmp:
+            err = check_case(args, shards, extra, tmp)
+        print("%-50s %s" % ("%s + %s" % (args, extra.split(" ")[0]), "ok" if err is None else "FAILED: " + err))
+        failures += err is not None
+    # --traj-threads above 1 changes the trajectories, so it must match
+    refused = [("different -t refused", ["12 4 1000 -t 10 -r 10 -d 1 2", "12 4 1000 -t 20 -r 10 -d 1 2"]),
+               ("different --traj-threads refused", ["12 4 10000 -t 10 -r 10 -ws 0.05 -a 500 -d 5 6 --traj-threads 2",
+                                                     "12 4 10000 -t 10 -r 10 -ws 0.05 -a 500 -d 5 6 --traj-threads 3"])]
+    for name, shardArgs in refused:
+        with tempfile.TemporaryDirectory() as tmp:
+            err = check_refused(tmp, shardArgs)
+        print("%-50s %s" % (name, "ok" if err is None else "FAILED: " + err))
+        failures += err is not None
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
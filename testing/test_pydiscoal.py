@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""
+Check the pydiscoal extension against the discoal executable.
+
+Build both first (make discoal pydiscoal.so), then run from this directory:
+
+    python3 test_pydiscoal.py
+
+Every case is simulated by both with the same seeds; the arrays the extension
+returns must match the ms output of the executable site for site.
+"""
+
+import os
+import subprocess
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+import pydiscoal
+
+DISCOAL = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "discoal")
+
+cases = [
+    "10 3 1000 -t 10 -r 10 -d 1 2",
+    "20 2 10000 -t 20 -r 20 -ws 0.05 -a 500 -d 3 4",
+    "10 3 1000 -t 5 -r 5 -p 2 5 5 -ed 0.5 0 1 -d 5 6",
+    "8 2 1000 -t 5 -r 5 -A 2 0 0.1 -d 7 8",
+    "10 2 1000 -t 5 -r 5 -T -d 9 10",
+]
+
+
+def ms_replicates(args):
+    """Replicates of the executable as (positions text, haplotype rows) or tree lines."""
+    out = subprocess.run([DISCOAL] + args.split(), capture_output=True, text=True, check=True).stdout
+    blocks = out.split("\n//\n")[1:]
+    reps = []
+    for block in blocks:
+        lines = [l for l in block.split("\n") if l]
+        if lines[0].startswith("["):
+            reps.append(lines)
+            continue
+        positions = lines[1].split()[1:] if len(lines) > 1 and lines[1].startswith("positions:") else []
+        reps.append((positions, lines[2:] if positions else lines[1:]))
+    return reps
+
+
+def as_text(positions, haplotypes):
+    mv_pos = memoryview(positions)
+    mv_hap = memoryview(haplotypes)
+    rows, sites = mv_hap.shape
+    cells = mv_hap.tolist()
+    symbol = {0: "0", 1: "1", -1: "N"}
+    return (["%6.6f" % p for p in mv_pos.tolist()],
+            ["".join(symbol[c] for c in cells[i]) for i in range(rows)])
+
+
+def check_case(args):
+    expected = ms_replicates(args)
+    with pydiscoal.Simulator(args) as sim:
+        got = list(sim)
+    if len(got) != len(expected):
+        return "%d replicates, expected %d" % (len(got), len(expected))
+    for i, (rep, want) in enumerate(zip(got, expected)):
+        if isinstance(rep, list):
+            if ["[%d]%s" % tree for tree in rep] != want:
+                return "trees of replicate %d differ" % i
+        elif as_text(*rep) != (want[0], want[1]):
+            return "replicate %d differs" % i
+    return None
+
+
+def check_gil_released():
+    """Another Python thread keeps running while a replicate is simulated."""
+    ticks = [0]
+    done = threading.Event()
+
+    def count():
+        while not done.is_set():
+            ticks[0] += 1
+
+    t = threading.Thread(target=count)
+    t.start()
+    with pydiscoal.Simulator("50 1 100000 -t 100 -r 400 -d 1 2") as sim:
+        before = ticks[0]
+        next(sim)
+        during = ticks[0] - before
+    done.set()
+    t.join()
+    return None if during > 0 else "no progress in other threads during simulation"
+
+
+def check_arrays_outlive_replicate():
+    """The arrays of a replicate keep their values while later ones run."""
+    with pydiscoal.Simulator("20 5 10000 -t 20 -r 20 -d 11 12") as sim:
+        positions, haplotypes = next(sim)
+        saved = (bytes(memoryview(positions)), bytes(memoryview(haplotypes)))
+        for _ in sim:
+            pass
+    if (bytes(memoryview(positions)), bytes(memoryview(haplotypes))) != saved:
+        return "first replicate changed"
+    return None
+
+
+def check_reinit_while_running():
+    """__init__ refuses to replace a simulator another thread is running."""
+    sim = pydiscoal.Simulator("200 1 100000 -t 100 -r 2000 -d 1 2")
+    started = threading.Event()
+    err = None
+
+    def run():
+        started.set()
+        next(sim)
+
+    t = threading.Thread(target=run)
+    t.start()
+    started.wait()
+    time.sleep(0.2)
+    try:
+        sim.__init__("5 1 100 -t 2 -d 1 2")
+        err = "__init__ succeeded while next() was running"
+    except RuntimeError:
+        pass
+    t.join()
+    sim.close()
+    return err
+
+
+def main():
+    failures = 0
+    for args in cases:
+        err = check_case(args)
+        print("%-50s %s" % (args, "ok" if err is None else "FAILED: " + err))
+        failures += err is not None
+    for name, check in (("GIL released during simulation", check_gil_released),
+                        ("arrays outlive their replicate", check_arrays_outlive_replicate),
+                        ("__init__ refused while running", check_reinit_while_running)):
+        err = check()
+        print("%-50s %s" % (name, "ok" if err is None else "FAILED: " + err))
+        failures += err is not None
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""
+Check discoal --serve against the discoal executable.
+
+Build it first (make discoal), then run from this directory:
+
+    python3 test_serve.py
+
+One server answers every case in turn, so its kept buffers are reused across
+command lines of different sizes. The ms reply must be the executable's
+output byte for byte (apart from the program name in the header), and the
+binary reply must hold the same replicates.
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, ".."))
+import discoalClient
+
+DISCOAL = os.path.join(HERE, "..", "discoal")
+
+cases = [
+    "10 3 1000 -t 10 -r 10 -d 1 2",
+    "40 2 10000 -t 20 -r 20 -ws 0.05 -a 500 -d 3 4",
+    "10 3 1000 -t 5 -r 5 -p 2 5 5 -ed 0.5 0 1 -d 5 6",
+    "8 2 1000 -t 5 -r 5 -A 2 0 0.1 -d 7 8",
+    "10 2 1000 -t 5 -r 5 -T -d 9 10",
+    "12 4 1000 -t 5 -r 5 --shard 1/2 -d 11 12",
+    "10 3 1000 -t 10 -r 10 -d 1 2",
+]
+
+
+def executable(args):
+    return subprocess.run([DISCOAL] + args.split(), capture_output=True, text=True, check=True).stdout
+
+
+def from_ms(out):
+    reps = []
+    for block in out.split("\n//\n")[1:]:
+        lines = [l for l in block.split("\n") if l]
+        if lines[0].startswith("["):
+            reps.append([(int(l[1:l.index("]")]), l[l.index("]") + 1:]) for l in lines])
+            continue
+        positions = lines[1].split()[1:] if len(lines) > 1 and lines[1].startswith("positions:") else []
+        rows = lines[2:] if positions else lines[1:]
+        reps.append((positions, rows))
+    return reps
+
+
+def from_binary(reps):
+    symbol = {0: "0", 1: "1", -1: "N"}
+    out = []
+    for rep in reps:
+        if isinstance(rep, list):
+            out.append(rep)
+        else:
+            positions, rows = rep
+            out.append((["%6.6f" % p for p in positions], ["".join(symbol[c] for c in row) for row in rows]))
+    return out
+
+
+def main():
+    failures = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, "discoal.sock")
+        server = subprocess.Popen([DISCOAL, "--serve", path], stderr=subprocess.DEVNULL)
+        try:
+            while not os.path.exists(path):
+                time.sleep(0.05)
+            for args in cases:
+                expected = executable(args)
+                served = discoalClient.ms(path, args)
+                # the executable's header starts with the path it was run as
+                ok = served.split(" ", 1)[1] == expected.split(" ", 1)[1]
+                seed1, seed2, reps = discoalClient.replicates(path, args)
+                ok = ok and from_binary(reps) == from_ms(expected)
+                print("%s  %s" % ("ok  " if ok else "FAIL", args))
+                failures += not ok
+            try:
+                discoalClient.ms(path, "10 1 1000 -t 10 --bogus")
+                print("FAIL  bad parameters were accepted")
+                failures += 1
+            except ValueError:
+                print("ok    bad parameters rejected")
+            unseeded = discoalClient.ms(path, "10 1 1000 -t 10")
+            ok = unseeded.split("\n")[1] != discoalClient.ms(path, "10 1 1000 -t 10").split("\n")[1]
+            print("%s  fresh seeds for requests without -d" % ("ok  " if ok else "FAIL"))
+            failures += not ok
+        finally:
+            server.terminate()
+            server.wait()
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
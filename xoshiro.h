@@ -0,0 +1,80 @@
+#ifndef __XOSHIRO_H__
+#define __XOSHIRO_H__
+
+// xoshiro256++ (Blackman and Vigna), the generator behind --rng xoshiro.
+// With rngBackend == RNG_XOSHIRO, ranf() and everything built on it draws
+// from this generator instead of ranlib's combined MLCG; the ranlib stream
+// stays the default so existing seeds keep reproducing their output.
+
+#include <stdint.h>
+
+#define RNG_RANLIB 0
+#define RNG_XOSHIRO 1
+
+extern int rngBackend;
+
+static inline uint64_t xoshiroRotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t xoshiroNext(uint64_t s[4]) {
+	uint64_t result = xoshiroRotl(s[0] + s[3], 23) + s[0];
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = xoshiroRotl(s[3], 45);
+	return result;
+}
+
+// the top 53 bits, centred in their interval so that, like ranf(), neither
+// 0 nor 1 is ever returned
+static inline double xoshiroUnit(uint64_t s[4]) {
+	return ((xoshiroNext(s) >> 11) + 0.5) * 0x1.0p-53;
+}
+
+static inline uint64_t splitmix64(uint64_t *x) {
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// the state of stream number `stream` of the run seeded with (seed1, seed2);
+// splitmix64 never yields the all-zero state xoshiro cannot leave
+static inline void xoshiroSeed(uint64_t s[4], long seed1, long seed2, uint64_t stream) {
+	uint64_t x = ((uint64_t)seed1 << 32) ^ (uint32_t)seed2;
+	int i;
+
+	x = splitmix64(&x) ^ stream;
+	x = splitmix64(&x);
+	for (i = 0; i < 4; i++)
+		s[i] = splitmix64(&x);
+}
+
+// advances s by 2^128 draws
+static inline void xoshiroJump(uint64_t s[4]) {
+	static const uint64_t jump[4] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+	                                  0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+	uint64_t t[4] = { 0, 0, 0, 0 };
+	int i, b;
+
+	for (i = 0; i < 4; i++)
+		for (b = 0; b < 64; b++) {
+			if (jump[i] & (1ULL << b)) {
+				t[0] ^= s[0];
+				t[1] ^= s[1];
+				t[2] ^= s[2];
+				t[3] ^= s[3];
+			}
+			xoshiroNext(s);
+		}
+	for (i = 0; i < 4; i++)
+		s[i] = t[i];
+}
+
+#endif